@@ -1,11 +1,18 @@
 #pragma once
 
 #include "action_history.h"
+#include "arena.h"
+#include "hex_view.h"
+#include "line_index.h"
+#include "line_tree.h"
 #include "mode_command.h"
 #include "mode_find.h"
 #include "modes.h"
+#include "piece_table.h"
+#include "row_chunks.h"
 #include "syntaxes.h"
 #include <stdbool.h>
+#include <sys/types.h>
 #include <termios.h>
 #include <time.h>
 
@@ -13,6 +20,7 @@
 #define A1_CONFIG_DIR "a1"
 #define A1_CONFIG_FILE "a1rc" // rc = run commands
 #define A1_LOG_FILE "a1.log"
+#define A1_UNDO_DIR "undo" // within state directory, for undo journals
 
 typedef enum {
     TAB = 9,    // horizontal tab (\t)
@@ -21,8 +29,9 @@ typedef enum {
     SPACE = 32,
     BACKSPACE = 127, // del
 
-    // soft codes, not related to ASCII values
-    ARROW_LEFT = 1000,
+    // soft codes, beyond every Unicode code point (other keys being the code
+    // point typed)
+    ARROW_LEFT = 0x110000,
     ARROW_RIGHT,
     ARROW_UP,
     ARROW_DOWN,
@@ -35,28 +44,85 @@ typedef enum {
 
 typedef enum { DIR_UP, DIR_RIGHT, DIR_LEFT, DIR_DOWN } EditorDirection;
 
+// buffers of up to this size are stored in the row rather than allocated
+#define ROW_INLINE_SIZE 32
+#define ROW_INLINE_SPANS 2
+
+// run of rendered columns sharing a highlight
+typedef struct {
+    ssize_t start;           // first column of render
+    ssize_t len;             // number of columns
+    unsigned char highlight; // EditorHighlight
+} EditorHighlightSpan;
+
+// char of a row not taking one column per byte (a tab or a multi-byte char),
+// for converting between chars and rendered columns
 typedef struct {
-    int index;                // position in editor state rows array
-    int size;                 // size of row (excluding null character)
-    int render_size;          // size of rendered row
-    char *chars;              // row content
-    char *render;             // row content rendered to screen (needed for \t)
-    unsigned char *highlight; // contains EditorHighlight data mapped to render
-    bool hl_open_comment;     // if line is part of multi-line comment
-} EditorRow;
+    ssize_t idx; // index of char in chars
+    ssize_t col; // rendered column of char
+    int len;     // number of bytes
+    int width;   // number of columns, 0 for combining chars
+} EditorRowGlyph;
+
+// render of a multi-byte char (see utf8.h), which is drawn from chars: its
+// first column, followed by one for each further column it takes
+// (invalid bytes are rendered as '?', so render is otherwise ASCII)
+#define RENDER_GLYPH ((char)0x80)
+#define RENDER_GLYPH_CONT ((char)0x81)
+
+struct EditorRow {
+    EditorLineNode *leaf; // leaf of rows tree containing row
+    ssize_t size;         // size of row (excluding null character)
+    ssize_t render_size;  // size of rendered row
+    ssize_t render_start; // column of render[0], only non-zero when a long
+                          // row is rendered around the columns on screen
+    ssize_t capacity;     // size of owned chars, 0 if viewing piece table
+    ssize_t gap_start;    // index of gap in chars (equals size when flat)
+    ssize_t gap_len;      // length of gap following gap_start
+    char *chars;          // row content (not null-terminated if a view)
+    char *render; // row content rendered to screen, a byte per column
+                  // (needed for \t and multi-byte chars), shares chars if
+                  // identical
+    EditorHighlightSpan *highlight; // ordered spans of render (by column of
+                                    // row), columns outside any span are
+                                    // HL_NORMAL
+    int highlight_count;            // number of spans in highlight
+    bool render_stale;    // render and highlight need rebuilding (and are NULL
+                          // until then, see editor_prepare_row())
+    bool hl_open_comment; // if line is part of multi-line comment
+    bool from_pack;       // chars are an unchanged copy of a packed line
+    EditorRowChunks *chunks; // column index of long rows, NULL until needed
+    EditorRowGlyph *glyphs; // glyphs of other rows in order, built when
+                            // converting between columns and freed with
+                            // render
+    int glyph_count;        // number of glyphs, -1 until glyphs are indexed
+    bool ascii;             // no chars beyond ASCII, known once indexed
+
+    // storage for short rows, pointed to by the buffers above when they fit
+    char inline_chars[ROW_INLINE_SIZE];
+    char inline_render[ROW_INLINE_SIZE];
+    EditorHighlightSpan inline_highlight[ROW_INLINE_SPANS];
+};
 
 typedef struct {
     bool auto_indent; // automatically indent new line based on line above
     bool case_insensitive_search; // determines default config for find mode
     bool line_numbers;            // whether to show line numbers
     bool tab_character; // whether to insert \t character when TAB key pressed
-    int tab_stop;       // indentation amount
+    int tab_stop;        // indentation amount
+    size_t memory_limit; // bytes rows may use before the least recently used
+                         // are freed, 0 for no limit
+    size_t undo_limit;   // bytes undo history may use before the oldest
+                         // actions are dropped, 0 for no limit
 } EditorOptions;
 
 typedef struct {
     bool clean;             // do not apply config file (a1rc)
     char *config_file_path; // apply config file at path
     bool manual;            // whether to simply print the manual and exit
+    bool large;             // open file in large-file mode regardless of size
+    bool follow;            // follow appends to file
+    bool hex;               // view file as hex regardless of its contents
     char *file_path;        // the file to edit
 } EditorArguments;
 
@@ -66,17 +132,17 @@ typedef struct {
 } EditorFilePermissions;
 
 typedef struct {
-    int cursor_x; // actual cursor x position
-    int cursor_y; // actual cursor y position
-    int target_x; // intended x position of cursor based on previous line(s)
-    int render_x; // rendered position of cursor
-    int row_scroll_offset; // offset of rows displayed (vertical scroll)
-    int col_scroll_offset; // offset of columns display (horizontal scroll)
-    int num_col_width;     // how many cells across the line numbers take
-    int screen_rows;       // number of rows available in the emulator window
-    int screen_cols;       // number of columns available in the emulator window
-    int num_rows;          // number of rows that make up the text buffer
-    EditorRow *rows;       // dynamic array of rows
+    ssize_t cursor_x; // actual cursor x position
+    int cursor_y;     // actual cursor y position
+    ssize_t target_x; // intended x position of cursor based on previous line(s)
+    ssize_t render_x; // rendered position of cursor
+    int row_scroll_offset;     // offset of rows displayed (vertical scroll)
+    ssize_t col_scroll_offset; // offset of columns display (horizontal scroll)
+    int num_col_width;    // how many cells across the line numbers take
+    int screen_rows;      // number of rows available in the emulator window
+    int screen_cols;      // number of columns available in the emulator window
+    int num_rows;         // number of rows that make up the text buffer
+    EditorLineTree *rows; // balanced tree of rows
     const EditorMode *mode;           // normal, insert, command etc.
     EditorCommandState command_state; // to store command mode variables
     EditorFindState find_state;       // to store find mode variables
@@ -92,6 +158,11 @@ typedef struct {
     const EditorSyntax
         *syntax; // the syntax highlighting info for the current file
     EditorActionHistory *action_history;
+    EditorPieceTable *piece_table; // backing text for unmodified rows
+    EditorLineIndex *line_index;   // lines of mapped file, in large-file mode
+                                   // (rows are then loaded when accessed)
+    EditorArena *arena;            // storage for chars, render and highlight
+    EditorHexView *hex_view;       // file viewed as hex, NULL when editing
 } EditorState;
 
 extern EditorState editor_state;
@@ -1,5 +1,44 @@
 #pragma once
 
+// Undo history, as a log of the edits made to the text.
+//
+// Each action is stored as a delta (where it was made, the bytes it removed
+// and the bytes it inserted) packed one after another into a single buffer.
+// Undoing an action applies its delta in reverse, so costs only the size of
+// the change however large the file.
+//
+// Actions undone are never discarded: an action made after undoing starts a
+// new branch, so the actions form a tree. Each has a node (its record, the
+// node of the action it was made after, and when it was made) in a flat array
+// in the order they were made. The text has a state for each action, that
+// after it, with state 0 being the text before any. Redo follows the branch
+// last made or moved back from, and moving between any two states undoes
+// back to where their branches meet, then redoes down the other.
+//
+// Positions are in bytes of text, a newline between rows counting as one.
+//
+// Typing is recorded a char at a time, but consecutive changes to a row in
+// insert mode are merged into the last record while they continue it, so that
+// a run of typing (with any backspacing) takes one record and is undone in one
+// step. A run ends when the cursor is moved, the mode changes, or after a
+// pause.
+//
+// The log of a file is kept in a journal (a file of its own), mapped into
+// memory and written to in place as actions are recorded, so that it survives
+// the editor being closed. Alongside the log the journal holds what identifies
+// the file's text as last opened or saved (its inode, size and modification
+// time, and a hash of samples of the text, so that it takes the same time for
+// a file of any size), and the state it is at. When the file is opened again
+// unchanged, the journal is mapped as it is, with the tree rebuilt from the
+// headers of its records (no action is applied), and actions are undone and
+// redone from it from there.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
 typedef struct EditorActionHistory EditorActionHistory;
 
 typedef enum {
@@ -15,9 +54,72 @@ typedef enum {
     ACTION_INVERT_LETTER
 } EditorActionType;
 
-EditorActionHistory *editor_action_history_create(void);
-void editor_record_action(EditorActionHistory *ah, int cursor_x, int cursor_y,
-                          char *data, EditorActionType type);
-void editor_undo_action(EditorActionHistory *ah);
-void editor_redo_action(EditorActionHistory *ah);
+// removed_len bytes of text at (x, y) replaced by inserted_len bytes
+typedef struct {
+    EditorActionType type;
+    int y;
+    ssize_t x;
+    const char *removed;
+    size_t removed_len;
+    const char *inserted;
+    size_t inserted_len;
+} EditorAction;
+
+// applies delta of action to the text, returns false (leaving the text as it
+// is) if the text at (x, y) is not the text removed by the action
+typedef bool (*EditorActionApplier)(const EditorAction *action);
+
+// limit is bytes the log may take before the oldest actions are dropped,
+// 0 for no limit
+EditorActionHistory *editor_action_history_create(size_t limit);
+void editor_action_history_set_limit(EditorActionHistory *ah, size_t limit);
+// keeps the log in the journal at journal_path, text (of len bytes) being the
+// file's text as just opened or written (whose stat is st), which is at the
+// current state, restoring the journal left for it if there are no actions yet
+void editor_action_history_attach(EditorActionHistory *ah,
+                                  const char *journal_path,
+                                  const struct stat *st, const char *text,
+                                  size_t len);
+// drops every action, e.g. after the text is replaced by the file on disk
+void editor_action_history_clear(EditorActionHistory *ah);
+// drops every action and deletes the journal, for a log found not to match the
+// text (e.g. the journal of a file changed in place without its size or
+// modification time changing, which its identity cannot tell), the journal
+// being made again when the file is next saved
+void editor_action_history_drop(EditorActionHistory *ah);
+// adds action (copying its text) after the current state, merged into the
+// last action if it continues its run (ACTION_MODIFY_LINE)
+void editor_record_action(EditorActionHistory *ah, const EditorAction *action);
+// ends the current run, so that the next action is recorded on its own
+void editor_action_history_break(EditorActionHistory *ah);
+// steps back over the last action, setting action to the delta reversing it,
+// returns false if there is none
+// text of action points into the log, valid until the next action is recorded
+bool editor_undo_action(EditorActionHistory *ah, EditorAction *action);
+// steps forward over the action redo follows (the last undone), setting action
+// to it, returns false if there is none
+bool editor_redo_action(EditorActionHistory *ah, EditorAction *action);
+
+// returns current state, 0 to editor_action_history_states() - 1, states
+// being numbered in the order they were reached
+size_t editor_action_history_state(const EditorActionHistory *ah);
+size_t editor_action_history_states(const EditorActionHistory *ah);
+// returns when state was reached (0 if there are no actions)
+time_t editor_action_history_state_time(const EditorActionHistory *ah,
+                                        size_t state);
+// returns newest state reached at or before time, 0 if none
+size_t editor_action_history_state_at(const EditorActionHistory *ah,
+                                      time_t time);
+// moves to state along the branches of the tree, passing each action undone
+// (reversed) or redone to apply, returns false if apply fails, stopping there
+// (with the history to be dropped, as it no longer matches the text)
+bool editor_action_history_goto(EditorActionHistory *ah, size_t state,
+                                EditorActionApplier apply);
+// makes redo follow the next branch made from the current state (wrapping
+// around), returns its number from 1 and sets count to the number of
+// branches, returns 0 if there are none
+int editor_action_history_next_branch(EditorActionHistory *ah, int *count);
+// returns bytes held in memory by the tree and log (the log taking none if
+// mapped from a journal)
+size_t editor_action_history_memory(const EditorActionHistory *ah);
 void editor_action_history_destroy(EditorActionHistory *ah);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Allocator for the many small buffers owned by rows (chars, render and
+// highlight). Requests are rounded up to a size class and carved out of large
+// slabs, avoiding a malloc header per buffer. Requests larger than the biggest
+// size class are passed through to malloc. As with a sized free, callers must
+// pass the size they allocated when reallocating or freeing.
+
+typedef struct EditorArena EditorArena;
+
+typedef struct {
+    size_t slabs;       // number of slabs held
+    size_t slab_bytes;  // bytes held in slabs
+    size_t used_bytes;  // bytes of slabs handed out (after rounding)
+    size_t large_bytes; // bytes passed through to malloc
+    size_t allocations; // live allocations (slab and large)
+} EditorArenaStats;
+
+EditorArena *editor_arena_create(void);
+void *editor_arena_alloc(EditorArena *arena, size_t size);
+void *editor_arena_realloc(EditorArena *arena, void *ptr, size_t old_size,
+                           size_t new_size);
+void editor_arena_free(EditorArena *arena, void *ptr, size_t size);
+
+// Compaction moves live buffers out of sparsely used slabs so that those slabs
+// can be released. It is run as begin, relocate (for every live buffer), end.
+// Chunks of an evacuated slab are never reused, and the slab is released once
+// all of its buffers have been relocated or freed.
+
+// marks sparse slabs for evacuation, returns false if there are none
+bool editor_arena_compact_begin(EditorArena *arena);
+// returns new location of buffer if it was in an evacuated slab, else ptr
+void *editor_arena_relocate(EditorArena *arena, void *ptr, size_t size);
+// releases empty slabs, returns number of bytes released
+size_t editor_arena_compact_end(EditorArena *arena);
+// whether enough of the held memory is unused for compaction to be worthwhile
+bool editor_arena_is_fragmented(const EditorArena *arena);
+
+void editor_arena_get_stats(const EditorArena *arena, EditorArenaStats *stats);
+void editor_arena_destroy(EditorArena *arena);
@@ -9,9 +9,39 @@ bool file_exists(const char *file_path);
 bool regular_file_exists(const char *file_path);
 void get_file_permissions(const char *file_path,
                           EditorFilePermissions *file_permissions);
+// rows are only inserted for the start of the file, see
+// editor_continue_loading()
 void editor_open_text_file(const char *file_path);
+// maps the file to be viewed as hex, without any rows, see hex_view.h
+void editor_open_hex_file(const char *file_path);
+// rows are inserted as text is read from fd (e.g. a pipe), which is closed at
+// its end, see editor_continue_loading()
+void editor_open_stream(int fd);
+// appends to the opened file are read as they are written, and added as rows,
+// see editor_continue_loading()
+// returns false, with a status message, if the file cannot be followed
+bool editor_start_following(void);
+void editor_stop_following(void);
+bool editor_is_following(void);
+// inserts the next batch of rows of the opened file or stream (or what has
+// been appended to a followed file), or adds lines indexed in the background
+// since the last call (large-file mode)
+// also reports (or reloads) changes made to the file by other programs
+// returns false once fully loaded with nothing to watch, otherwise sets how
+// long to wait (ms, -1 for indefinitely) before calling again, cut short by
+// input on wait_fd if not -1
+bool editor_continue_loading(int *wait, int *wait_fd);
+// loads the rest of the file, for operations needing all of it
+// streams are left as they are, as they may never end
+void editor_finish_loading(void);
+// returns percentage of file loaded, or -1 when not loading (or a stream)
+int editor_loading_progress(void);
+// replaces the rows of lines changed on disk by another program, keeping the
+// rest, along with the cursor and scroll offset
+void editor_reload_file(void);
 // pass in NULL for file_path to save to same location
-void editor_save_text_buffer(const char *file_path);
+// unless forced, refuses to overwrite changes made by another program
+void editor_save_text_buffer(const char *file_path, bool force);
 // checks if $XDG_CONFIG_HOME is set before using $HOME
 // heap-allocated, caller frees returned string
 char *editor_get_default_config_file_path(void);
@@ -0,0 +1,62 @@
+#pragma once
+
+// Hex and ASCII view of a file which is not text (e.g. a core dump or other
+// binary blob), in lines of 16 bytes. The file is mapped read-only and no rows
+// are made for it: lines are formatted straight from the mapping as they are
+// drawn, so that only the pages on screen are ever read and a file of any
+// size opens instantly.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HEX_VIEW_LINE_BYTES 16
+// longest formatted line, see editor_hex_view_format_line()
+#define HEX_VIEW_LINE_MAX 96
+// files with a null byte among their first bytes are viewed as hex
+#define HEX_VIEW_SNIFF_SIZE 8000
+
+typedef struct {
+    int fd;
+    const unsigned char *data; // mapping of the file, NULL if empty
+    size_t size;
+    int offset_digits;  // hex digits offsets are drawn with, at least 8
+    size_t cursor;      // offset of byte under cursor
+    size_t scroll_line; // first line on screen
+    unsigned char *pattern; // last searched for, NULL if none
+    size_t pattern_len;
+} EditorHexView;
+
+// whether file looks binary (contains a null byte near its start)
+bool editor_hex_view_is_binary(const char *file_path);
+// maps file, returns NULL (with errno set) on failure
+EditorHexView *editor_hex_view_open(const char *file_path);
+void editor_hex_view_close(EditorHexView *view);
+// maps the file again if its size changed on disk (so that bytes cut off by
+// truncating it are never read), returns whether it did
+bool editor_hex_view_refresh(EditorHexView *view);
+// returns number of lines, at least one (an empty file has one empty line)
+size_t editor_hex_view_lines(const EditorHexView *view);
+// returns bytes of line, setting len (less than a whole line for the last)
+const unsigned char *editor_hex_view_line(const EditorHexView *view,
+                                          size_t line, size_t *len);
+// writes line to buf (of HEX_VIEW_LINE_MAX) as its offset, its bytes in hex
+// and its bytes as ASCII (like hexdump -C), returns its length
+int editor_hex_view_format_line(const EditorHexView *view, size_t line,
+                                char *buf);
+// sets columns of formatted line at which byte i of the line is drawn in hex
+// and as ASCII
+void editor_hex_view_byte_cols(const EditorHexView *view, int i, int *hex_col,
+                               int *ascii_col);
+
+// parses offset in decimal or hex (with 0x prefix), returns false if invalid
+bool editor_hex_view_parse_offset(const char *string, size_t *offset);
+// parses words of pattern into bytes, each word being hex digits (bytes
+// written as pairs, e.g. "7f454c46") or quoted text (e.g. "\"ELF\""),
+// returns heap-allocated bytes, or NULL if invalid
+unsigned char *editor_hex_view_parse_pattern(char **words, int count,
+                                             size_t *len);
+// finds next match of the view's pattern after (or before) the cursor,
+// wrapping around the file, setting offset and wrapped if it did
+// returns false if there is none
+bool editor_hex_view_find(const EditorHexView *view, bool forward,
+                          size_t *offset, bool *wrapped);
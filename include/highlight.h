@@ -13,9 +13,19 @@ typedef enum {
     HL_MATCH
 } EditorHighlight;
 
+// highlights are rebuilt lazily, with editor_prepare_row(), but multi-line
+// comment state is kept up to date as it carries over between rows
+
+// marks row for highlighting and updates its multi-line comment state, along
+// with following rows affected by a change in that state
 void editor_update_syntax_highlight(EditorRow *row);
+// as above for count rows in a single pass
+void editor_update_syntax_highlight_rows(EditorRow *first, int count);
 void editor_update_syntax_highlight_all(void);
-void editor_apply_find_mode_highlights(void);
+// returns highlight spans of render, valid until the next call
+// to be called by editor_prepare_row()
+const EditorHighlightSpan *editor_highlight_row(const EditorRow *row,
+                                               int *count);
 char *editor_syntax_to_sequence(EditorHighlight highlight);
 // sets editor syntax to appropriate struct based on file extension
 void editor_set_syntax(char *file_name);
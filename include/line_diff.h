@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Lines two versions of a text have in common, found by comparing a hash of
+// each line, so that only the lines which differ need replacing when a file is
+// reloaded.
+
+// run of count equal lines, starting at old_line and new_line
+typedef struct {
+    int old_line;
+    int new_line;
+    int count;
+} EditorDiffMatch;
+
+// hash of a line's chars (excluding line-ending characters)
+uint64_t editor_line_hash(const char *chars, size_t len);
+
+// returns the runs of equal lines of old and new in order, setting count, or
+// NULL if there are none (or memory ran out, in which case every line differs)
+// heap-allocated, caller frees returned array
+EditorDiffMatch *editor_diff_lines(const uint64_t *old_hashes, int old_count,
+                                   const uint64_t *new_hashes, int new_count,
+                                   int *count);
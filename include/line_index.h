@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Start offsets of every line of a text (the mapped file in large-file mode),
+// so that any line can be found without scanning the text before it. At 8
+// bytes a line this is far smaller than a row, letting rows be created only
+// for the lines actually viewed or edited.
+//
+// The text is indexed by a background thread, front to back, with lines
+// becoming available in batches as it goes. Lines which are available may be
+// read at any time, the rest of the index is only read by the indexing thread.
+
+typedef struct EditorLineIndex EditorLineIndex;
+
+// starts indexing text in the background
+EditorLineIndex *editor_line_index_create(const char *text, size_t size);
+// returns number of lines available so far, setting complete (unless NULL)
+// once indexing has finished
+int editor_line_index_count(EditorLineIndex *index, bool *complete);
+// returns how many bytes of text have been indexed so far
+size_t editor_line_index_indexed(EditorLineIndex *index);
+// waits until count lines are available or indexing has finished, returns
+// number of lines available
+int editor_line_index_wait_for(EditorLineIndex *index, int count);
+// waits for indexing to finish, returns errno value if it failed (EFBIG for
+// more than INT_MAX lines), else 0
+int editor_line_index_wait(EditorLineIndex *index);
+// returns start of line, setting len (excluding line-ending characters)
+const char *editor_line_index_line(const EditorLineIndex *index, int line,
+                                   size_t *len);
+// returns the available line starting at start (a pointer into the text), or
+// -1 if none does
+int editor_line_index_find(EditorLineIndex *index, const char *start);
+// returns text of count lines from line onwards, including the newlines
+// between them but not after the last, setting len
+// only valid when there are no carriage returns to strip
+const char *editor_line_index_lines(const EditorLineIndex *index, int line,
+                                    int count, size_t *len);
+// whether any line ends in carriage returns, which rows do not include
+// only valid once indexing has finished
+bool editor_line_index_has_carriage_returns(const EditorLineIndex *index);
+// stops indexing if still in progress
+void editor_line_index_destroy(EditorLineIndex *index);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+
+// Lines of text held compressed (see lz.h), for text kept by nothing else
+// (e.g. text piped to stdin), so that lines which are not being viewed take a
+// fraction of their size. Reading a line decompresses the whole pack, with the
+// pack last read kept decompressed so that reading its other lines is cheap.
+//
+// A pack is shared by the unloaded leaves of the rows tree standing for its
+// lines, and freed once the last reference to it is released.
+//
+// So that memory does not grow with the text (e.g. of a long-running log),
+// once packs hold more than LINE_PACKS_RESIDENT_SIZE the data of the oldest is
+// moved to an unlinked temporary file, to be read back from it (as lines of a
+// file in large-file mode are) when one of its lines is read.
+
+// text is split into packs of about this size, larger packs compress better
+// but take longer to read a line from
+#define LINE_PACK_SIZE (64 * 1024)
+// compressed text kept in memory before the oldest packs are moved to disk
+#define LINE_PACKS_RESIDENT_SIZE (16 * 1024 * 1024)
+
+typedef struct EditorLinePack EditorLinePack;
+
+// compresses the lines of text (split as editor_insert_rows() splits them),
+// returns pack with a single reference, or NULL if text is empty
+EditorLinePack *editor_line_pack_create(const char *text, size_t len);
+int editor_line_pack_count(const EditorLinePack *pack);
+// returns start of line, setting len (excluding line-ending characters)
+// valid until a line of another pack is read
+const char *editor_line_pack_line(EditorLinePack *pack, int line, size_t *len);
+void editor_line_pack_retain(EditorLinePack *pack);
+// frees pack once every reference has been released
+void editor_line_pack_release(EditorLinePack *pack);
+// returns bytes held in memory by every pack, setting text_size (unless NULL)
+// to the size of the text they hold, and spilled (unless NULL) to the
+// size of the data moved to the temporary file
+size_t editor_line_pack_memory(size_t *text_size, size_t *spilled);
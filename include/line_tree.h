@@ -0,0 +1,85 @@
+#pragma once
+
+// A B+ tree holding the rows of the text buffer. Leaves hold rows and every
+// node records how many rows are beneath it, so that looking up, inserting and
+// deleting a row by index are all O(log n). A row's index is derived by
+// walking from its leaf up to the root rather than being stored.
+//
+// A leaf may instead be unloaded, standing for a range of lines of a source
+// text (the mapped file in large-file mode) or of a pack of compressed lines,
+// without holding their rows. The rows are created by the tree's loader, a
+// leaf's worth at a time, when any of them is first accessed, so every
+// function returning a row may load rows.
+
+#include "line_pack.h"
+#include <stdbool.h>
+
+typedef struct EditorRow EditorRow;
+typedef struct EditorLineNode EditorLineNode;
+typedef struct EditorLineTree EditorLineTree;
+
+// creates the row for a line of pack, or of the source text if pack is NULL
+typedef EditorRow *(*EditorLineLoader)(EditorLinePack *pack, int line);
+
+// the tree in order as runs of either a single loaded row or all the lines of
+// an unloaded leaf, for walking every line without loading any
+typedef struct {
+    EditorLineNode *leaf; // leaf containing run
+    int position;         // position of row within leaf
+    EditorRow *row;       // loaded row, NULL for unloaded lines
+    int source_line;      // first line of source text (unloaded lines only)
+    EditorLinePack *pack; // pack holding unloaded lines (from source_line),
+                          // NULL if they are lines of the source text
+    int count;            // number of lines in run
+} EditorLineRun;
+
+EditorLineTree *editor_line_tree_create(EditorLineLoader load_row);
+int editor_line_tree_count(const EditorLineTree *tree);
+EditorRow *editor_line_tree_get(EditorLineTree *tree, int index);
+// index may equal count to append
+void editor_line_tree_insert(EditorLineTree *tree, int index, EditorRow *row);
+// inserts count rows at index, filling whole leaves at a time
+void editor_line_tree_insert_many(EditorLineTree *tree, int index,
+                                  EditorRow **rows, int count);
+// appends count unloaded lines, from source_line of pack (taking a reference)
+// or of the source text (pack NULL) onwards
+void editor_line_tree_append_unloaded(EditorLineTree *tree,
+                                      EditorLinePack *pack, int source_line,
+                                      int count);
+// returns removed row (which is not freed)
+EditorRow *editor_line_tree_remove(EditorLineTree *tree, int index);
+int editor_line_tree_index_of(const EditorRow *row);
+// neighbouring rows, NULL at either end of the tree
+EditorRow *editor_line_tree_next(const EditorRow *row);
+EditorRow *editor_line_tree_prev(const EditorRow *row);
+// returns false if tree is empty
+bool editor_line_tree_first_run(const EditorLineTree *tree,
+                                EditorLineRun *run);
+// advances run, returns false after the last run
+// rows may not be inserted or removed during the walk
+bool editor_line_tree_next_run(EditorLineRun *run);
+// sets the first source line of an unloaded run, after the source text changes
+// (packed lines become lines of the source text)
+void editor_line_tree_rebase_run(EditorLineRun *run, int source_line);
+
+// Leaves record when they were last accessed, so that the least recently used
+// rows can be unloaded again (see editor_limit_rows_memory()).
+
+// starts a new period of use
+void editor_line_tree_tick(EditorLineTree *tree);
+// whether leaf has been accessed since the last tick
+bool editor_line_node_used_since_tick(const EditorLineNode *leaf);
+// returns heap-allocated array of leaves holding rows, least recently used
+// first, setting count
+EditorLineNode **editor_line_tree_loaded_leaves(const EditorLineTree *tree,
+                                                int *count);
+// returns rows of leaf, setting count
+EditorRow **editor_line_node_rows(EditorLineNode *leaf, int *count);
+// makes a loaded leaf stand for its lines from source_line of pack (taking a
+// reference) or of the source text (pack NULL) onwards, once the caller has
+// freed its rows (leaf may be freed)
+void editor_line_tree_unload(EditorLineNode *leaf, EditorLinePack *pack,
+                             int source_line);
+
+// frees nodes but not the rows within
+void editor_line_tree_destroy(EditorLineTree *tree);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Fast LZ77 block compression, in the style of LZ4, for holding text which is
+// rarely read (see line_pack.h). A block is a series of sequences, each a run
+// of literal bytes followed by a copy of earlier output, with the last
+// sequence having literals only:
+//
+//   token          high 4 bits literal length, low 4 bits match length - 4,
+//                  either being 15 when continued in further length bytes
+//   [length bytes] 255 while the length continues, then the remainder
+//   literals
+//   offset         2 bytes little-endian, distance back to the match
+//   [length bytes] of match length, as above
+//
+// Compression favours speed, finding matches through a single hash table of
+// recent positions, as text is compressed as it is read.
+
+// returns the largest compressed size of len bytes (for sizing dst)
+size_t editor_lz_bound(size_t len);
+// compresses len bytes of src into dst, returns compressed size
+size_t editor_lz_compress(const char *src, size_t len, unsigned char *dst);
+// decompresses block of src_len bytes into dst, which must hold exactly len
+// bytes, returns false if block is corrupt
+bool editor_lz_decompress(const unsigned char *src, size_t src_len, char *dst,
+                          size_t len);
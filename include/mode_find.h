@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <sys/types.h>
 
 typedef struct {
     char *string;
@@ -8,7 +9,7 @@ typedef struct {
 } FindModeData;
 
 typedef struct {
-    int col;
+    ssize_t col;
     int row;
 } FindMatch;
 
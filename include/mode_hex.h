@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdbool.h>
+
+void mode_hex_entry(void *data);
+void mode_hex_input(int input);
+void mode_hex_exit(void);
+// moves cursor to next (or previous) match of the hex view's pattern,
+// returns whether there is one
+bool mode_hex_find_next(bool forward);
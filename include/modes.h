@@ -11,5 +11,8 @@ extern const EditorMode normal_mode;
 extern const EditorMode insert_mode;
 extern const EditorMode command_mode;
 extern const EditorMode find_mode;
+extern const EditorMode hex_mode;
 
 void mode_transition(const EditorMode *new_mode, void *data);
+// returns mode returned to after a command, hex mode when viewing hex
+const EditorMode *mode_default(void);
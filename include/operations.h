@@ -2,13 +2,61 @@
 
 #include "a1.h"
 
+// returns NULL if row_idx is out of range
+EditorRow *editor_get_row(int row_idx);
+// derived from position in rows tree, O(log n)
+int editor_get_row_index(const EditorRow *row);
+
+// creates row viewing line of the mapped file, or holding a copy of a line of
+// pack, loader of the rows tree
+EditorRow *editor_load_row(EditorLinePack *pack, int line);
+// appends count lines of the mapped file, from source_line onwards, whose rows
+// are only created when accessed (large-file mode)
+void editor_append_unloaded_rows(int source_line, int count);
+// appends a row for each line of text, held compressed until accessed
+// returns false, stopping short, if there would be more than INT_MAX rows
+bool editor_append_packed_rows(const char *text, size_t len);
+// returns text of a line of an unloaded run without loading it, setting len
+// valid until another packed line is read
+const char *editor_unloaded_line(const EditorLineRun *run, int line,
+                                 size_t *len);
+
+// string is copied into the piece table's add buffer
 void editor_insert_row(int row_idx, const char *string, size_t len);
-void editor_insert_char_in_row(EditorRow *row, int col_idx, int c);
+// row views chars directly, which must outlive it (e.g. the mapped file)
+void editor_insert_row_view(int row_idx, const char *chars, size_t len);
+// inserts a row for each line of text in a single pass (carriage returns
+// before newlines are stripped), text is copied into the add buffer
+// returns false, inserting nothing, if there would be more than INT_MAX rows
+bool editor_insert_rows(int row_idx, const char *text, size_t len);
+// as above, with rows viewing text directly
+bool editor_insert_rows_view(int row_idx, const char *text, size_t len);
+// inserts code point c, encoded as UTF-8
+void editor_insert_char_in_row(EditorRow *row, ssize_t col_idx, int c);
 
+// flattens the chars of the row being typed into back into a regular string
+// must be called before taking pointers into that row's chars
+void editor_close_row_gap(void);
+// applies keys typed into the row being typed into since last called (see
+// editor_update_row()), must be called before drawing
+void editor_update_gap_row(void);
+
+// marks render and highlight of row to be rebuilt, and updates multi-line
+// comment state, after its chars have changed
 void editor_update_row(EditorRow *row);
+// frees render and highlight of row, to be rebuilt when next needed
+void editor_invalidate_row(EditorRow *row);
+// rebuilds render and highlight of row if invalidated
+// must be called before reading either (e.g. when drawing or measuring)
+void editor_prepare_row(EditorRow *row);
+// indexes glyphs of row (see EditorRowGlyph) if invalidated (along with
+// render), for converting between chars and rendered columns without scanning
+// the row, all-ASCII rows being checked a vector at a time and then searched
+// for tabs alone
+void editor_prepare_row_glyphs(EditorRow *row);
 void editor_append_string_to_row(EditorRow *row, const char *string,
                                  size_t len);
-void editor_invert_letter_at_row(EditorRow *row, int col_idx);
+void editor_invert_letter_at_row(EditorRow *row, ssize_t col_idx);
 // remove chars without removing row itself
 void editor_clear_row(EditorRow *row);
 // inserts spaces or tabs to match indentation of row above
@@ -17,8 +65,47 @@ void editor_clear_row(EditorRow *row);
 int editor_auto_indent_row(EditorRow *row);
 
 void editor_del_row(int row_idx);
+// frees row and its buffers, row must not be accessed through rows tree after
+void editor_free_row(EditorRow *row);
+// frees every row and the rows tree itself
+void editor_free_rows(void);
+// moves row buffers out of sparsely used arena slabs so those slabs can be
+// released, returns number of bytes released
+size_t editor_compact_rows(void);
+// returns approximate number of bytes held by rows and their buffers
+size_t editor_rows_memory(void);
+// when rows are using more than the memory limit, frees the least recently
+// used rows not accessed since the rows tree's last tick, down to well below
+// the limit
+// unmodified rows of the mapped file (large-file mode) are unloaded, and
+// unmodified rows of packed lines packed again, to be loaded again when
+// accessed, others only have their render and highlight freed
+void editor_limit_rows_memory(void);
 // called when user backspaces at beginning of line and there is a line above to
 // be added to
 void editor_del_to_previous_row(int row_idx);
-void editor_del_to_end_of_row(EditorRow *row, int col_idx);
-void editor_del_char_at_row(EditorRow *row, int col_idx);
+void editor_del_to_end_of_row(EditorRow *row, ssize_t col_idx);
+// deletes the char starting at col_idx, with any combining chars after it
+void editor_del_char_at_row(EditorRow *row, ssize_t col_idx);
+// replaces row's chars with a view of identical text, freeing owned chars
+void editor_rebase_row(EditorRow *row, const char *chars);
+
+// replaces removed_len bytes of text at (col_idx, row_idx) with len bytes of
+// text, either of which may span rows (a newline between rows counting as one
+// byte), costing O(change) rather than O(file)
+void editor_replace_text(int row_idx, ssize_t col_idx, size_t removed_len,
+                         const char *text, size_t len);
+// edits are recorded in the undo history (see action_history.h) by the modes
+// making them, with the text read from the rows
+// records that len bytes of text at (col_idx, row_idx) are about to be deleted
+void editor_record_delete(EditorActionType type, int row_idx, ssize_t col_idx,
+                          size_t len);
+// records that len bytes of text were just inserted at (col_idx, row_idx)
+void editor_record_insert(EditorActionType type, int row_idx, ssize_t col_idx,
+                          size_t len);
+// records that the char at (col_idx, row_idx) is about to be replaced with c
+void editor_record_replace(EditorActionType type, int row_idx,
+                           ssize_t col_idx, char c);
+// applies delta of action undone or redone, moving the cursor to where it was
+// made, returns false if the text does not match it (see EditorActionApplier)
+bool editor_apply_action(const EditorAction *action);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The text of the buffer is held in two places: the original file, mapped
+// read-only, and an append-only 'add' buffer holding any text inserted since.
+// Rows act as the pieces, each viewing a span of one of these until modified,
+// at which point the row takes its own copy of the text.
+
+typedef struct EditorPieceTable EditorPieceTable;
+
+EditorPieceTable *editor_piece_table_create(void);
+// maps the file as the original text, replacing any previous original
+// the previous original remains readable, for rows still viewing it, until
+// released (or the next load)
+// falls back to reading the file if it cannot be mapped (e.g. procfs files)
+// returns false on failure
+bool editor_piece_table_load_file(EditorPieceTable *pt, int fd);
+// takes text (allocated with malloc()) as the original, replacing any previous
+// original as above
+void editor_piece_table_load_text(EditorPieceTable *pt, char *text,
+                                  size_t size);
+// returns original text (NULL if empty), setting size
+const char *editor_piece_table_original(const EditorPieceTable *pt,
+                                        size_t *size);
+// copies string into add buffer, returned pointer remains valid until reset
+const char *editor_piece_table_append(EditorPieceTable *pt, const char *string,
+                                      size_t len);
+// discards previous original and add buffer, once rows only view the original
+void editor_piece_table_release(EditorPieceTable *pt);
+// discards original and add buffer (invalidating every view)
+void editor_piece_table_reset(EditorPieceTable *pt);
+void editor_piece_table_destroy(EditorPieceTable *pt);
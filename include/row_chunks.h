@@ -0,0 +1,97 @@
+#pragma once
+
+// Column index of long rows (e.g. minified code), so that converting between
+// chars and rendered columns, and rebuilding what is drawn after typing a
+// char, cost O(chunk) rather than O(row).
+//
+// A long row's chars are split into chunks, each recording the index and
+// rendered column of its first char along with how its own chars render,
+// from which the column after it follows from the column before it in O(1).
+// Each chunk also records the state highlighting reaches at its first char
+// (see highlight.c), so that only the columns on screen are rendered and
+// highlighted (see editor_prepare_row()).
+//
+// Typing or deleting a char remeasures its chunk alone (and, as a multi-byte
+// char may run on into the next chunk, chunks next to it which are not all
+// ASCII), with the columns of following chunks only updated until one starts
+// where it did before (at a tab). Other changes to a row drop its index, which
+// is rebuilt when next needed.
+
+#include "line_tree.h"
+#include "syntaxes.h"
+#include <stdbool.h>
+#include <sys/types.h>
+
+// chars per chunk when built, a chunk is split once typed into up to twice this
+#define ROW_CHUNK_SIZE 1024
+// rows of at least this many chars are indexed
+#define LONG_ROW_SIZE (4 * ROW_CHUNK_SIZE)
+// as is the row being typed into once it has this many, so that rescanning it
+// after a key costs O(chunk) rather than O(row)
+#define TYPED_ROW_SIZE (2 * ROW_CHUNK_SIZE)
+// columns past those on screen rendered and chars past a chunk read when
+// highlighting, more than the longest keyword or comment delimiter
+#define ROW_CHUNK_LOOKAHEAD 64
+
+// state of highlighting at a char, to resume highlighting from there
+typedef struct {
+    ssize_t skip; // chars of a token started earlier still to be passed over,
+                  // -1 if the state is unknown
+    unsigned char prev_hl; // EditorHighlight of the previous char
+    bool prev_sep;         // previous char is a separator
+    bool in_str;
+    char str_ch;
+    bool in_ml_comment;
+    bool in_sl_comment;
+} EditorScanState;
+
+typedef struct {
+    ssize_t start;  // index of first char
+    ssize_t col;    // rendered column of first char
+    ssize_t len;    // number of chars
+    int tabs;       // number of tabs
+    ssize_t before; // columns before first tab (every column if none)
+    ssize_t after;  // columns after first tab, which ends on a tab stop
+    bool ascii;     // chars are all ASCII, taking a column each before tabs
+    EditorScanState entry; // highlighting state at first char
+} EditorRowChunk;
+
+typedef struct {
+    EditorRowChunk *chunks; // at least one
+    int count;
+    int capacity;
+    int tab_stop; // tab stop columns were measured with
+    int dirty;    // first chunk changed since highlighting states were scanned,
+                  // states after it being those from before, count if none
+    const EditorSyntax *syntax; // syntax states were scanned with
+    EditorScanState exit;       // highlighting state at end of row
+} EditorRowChunks;
+
+// returns index of row, building it if row is long (or updating its columns
+// after a change of tab stop), NULL if row is not long and has none
+EditorRowChunks *editor_row_chunks(EditorRow *row);
+// as above, but building the index once row has at least min_size chars
+EditorRowChunks *editor_row_chunks_sized(EditorRow *row, ssize_t min_size);
+void editor_row_chunks_free(EditorRow *row);
+// returns chunk containing char idx (the last chunk for the end of the row)
+int editor_row_chunks_find(const EditorRowChunks *chunks, ssize_t idx);
+// returns chunk containing rendered column rx
+int editor_row_chunks_find_col(const EditorRowChunks *chunks, ssize_t rx);
+// returns index of the first char starting in chunk, as chunk may start within
+// a multi-byte char of the chunk before it (to which that char belongs)
+ssize_t editor_row_chunk_first_char(const EditorRow *row,
+                                    const EditorRowChunk *chunk);
+// returns rendered column following chunk
+ssize_t editor_row_chunk_end_col(const EditorRowChunks *chunks,
+                                 const EditorRowChunk *chunk);
+// returns rendered width of row
+ssize_t editor_row_chunks_width(const EditorRowChunks *chunks);
+
+// updates row's index (if it has one) after char idx was inserted, deleted or
+// replaced, O(chunk) plus a pass over the chunks' starts
+void editor_row_chunks_insert(EditorRow *row, ssize_t idx);
+void editor_row_chunks_delete(EditorRow *row, ssize_t idx);
+void editor_row_chunks_replace(EditorRow *row, ssize_t idx);
+
+// returns bytes held by every index
+size_t editor_row_chunks_memory(void);
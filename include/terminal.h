@@ -2,6 +2,9 @@
 
 void terminal_die(const char *s);
 void terminal_quit(void);
+// moves what was stdin (e.g. a pipe) to the returned descriptor, and reopens
+// stdin as the controlling terminal so that keys can still be read
+int terminal_detach_stdin(void);
 void terminal_disable_raw_mode(void);
 void terminal_enable_raw_mode(void);
 int terminal_get_cursor_position(int *rows, int *cols);
@@ -0,0 +1,39 @@
+#pragma once
+
+// UTF-8 decoding, and the columns characters take on a terminal.
+//
+// Rows hold bytes, a char being a valid UTF-8 sequence or else a single byte
+// (an ASCII char, or an invalid byte drawn as '?'). As no valid sequence
+// contains a byte which could start one, char boundaries are found from any
+// byte by looking back at most 3 bytes.
+//
+// Widths follow the East Asian Width property (wide and fullwidth chars, most
+// emoji, take 2 columns), with combining marks and other zero-width chars
+// taking none, being drawn with the char before them.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// longest sequence
+#define UTF8_MAX_LEN 4
+// code points are 21-bit, keys above them are soft codes (see EditorKey)
+#define UTF8_MAX_CODE_POINT 0x10FFFF
+
+// whether c cannot start a char, being part of a sequence
+#define UTF8_IS_CONTINUATION(c) (((unsigned char)(c) & 0xC0) == 0x80)
+
+// whether len bytes of text are all ASCII, checking a vector (or a word) of
+// bytes at a time
+bool editor_utf8_is_ascii(const char *text, size_t len);
+// returns length of valid sequence starting text (without reading past len),
+// setting code_point, or 0 if text does not start with one
+int editor_utf8_decode(const char *text, size_t len, uint32_t *code_point);
+// writes sequence of code_point to buf, returns its length
+int editor_utf8_encode(uint32_t code_point, char buf[UTF8_MAX_LEN]);
+// returns columns taken by code_point, 0 to 2
+int editor_utf8_width(uint32_t code_point);
+// whether code_point may be typed into text (not a control char)
+bool editor_utf8_is_printable(uint32_t code_point);
+// returns columns taken by len bytes of text (invalid bytes taking 1 each)
+size_t editor_utf8_text_width(const char *text, size_t len);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "a1.h"
+#include <stdint.h>
 
 // ===== MACROS ================================================================
 
@@ -15,20 +16,37 @@
 
 // ===== EDITOR ================================================================
 
+// returns character at index, accounting for a gap opened when typing
+char editor_row_char_at(const EditorRow *row, ssize_t idx);
+// returns length of valid UTF-8 sequence at idx, setting code_point, or 0
+int editor_row_decode(const EditorRow *row, ssize_t idx,
+                      uint32_t *code_point);
+// returns columns char at idx takes when rendered from column col, setting
+// len to its number of bytes
+int editor_row_char_columns(const EditorRow *row, ssize_t idx, ssize_t col,
+                            int *len);
+// returns start of char containing byte idx
+ssize_t editor_row_char_start(const EditorRow *row, ssize_t idx);
+// return start of the char after/before the one at idx, passing over combining
+// chars along with the char they are drawn with
+ssize_t editor_row_next_char(const EditorRow *row, ssize_t idx);
+ssize_t editor_row_prev_char(const EditorRow *row, ssize_t idx);
 // convert cursor x position to equivalent rendered cursor x position
-int editor_row_cx_to_rx(const EditorRow *row, int cx);
+// O(log glyphs) through the row's glyph index, or O(chunk) for long rows (see
+// row_chunks.h)
+ssize_t editor_row_cx_to_rx(EditorRow *row, ssize_t cx);
 // convert rendered cursor x position to equivalent cursor x position
-int editor_row_rx_to_cx(const EditorRow *row, const int rx);
+ssize_t editor_row_rx_to_cx(EditorRow *row, const ssize_t rx);
 // based on stock Neovim, decided by scroll offset not cursor position
 void editor_get_scroll_percentage(char *buf, size_t size);
 // serialises text buffer into single string
-char *editor_rows_to_string(int *buf_len);
+char *editor_rows_to_string(size_t *buf_len);
 // returns number of characters to delete to the left of cursor
 // will return larger number if there are multiple spaces
-int editor_get_backspace_deletion_count(const EditorRow *row, int cursor_x);
+int editor_get_backspace_deletion_count(EditorRow *row, ssize_t cursor_x);
 // returns index of first non whitespace character (i.e. not tab or space)
 // returns -1 if no character found
-int editor_get_first_non_whitespace(EditorRow *row);
+ssize_t editor_get_first_non_whitespace(EditorRow *row);
 
 // ===== GENERAL ===============================================================
 
@@ -40,6 +58,10 @@ bool is_string_integer(const char *string);
 bool is_whitescape(const char c);
 bool parse_bool(const char *string, bool *valid);
 int parse_int(const char *string, bool *valid);
+// number of bytes with an optional K, M or G suffix (e.g. "512M")
+size_t parse_size(const char *string, bool *valid);
+// writes size in bytes with the largest suffix dividing it exactly
+void size_to_str(size_t size, char *buffer, size_t buffer_size);
 // returns heap-allocated str
 char *file_name_from_file_path(const char *file_path);
 // returns array of strings separated by delimiter (not including delimiter)
@@ -1,55 +1,795 @@
-#define _GNU_SOURCE
+#define _GNU_SOURCE // mremap()
 
 #include "action_history.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+// longest pause (ms) between keystrokes merged into one action
+#define ACTION_RUN_GAP 2000
+// parent of actions made from the oldest state, and child of states with none
+#define NO_NODE UINT32_MAX
+
+// "A1UNDO03" (its layout changes with the records')
+#define JOURNAL_MAGIC 0x33304f444e553141ULL
+// saved_state when the file's text is at no state of the log
+#define JOURNAL_NO_SAVE UINT64_MAX
+
+// start of each record in the log, followed by the removed and inserted text
+// records are packed, so are copied in and out rather than accessed in place
+typedef struct {
+    size_t removed_len;
+    size_t inserted_len;
+    ssize_t x;
+    int64_t time; // when made (or last extended)
+    int32_t y;
+    uint32_t parent; // node of the action it was made after
+    uint8_t type;    // EditorActionType
+} EditorActionHeader;
+
+// node of the tree of actions, one for each record in the same order
+typedef struct {
+    size_t offset;
+    uint32_t parent;
+    uint32_t child; // followed by redo, the last made or moved back from
+    int64_t time;
+} EditorActionNode;
+
+// text is sampled in this many pieces of this many bytes, see text_sample()
+#define TEXT_SAMPLES 32
+#define TEXT_SAMPLE_SIZE 256
+
+// what identifies the file's text, without reading all of it
+typedef struct {
+    uint64_t len;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t sample; // hash of samples of the text
+} EditorJournalText;
+
+// start of a journal, followed by the log
 typedef struct {
-    int cursor_x;
-    int cursor_y;
-    char *data;
-    EditorActionType type;
-} EditorAction;
+    uint64_t magic;
+    EditorJournalText text;
+    uint64_t saved_state; // state the file's text is at
+    uint64_t len;
+    uint64_t state;
+} EditorJournalHeader;
 
 struct EditorActionHistory {
-    int capacity;
-    int count;
-    EditorAction **actions;
+    char *log; // in memory, or mapped from after the journal's header
+    size_t len;
+    size_t capacity;
+    size_t limit;
+    bool run_open;     // last record may be extended by the next action
+    uint64_t run_time; // when the last action was recorded (ms)
+
+    EditorActionNode *nodes;
+    uint32_t count;
+    uint32_t nodes_capacity;
+    uint32_t root_child; // followed by redo from state 0
+    size_t state;        // 0, or 1 + node of the last action made to the text
+
+    char *journal_path;           // NULL if the log is not to be kept
+    EditorJournalHeader *journal; // mapping, NULL if not made yet
+    int journal_fd;
+    // whether the journal is yet to be made for text (once there is an action
+    // to keep)
+    bool pending;
+    EditorJournalText text;
 };
 
-EditorActionHistory *editor_action_history_create(void) {
+static size_t record_len(const EditorActionHeader *header) {
+    return sizeof(EditorActionHeader) + header->removed_len +
+           header->inserted_len;
+}
+
+static EditorActionHeader read_header(const EditorActionHistory *ah,
+                                      size_t offset) {
+    EditorActionHeader header;
+    memcpy(&header, &ah->log[offset], sizeof(header));
+    return header;
+}
+
+// returns state the action of node was made from
+static size_t parent_state(const EditorActionHistory *ah, uint32_t node) {
+    uint32_t parent = ah->nodes[node].parent;
+    return parent == NO_NODE ? 0 : (size_t)parent + 1;
+}
+
+// returns node redo follows from state
+static uint32_t *child_of_state(EditorActionHistory *ah, size_t state) {
+    return state == 0 ? &ah->root_child : &ah->nodes[state - 1].child;
+}
+
+// adds node for record at offset, followed by redo from its parent
+static void editor_action_history_add_node(EditorActionHistory *ah,
+                                           size_t offset,
+                                           const EditorActionHeader *header) {
+    if (ah->count == ah->nodes_capacity) {
+        ah->nodes_capacity = ah->nodes_capacity ? ah->nodes_capacity * 2 : 256;
+        ah->nodes =
+            realloc(ah->nodes, ah->nodes_capacity * sizeof(EditorActionNode));
+    }
+
+    ah->nodes[ah->count] = (EditorActionNode){.offset = offset,
+                                              .parent = header->parent,
+                                              .child = NO_NODE,
+                                              .time = header->time};
+    *child_of_state(ah, parent_state(ah, ah->count)) = ah->count;
+    ah->count++;
+}
+
+// FNV-1a over words rather than bytes
+static uint64_t text_hash(const char *text, size_t len) {
+    uint64_t hash = 14695981039346656037ULL ^ len;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, &text[i], sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+        hash ^= hash >> 32;
+    }
+    for (; i < len; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// returns hash of pieces of text spread evenly over it (from its start to its
+// end), or of the whole text if shorter than them
+static uint64_t text_sample(const char *text, size_t len) {
+    if (len <= TEXT_SAMPLES * TEXT_SAMPLE_SIZE) { return text_hash(text, len); }
+
+    uint64_t hash = len;
+    size_t step = (len - TEXT_SAMPLE_SIZE) / (TEXT_SAMPLES - 1);
+    for (size_t i = 0; i < TEXT_SAMPLES; i++) {
+        hash = (hash ^ text_hash(&text[i * step], TEXT_SAMPLE_SIZE)) *
+               1099511628211ULL;
+    }
+    return hash;
+}
+
+static EditorJournalText text_identify(const struct stat *st, const char *text,
+                                       size_t len) {
+    return (EditorJournalText){.len = len,
+                               .dev = st->st_dev,
+                               .ino = st->st_ino,
+                               .mtime_sec = st->st_mtim.tv_sec,
+                               .mtime_nsec = st->st_mtim.tv_nsec,
+                               .sample = text_sample(text, len)};
+}
+
+static bool text_equal(const EditorJournalText *a,
+                       const EditorJournalText *b) {
+    return a->len == b->len && a->dev == b->dev && a->ino == b->ino &&
+           a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec &&
+           a->sample == b->sample;
+}
+
+// copies where the log is up to into the journal's header
+static void editor_journal_sync(EditorActionHistory *ah) {
+    if (ah->journal == NULL) { return; }
+    ah->journal->len = ah->len;
+    ah->journal->state = ah->state;
+}
+
+// moves the log into memory, unmapping the journal (which is deleted if
+// remove, as it may be left part written)
+static void editor_journal_detach(EditorActionHistory *ah, bool remove) {
+    if (ah->journal != NULL) {
+        char *log = malloc(MAX(ah->capacity, 1));
+        memcpy(log, ah->log, ah->len);
+        ah->log = log;
+
+        munmap(ah->journal, sizeof(EditorJournalHeader) + ah->capacity);
+        close(ah->journal_fd);
+        ah->journal = NULL;
+    }
+
+    if (remove && ah->journal_path != NULL) { unlink(ah->journal_path); }
+    free(ah->journal_path);
+    ah->journal_path = NULL;
+    ah->pending = false;
+}
+
+// maps journal of size bytes from fd, with the log after its header
+static bool editor_journal_map(EditorActionHistory *ah, int fd, size_t size) {
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) { return false; }
+
+    ah->journal = map;
+    ah->journal_fd = fd;
+    ah->log = (char *)map + sizeof(EditorJournalHeader);
+    ah->capacity = size - sizeof(EditorJournalHeader);
+    return true;
+}
+
+// makes the journal, moving the log into it, with the file's text (ah->text)
+// at saved_state, stops keeping the log on failure
+static void editor_journal_create(EditorActionHistory *ah,
+                                  size_t saved_state) {
+    ah->pending = false;
+
+    // not kept if the file is open in another editor, which holds the lock
+    // on its journal
+    int fd = open(ah->journal_path, O_RDWR | O_CREAT, 0600);
+    size_t size = sizeof(EditorJournalHeader) + ah->capacity;
+    char *log = ah->log;
+    if (fd == -1 || flock(fd, LOCK_EX | LOCK_NB) == -1 ||
+        ftruncate(fd, 0) == -1 || ftruncate(fd, size) == -1 ||
+        !editor_journal_map(ah, fd, size)) {
+        if (fd != -1) { close(fd); }
+        editor_journal_detach(ah, false);
+        return;
+    }
+    if (log != NULL) {
+        memcpy(ah->log, log, ah->len);
+        free(log);
+    }
+
+    *ah->journal = (EditorJournalHeader){.magic = JOURNAL_MAGIC,
+                                         .text = ah->text,
+                                         .saved_state = saved_state};
+    editor_journal_sync(ah);
+}
+
+// adds a node for each record of the log, returns false if they do not form
+// a tree (the journal is corrupt)
+static bool editor_action_history_index(EditorActionHistory *ah) {
+    for (size_t offset = 0; offset < ah->len;) {
+        if (ah->len - offset < sizeof(EditorActionHeader)) { return false; }
+
+        EditorActionHeader header = read_header(ah, offset);
+        if (header.removed_len > ah->len || header.inserted_len > ah->len ||
+            record_len(&header) > ah->len - offset ||
+            (header.parent != NO_NODE && header.parent >= ah->count) ||
+            ah->count == NO_NODE) {
+            return false;
+        }
+
+        editor_action_history_add_node(ah, offset, &header);
+        offset += record_len(&header);
+    }
+    return true;
+}
+
+// maps the journal left by an earlier session if the file's text (ah->text) is
+// still that at a state of it, moving there, returns false if not
+static bool editor_journal_restore(EditorActionHistory *ah) {
+    int fd = open(ah->journal_path, O_RDWR);
+    if (fd == -1) { return false; }
+
+    EditorJournalHeader header;
+    struct stat st;
+    bool valid =
+        flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &st) == 0 &&
+        (size_t)st.st_size >= sizeof(header) &&
+        pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        header.magic == JOURNAL_MAGIC && text_equal(&header.text, &ah->text) &&
+        header.saved_state != JOURNAL_NO_SAVE &&
+        header.len <= st.st_size - sizeof(header);
+
+    char *log = ah->log;
+    size_t capacity = ah->capacity;
+    if (!valid || !editor_journal_map(ah, fd, st.st_size)) {
+        close(fd);
+        return false;
+    }
+    ah->len = header.len;
+
+    // the tree is rebuilt from the records' headers, no action is applied
+    if (!editor_action_history_index(ah) || header.saved_state > ah->count) {
+        munmap(ah->journal, st.st_size);
+        close(fd);
+        ah->journal = NULL;
+        ah->log = log;
+        ah->capacity = capacity;
+        ah->len = 0;
+        ah->count = 0;
+        ah->root_child = NO_NODE;
+        return false;
+    }
+    free(log);
+
+    ah->state = header.saved_state;
+    editor_journal_sync(ah);
+    return true;
+}
+
+// drops the oldest records until the log is well below the limit, so that
+// the log is not compacted on every action once at it
+// with them go the branches made from states before the current one's (whose
+// oldest kept state becomes the first), which could not be reached from it
+static void editor_action_history_trim(EditorActionHistory *ah) {
+    if (ah->limit == 0 || ah->len <= ah->limit) { return; }
+
+    size_t target = ah->limit / 4 * 3;
+    uint32_t oldest = 0; // first node kept
+    size_t dropped = 0;
+    while (oldest < ah->count && ah->len - dropped > target) {
+        EditorActionHeader header = read_header(ah, ah->nodes[oldest].offset);
+        dropped += record_len(&header);
+        oldest++;
+    }
+
+    // the current text can only be reached from a state before it
+    if (ah->state == 0 || ah->state - 1 < oldest) {
+        editor_action_history_clear(ah);
+        return;
+    }
+
+    // the newest state dropped that the current one is reached through
+    uint32_t base = ah->state - 1;
+    while (base != NO_NODE && base >= oldest) {
+        base = ah->nodes[base].parent;
+    }
+    uint32_t base_child = *child_of_state(ah, base == NO_NODE ? 0 : base + 1);
+
+    // records kept are moved down over those dropped, in the same order
+    uint32_t *index = malloc(ah->count * sizeof(uint32_t));
+    uint32_t kept = 0;
+    size_t len = 0;
+    for (uint32_t i = 0; i < ah->count; i++) {
+        uint32_t parent = ah->nodes[i].parent;
+        bool keep = i >= oldest &&
+                    (parent == base ||
+                     (parent != NO_NODE && index[parent] != NO_NODE));
+        index[i] = keep ? kept : NO_NODE;
+        if (!keep) { continue; }
+
+        EditorActionHeader header = read_header(ah, ah->nodes[i].offset);
+        header.parent = parent == base ? NO_NODE : index[parent];
+        memmove(&ah->log[len], &ah->log[ah->nodes[i].offset],
+                record_len(&header));
+        memcpy(&ah->log[len], &header, sizeof(header));
+
+        ah->nodes[kept] = (EditorActionNode){.offset = len,
+                                             .parent = header.parent,
+                                             .child = ah->nodes[i].child,
+                                             .time = header.time};
+        len += record_len(&header);
+        kept++;
+    }
+
+    // branches redo followed are kept if they still can be, otherwise the
+    // oldest left
+    ah->root_child = base_child != NO_NODE ? index[base_child] : NO_NODE;
+    for (uint32_t i = 0; i < kept; i++) {
+        uint32_t child = ah->nodes[i].child;
+        ah->nodes[i].child = child != NO_NODE ? index[child] : NO_NODE;
+    }
+    ah->count = kept;
+    for (uint32_t i = 0; i < kept; i++) {
+        uint32_t *child = child_of_state(ah, parent_state(ah, i));
+        if (*child == NO_NODE) { *child = i; }
+    }
+
+    if (ah->journal != NULL && ah->journal->saved_state != JOURNAL_NO_SAVE) {
+        uint64_t saved = ah->journal->saved_state;
+        if (saved == 0) {
+            saved = base == NO_NODE ? 0 : JOURNAL_NO_SAVE;
+        } else if (saved - 1 == base) {
+            saved = 0;
+        } else {
+            saved = index[saved - 1] != NO_NODE ? index[saved - 1] + 1
+                                                : JOURNAL_NO_SAVE;
+        }
+        ah->journal->saved_state = saved;
+    }
+
+    ah->state = index[ah->state - 1] + 1;
+    ah->len = len;
+    free(index);
+}
+
+// resizes the journal to hold capacity bytes of log
+static bool editor_journal_resize(EditorActionHistory *ah, size_t capacity) {
+    size_t size = sizeof(EditorJournalHeader) + ah->capacity;
+    size_t new_size = sizeof(EditorJournalHeader) + capacity;
+    if (ftruncate(ah->journal_fd, new_size) == -1) { return false; }
+
+    void *map = mremap(ah->journal, size, new_size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) { return false; }
+
+    ah->journal = map;
+    ah->log = (char *)map + sizeof(EditorJournalHeader);
+    return true;
+}
+
+// ensures log can hold size bytes
+static void editor_action_history_reserve(EditorActionHistory *ah,
+                                          size_t size) {
+    if (size <= ah->capacity) { return; }
+
+    size_t capacity = ah->capacity ? ah->capacity * 2 : 4096;
+    // not grown far past the limit, as it is trimmed to below it
+    if (ah->limit > 0) { capacity = MIN(capacity, ah->limit); }
+    capacity = MAX(capacity, size);
+
+    // kept in memory if the journal cannot grow (e.g. the disk is full)
+    if (ah->journal != NULL && !editor_journal_resize(ah, capacity)) {
+        editor_journal_detach(ah, true);
+    }
+    if (ah->journal == NULL) { ah->log = realloc(ah->log, capacity); }
+    ah->capacity = capacity;
+}
+
+static uint64_t current_time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// removes the newest node, that of the current state
+static void editor_action_history_drop_last(EditorActionHistory *ah) {
+    uint32_t last = ah->count - 1;
+    size_t parent = parent_state(ah, last);
+
+    ah->len = ah->nodes[last].offset;
+    ah->count--;
+    ah->state = parent;
+
+    // redo follows the newest branch left
+    uint32_t *child = child_of_state(ah, parent);
+    *child = NO_NODE;
+    for (uint32_t i = last; i-- > 0;) {
+        if (parent_state(ah, i) == parent) {
+            *child = i;
+            break;
+        }
+    }
+}
+
+// merges action into the last record when it continues it on the same row
+// (typing after it, or deleting what was typed or the text either side of
+// it), rewriting the record in place, returns false if it does not
+static bool editor_action_history_merge(EditorActionHistory *ah,
+                                        const EditorAction *action) {
+    uint64_t now = current_time_ms();
+    // (the last record may have been trimmed)
+    bool open = ah->run_open && ah->count > 0 && ah->state == ah->count &&
+                action->type == ACTION_MODIFY_LINE &&
+                now - ah->run_time < ACTION_RUN_GAP;
+    ah->run_time = now;
+    if (!open) { return false; }
+
+    size_t start = ah->nodes[ah->count - 1].offset;
+    EditorActionHeader header = read_header(ah, start);
+
+    // a record replaces removed text at x with inserted text
+    ssize_t inserted_end = header.x + header.inserted_len;
+    ssize_t x = action->x;
+    size_t n = action->removed_len + action->inserted_len;
+    if (header.y != action->y ||
+        (action->removed_len > 0) == (action->inserted_len > 0)) {
+        return false;
+    }
+
+    // the file's text must stay at its state
+    if (ah->journal != NULL && ah->journal->saved_state == ah->state) {
+        return false;
+    }
+
+    editor_action_history_reserve(ah, ah->len + n);
+    char *removed = &ah->log[start + sizeof(header)];
+    char *inserted = removed + header.removed_len;
+
+    if (action->inserted_len > 0 && x == inserted_end) {
+        // typed after
+        memcpy(&inserted[header.inserted_len], action->inserted, n);
+        header.inserted_len += n;
+    } else if (action->removed_len > 0 && x >= header.x &&
+               x + (ssize_t)n == inserted_end) {
+        // backspaced over what was typed
+        header.inserted_len -= n;
+    } else if (action->removed_len > 0 && x + (ssize_t)n == header.x) {
+        // backspaced before
+        memmove(&removed[n], removed,
+                header.removed_len + header.inserted_len);
+        memcpy(removed, action->removed, n);
+        header.removed_len += n;
+        header.x = x;
+    } else if (action->removed_len > 0 && x == inserted_end) {
+        // deleted after
+        memmove(&inserted[n], inserted, header.inserted_len);
+        memcpy(inserted, action->removed, n);
+        header.removed_len += n;
+    } else {
+        return false;
+    }
+
+    // backspaced over all that was typed, leaving no change
+    if (header.removed_len == 0 && header.inserted_len == 0) {
+        editor_action_history_drop_last(ah);
+        ah->run_open = false;
+        return true;
+    }
+
+    header.time = time(NULL);
+    memcpy(&ah->log[start], &header, sizeof(header));
+    ah->nodes[ah->count - 1].time = header.time;
+    ah->len = start + record_len(&header);
+    return true;
+}
+
+EditorActionHistory *editor_action_history_create(size_t limit) {
     EditorActionHistory *ah = malloc(sizeof *ah);
-    *ah = (EditorActionHistory){.capacity = 0, .count = 0, .actions = NULL};
+    *ah = (EditorActionHistory){.log = NULL,
+                                .len = 0,
+                                .capacity = 0,
+                                .limit = limit,
+                                .run_open = false,
+                                .run_time = 0,
+                                .nodes = NULL,
+                                .count = 0,
+                                .nodes_capacity = 0,
+                                .root_child = NO_NODE,
+                                .state = 0,
+                                .journal_path = NULL,
+                                .journal = NULL,
+                                .journal_fd = -1,
+                                .pending = false};
     return ah;
 }
 
-void editor_record_action(EditorActionHistory *ah, int cursor_x, int cursor_y,
-                          char *data, EditorActionType type) {
-    if (ah->count >= ah->capacity) {
-        ah->capacity = ah->capacity ? ah->capacity * 2 : 1;
-        ah->actions =
-            realloc(ah->actions, ah->capacity * sizeof(EditorAction *));
+void editor_action_history_set_limit(EditorActionHistory *ah, size_t limit) {
+    ah->limit = limit;
+    editor_action_history_trim(ah);
+    editor_journal_sync(ah);
+}
+
+void editor_action_history_attach(EditorActionHistory *ah,
+                                  const char *journal_path,
+                                  const struct stat *st, const char *text,
+                                  size_t len) {
+    ah->run_open = false;
+    if (text == NULL) { text = ""; } // (empty file)
+    ah->text = text_identify(st, text, len);
+
+    if (ah->journal_path == NULL || strcmp(ah->journal_path, journal_path)) {
+        // the journal of another file is left for when it is opened again
+        editor_journal_detach(ah, false);
+        ah->journal_path = strdup(journal_path);
+
+        // a new history carries on from the last session's
+        if (ah->count == 0 && editor_journal_restore(ah)) { return; }
     }
-    EditorAction *action = malloc(sizeof(*action));
-    *action = (EditorAction){.cursor_x = cursor_x,
-                             .cursor_y = cursor_y,
-                             .data = strdup(data),
-                             .type = type};
 
-    ah->actions[ah->count] = action;
-    ah->count++;
+    if (ah->journal != NULL) {
+        ah->journal->text = ah->text;
+        ah->journal->saved_state = ah->state;
+    } else if (ah->count == 0) {
+        // made once there is an action to keep
+        ah->pending = true;
+    } else {
+        editor_journal_create(ah, ah->state);
+    }
+}
+
+void editor_action_history_clear(EditorActionHistory *ah) {
+    if (ah->journal != NULL) {
+        ah->journal->saved_state = JOURNAL_NO_SAVE;
+    } else {
+        free(ah->log);
+        ah->log = NULL;
+        ah->capacity = 0;
+    }
+    ah->len = 0;
+    ah->count = 0;
+    ah->root_child = NO_NODE;
+    ah->state = 0;
+    ah->run_open = false;
+    ah->pending = false; // the text may be about to be replaced
+    editor_journal_sync(ah);
 }
 
-void editor_undo_action(EditorActionHistory *ah) {}
+void editor_action_history_drop(EditorActionHistory *ah) {
+    editor_journal_detach(ah, true);
+    editor_action_history_clear(ah);
+}
 
-void editor_redo_action(EditorActionHistory *ah) {}
+void editor_action_history_break(EditorActionHistory *ah) {
+    ah->run_open = false;
+}
 
-void editor_action_history_destroy(EditorActionHistory *ah) {
-    if (ah->actions) {
-        for (int i = 0; i < ah->count; i++) {
-            EditorAction *action = ah->actions[i];
-            free(action->data);
+void editor_record_action(EditorActionHistory *ah, const EditorAction *action) {
+    if (editor_action_history_merge(ah, action)) {
+        editor_action_history_trim(ah);
+        editor_journal_sync(ah);
+        return;
+    }
+
+    if (ah->pending) { editor_journal_create(ah, ah->state); }
+
+    // actions undone are kept, the new action starting a branch from them
+    EditorActionHeader header = {
+        .removed_len = action->removed_len,
+        .inserted_len = action->inserted_len,
+        .x = action->x,
+        .time = time(NULL),
+        .y = action->y,
+        .parent = ah->state == 0 ? NO_NODE : ah->state - 1,
+        .type = action->type};
+    size_t len = record_len(&header);
+
+    editor_action_history_reserve(ah, ah->len + len);
+
+    char *record = &ah->log[ah->len];
+    memcpy(record, &header, sizeof(header));
+    record += sizeof(header);
+    memcpy(record, action->removed, action->removed_len);
+    record += action->removed_len;
+    memcpy(record, action->inserted, action->inserted_len);
+
+    editor_action_history_add_node(ah, ah->len, &header);
+    ah->len += len;
+    ah->state = ah->count;
+    ah->run_open = action->type == ACTION_MODIFY_LINE;
+
+    editor_action_history_trim(ah);
+    editor_journal_sync(ah);
+}
+
+// sets action to record of node
+static void editor_read_action(const EditorActionHistory *ah, uint32_t node,
+                               EditorAction *action) {
+    size_t offset = ah->nodes[node].offset;
+    EditorActionHeader header = read_header(ah, offset);
+    const char *text = &ah->log[offset + sizeof(header)];
+
+    *action = (EditorAction){.type = header.type,
+                             .y = header.y,
+                             .x = header.x,
+                             .removed = text,
+                             .removed_len = header.removed_len,
+                             .inserted = text + header.removed_len,
+                             .inserted_len = header.inserted_len};
+}
+
+bool editor_undo_action(EditorActionHistory *ah, EditorAction *action) {
+    if (ah->state == 0) { return false; }
+    ah->run_open = false;
+
+    // redo comes back down the same branch
+    uint32_t node = ah->state - 1;
+    ah->state = parent_state(ah, node);
+    *child_of_state(ah, ah->state) = node;
+    editor_journal_sync(ah);
+
+    // reversed, the inserted text is removed and the removed text inserted
+    editor_read_action(ah, node, action);
+    const char *removed = action->removed;
+    size_t removed_len = action->removed_len;
+    action->removed = action->inserted;
+    action->removed_len = action->inserted_len;
+    action->inserted = removed;
+    action->inserted_len = removed_len;
+    return true;
+}
+
+bool editor_redo_action(EditorActionHistory *ah, EditorAction *action) {
+    uint32_t node = *child_of_state(ah, ah->state);
+    if (node == NO_NODE) { return false; }
+    ah->run_open = false;
+
+    editor_read_action(ah, node, action);
+    ah->state = (size_t)node + 1;
+    editor_journal_sync(ah);
+    return true;
+}
+
+size_t editor_action_history_state(const EditorActionHistory *ah) {
+    return ah->state;
+}
+
+size_t editor_action_history_states(const EditorActionHistory *ah) {
+    return (size_t)ah->count + 1;
+}
+
+time_t editor_action_history_state_time(const EditorActionHistory *ah,
+                                        size_t state) {
+    if (ah->count == 0) { return 0; }
+    // the oldest state is taken to be as old as the first action made from it
+    return ah->nodes[state == 0 ? 0 : state - 1].time;
+}
+
+size_t editor_action_history_state_at(const EditorActionHistory *ah,
+                                      time_t time) {
+    size_t state = ah->count;
+    while (state > 0 && ah->nodes[state - 1].time > time) {
+        state--;
+    }
+    return state;
+}
+
+// returns number of actions made to reach state from the oldest
+static size_t state_depth(const EditorActionHistory *ah, size_t state) {
+    size_t depth = 0;
+    for (; state != 0; state = parent_state(ah, state - 1)) {
+        depth++;
+    }
+    return depth;
+}
+
+bool editor_action_history_goto(EditorActionHistory *ah, size_t state,
+                                EditorActionApplier apply) {
+    // the newest state both are reached through
+    size_t from = ah->state, to = state;
+    size_t from_depth = state_depth(ah, from), to_depth = state_depth(ah, to);
+    for (; from_depth > to_depth; from_depth--) {
+        from = parent_state(ah, from - 1);
+    }
+    for (; to_depth > from_depth; to_depth--) {
+        to = parent_state(ah, to - 1);
+    }
+    while (from != to) {
+        from = parent_state(ah, from - 1);
+        to = parent_state(ah, to - 1);
+    }
+
+    EditorAction action;
+    while (ah->state != from && editor_undo_action(ah, &action)) {
+        if (!apply(&action)) { return false; }
+    }
+
+    // redo follows the branch to state
+    for (size_t s = state; s != from; s = parent_state(ah, s - 1)) {
+        *child_of_state(ah, parent_state(ah, s - 1)) = s - 1;
+    }
+    while (ah->state != state && editor_redo_action(ah, &action)) {
+        if (!apply(&action)) { return false; }
+    }
+    return true;
+}
+
+int editor_action_history_next_branch(EditorActionHistory *ah, int *count) {
+    uint32_t *child = child_of_state(ah, ah->state);
+    uint32_t first = NO_NODE, next = NO_NODE;
+    int branch = 0;
+    *count = 0;
+
+    // branches in the order they were made
+    for (uint32_t i = 0; i < ah->count; i++) {
+        if (parent_state(ah, i) != ah->state) { continue; }
+        (*count)++;
+        if (first == NO_NODE) { first = i; }
+        if (next == NO_NODE && *child != NO_NODE && i > *child) {
+            next = i;
+            branch = *count;
         }
-        free(ah->actions);
     }
+
+    if (first == NO_NODE) { return 0; }
+    if (next == NO_NODE) {
+        next = first;
+        branch = 1;
+    }
+    *child = next;
+    return branch;
+}
+
+size_t editor_action_history_memory(const EditorActionHistory *ah) {
+    return ah->nodes_capacity * sizeof(EditorActionNode) +
+           (ah->journal != NULL ? 0 : ah->capacity);
+}
+
+void editor_action_history_destroy(EditorActionHistory *ah) {
+    if (ah->journal != NULL) {
+        munmap(ah->journal, sizeof(EditorJournalHeader) + ah->capacity);
+        close(ah->journal_fd);
+    } else {
+        free(ah->log);
+    }
+    free(ah->nodes);
+    free(ah->journal_path);
+    free(ah);
 }
@@ -0,0 +1,304 @@
+#define _POSIX_C_SOURCE 200112L // posix_memalign()
+
+#include "arena.h"
+#include "util.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// slabs are aligned to their size so a chunk's slab can be found by masking
+#define SLAB_SIZE (64 * 1024)
+
+// a slab is only released by compaction once less than this fraction is used
+#define SPARSE_SLAB_DIVISOR 4
+
+// compaction is not worthwhile below this amount of held memory
+#define MIN_COMPACT_BYTES (1024 * 1024)
+
+// steps of roughly 1.5x, bounding the space lost to rounding
+static const size_t size_classes[] = {16,  24,  32,  48,   64,   96,
+                                      128, 192, 256, 384,  512,  768,
+                                      1024, 1536, 2048, 3072, 4096};
+
+#define NUM_SIZE_CLASSES ARRAY_LEN(size_classes)
+
+// stored in the chunk itself while it is free
+typedef struct Chunk {
+    struct Chunk *next;
+} Chunk;
+
+typedef struct Slab {
+    struct Slab *prev; // previous slab of same size class
+    struct Slab *next; // next slab of same size class
+    int size_class;    // index into size_classes
+    int live;          // chunks currently handed out
+    int capacity;      // chunks in slab
+    bool evacuating;   // chunks are not reused, slab released once empty
+} Slab;
+
+// first chunk follows the header, rounded up to keep chunks 16 byte aligned
+#define SLAB_HEADER_SIZE ((sizeof(Slab) + 15) & ~(size_t)15)
+
+typedef struct {
+    Slab *slabs;      // every slab of this size class
+    Chunk *free_list; // free chunks of non-evacuating slabs
+} SizeClass;
+
+struct EditorArena {
+    SizeClass classes[NUM_SIZE_CLASSES];
+    size_t num_slabs;
+    size_t used_bytes;
+    size_t large_bytes;
+    size_t allocations;
+};
+
+// returns index of smallest size class that fits size, -1 if too large
+static int size_class_index(size_t size) {
+    for (int i = 0; i < (int)NUM_SIZE_CLASSES; i++) {
+        if (size <= size_classes[i]) { return i; }
+    }
+    return -1;
+}
+
+static Slab *slab_of(const void *ptr) {
+    return (Slab *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+static bool new_slab(EditorArena *arena, int class_idx) {
+    void *memory;
+    if (posix_memalign(&memory, SLAB_SIZE, SLAB_SIZE) != 0) { return false; }
+
+    SizeClass *size_class = &arena->classes[class_idx];
+    size_t chunk_size = size_classes[class_idx];
+
+    Slab *slab = memory;
+    slab->prev = NULL;
+    slab->next = size_class->slabs;
+    slab->size_class = class_idx;
+    slab->live = 0;
+    slab->capacity = (SLAB_SIZE - SLAB_HEADER_SIZE) / chunk_size;
+    slab->evacuating = false;
+
+    if (size_class->slabs != NULL) { size_class->slabs->prev = slab; }
+    size_class->slabs = slab;
+
+    // pushed in reverse so chunks are handed out in address order
+    char *chunks = (char *)memory + SLAB_HEADER_SIZE;
+    for (int i = slab->capacity - 1; i >= 0; i--) {
+        Chunk *chunk = (Chunk *)(chunks + i * chunk_size);
+        chunk->next = size_class->free_list;
+        size_class->free_list = chunk;
+    }
+
+    arena->num_slabs++;
+    return true;
+}
+
+EditorArena *editor_arena_create(void) {
+    EditorArena *arena = malloc(sizeof(EditorArena));
+
+    for (int i = 0; i < (int)NUM_SIZE_CLASSES; i++) {
+        arena->classes[i].slabs = NULL;
+        arena->classes[i].free_list = NULL;
+    }
+    arena->num_slabs = 0;
+    arena->used_bytes = 0;
+    arena->large_bytes = 0;
+    arena->allocations = 0;
+
+    return arena;
+}
+
+void *editor_arena_alloc(EditorArena *arena, size_t size) {
+    int class_idx = size_class_index(size);
+
+    if (class_idx < 0) {
+        void *ptr = malloc(size);
+        if (ptr != NULL) {
+            arena->large_bytes += size;
+            arena->allocations++;
+        }
+        return ptr;
+    }
+
+    SizeClass *size_class = &arena->classes[class_idx];
+    if (size_class->free_list == NULL && !new_slab(arena, class_idx)) {
+        return NULL;
+    }
+
+    Chunk *chunk = size_class->free_list;
+    size_class->free_list = chunk->next;
+    slab_of(chunk)->live++;
+
+    arena->used_bytes += size_classes[class_idx];
+    arena->allocations++;
+    return chunk;
+}
+
+void editor_arena_free(EditorArena *arena, void *ptr, size_t size) {
+    if (ptr == NULL) { return; }
+
+    arena->allocations--;
+
+    int class_idx = size_class_index(size);
+    if (class_idx < 0) {
+        arena->large_bytes -= size;
+        free(ptr);
+        return;
+    }
+
+    Slab *slab = slab_of(ptr);
+    slab->live--;
+    arena->used_bytes -= size_classes[class_idx];
+
+    if (!slab->evacuating) {
+        SizeClass *size_class = &arena->classes[class_idx];
+        Chunk *chunk = ptr;
+        chunk->next = size_class->free_list;
+        size_class->free_list = chunk;
+    }
+}
+
+void *editor_arena_realloc(EditorArena *arena, void *ptr, size_t old_size,
+                           size_t new_size) {
+    if (ptr == NULL) { return editor_arena_alloc(arena, new_size); }
+
+    int old_class = size_class_index(old_size);
+    int new_class = size_class_index(new_size);
+
+    // chunk already large enough (and not so large as to waste space)
+    if (old_class >= 0 && old_class == new_class &&
+        !slab_of(ptr)->evacuating) {
+        return ptr;
+    }
+
+    if (old_class < 0 && new_class < 0) {
+        void *new_ptr = realloc(ptr, new_size);
+        if (new_ptr != NULL) {
+            arena->large_bytes += new_size;
+            arena->large_bytes -= old_size;
+        }
+        return new_ptr;
+    }
+
+    void *new_ptr = editor_arena_alloc(arena, new_size);
+    if (new_ptr == NULL) { return NULL; }
+
+    memcpy(new_ptr, ptr, MIN(old_size, new_size));
+    editor_arena_free(arena, ptr, old_size);
+    return new_ptr;
+}
+
+// removes free chunks of evacuating slabs from free list so they are not reused
+static void filter_free_list(SizeClass *size_class) {
+    Chunk **link = &size_class->free_list;
+    while (*link != NULL) {
+        if (slab_of(*link)->evacuating) {
+            *link = (*link)->next;
+        } else {
+            link = &(*link)->next;
+        }
+    }
+}
+
+bool editor_arena_compact_begin(EditorArena *arena) {
+    bool any_evacuating = false;
+
+    for (int i = 0; i < (int)NUM_SIZE_CLASSES; i++) {
+        SizeClass *size_class = &arena->classes[i];
+        bool class_evacuating = false;
+
+        // a lone slab is only worth evacuating if it is empty, otherwise its
+        // buffers would just be moved into a new slab
+        bool lone_slab = size_class->slabs != NULL &&
+                         size_class->slabs->next == NULL;
+
+        for (Slab *slab = size_class->slabs; slab != NULL; slab = slab->next) {
+            if (slab->evacuating) { continue; }
+            if (lone_slab && slab->live > 0) { continue; }
+
+            if (slab->live * SPARSE_SLAB_DIVISOR < slab->capacity) {
+                slab->evacuating = true;
+                class_evacuating = true;
+            }
+        }
+
+        if (class_evacuating) {
+            filter_free_list(size_class);
+            any_evacuating = true;
+        }
+    }
+
+    return any_evacuating;
+}
+
+void *editor_arena_relocate(EditorArena *arena, void *ptr, size_t size) {
+    if (ptr == NULL || size_class_index(size) < 0) { return ptr; }
+    if (!slab_of(ptr)->evacuating) { return ptr; }
+
+    void *new_ptr = editor_arena_alloc(arena, size);
+    if (new_ptr == NULL) { return ptr; } // left in place, slab kept
+
+    memcpy(new_ptr, ptr, size);
+    editor_arena_free(arena, ptr, size);
+    return new_ptr;
+}
+
+size_t editor_arena_compact_end(EditorArena *arena) {
+    size_t released = 0;
+
+    for (int i = 0; i < (int)NUM_SIZE_CLASSES; i++) {
+        SizeClass *size_class = &arena->classes[i];
+        Slab *slab = size_class->slabs;
+
+        while (slab != NULL) {
+            Slab *next = slab->next;
+
+            // evacuating slabs which still have live chunks are kept until a
+            // later compaction finds them empty
+            if (slab->evacuating && slab->live == 0) {
+                if (slab->prev != NULL) {
+                    slab->prev->next = slab->next;
+                } else {
+                    size_class->slabs = slab->next;
+                }
+                if (slab->next != NULL) { slab->next->prev = slab->prev; }
+
+                free(slab);
+                arena->num_slabs--;
+                released += SLAB_SIZE;
+            }
+
+            slab = next;
+        }
+    }
+
+    return released;
+}
+
+bool editor_arena_is_fragmented(const EditorArena *arena) {
+    size_t slab_bytes = arena->num_slabs * SLAB_SIZE;
+    return slab_bytes >= MIN_COMPACT_BYTES &&
+           arena->used_bytes * SPARSE_SLAB_DIVISOR < slab_bytes;
+}
+
+void editor_arena_get_stats(const EditorArena *arena, EditorArenaStats *stats) {
+    stats->slabs = arena->num_slabs;
+    stats->slab_bytes = arena->num_slabs * SLAB_SIZE;
+    stats->used_bytes = arena->used_bytes;
+    stats->large_bytes = arena->large_bytes;
+    stats->allocations = arena->allocations;
+}
+
+// large allocations are not tracked, and must be freed by their owners first
+void editor_arena_destroy(EditorArena *arena) {
+    for (int i = 0; i < (int)NUM_SIZE_CLASSES; i++) {
+        Slab *slab = arena->classes[i].slabs;
+        while (slab != NULL) {
+            Slab *next = slab->next;
+            free(slab);
+            slab = next;
+        }
+    }
+    free(arena);
+}
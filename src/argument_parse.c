@@ -18,6 +18,9 @@ static char args_doc[] = "[FILE]";
 static struct argp_option options[] = {
     {"clean", 'c', 0, 0, "Do not apply configuration", 0},
     {"config", 'f', "FILE", 0, "Apply config from this file", 0},
+    {"follow", 'F', 0, 0, "Follow appends to file (like tail -f)", 0},
+    {"hex", 'x', 0, 0, "View file as hex", 0},
+    {"large", 'l', 0, 0, "Open file in large-file mode", 0},
     {"manual", 'm', 0, 0, "Print manual and exit", 0},
     {0}};
 
@@ -32,6 +35,15 @@ static error_t parse_option(int key, char *arg, struct argp_state *state) {
     case 'f':
         arguments->config_file_path = arg;
         break;
+    case 'F':
+        arguments->follow = true;
+        break;
+    case 'x':
+        arguments->hex = true;
+        break;
+    case 'l':
+        arguments->large = true;
+        break;
     case 'm':
         arguments->manual = true;
         break;
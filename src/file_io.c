@@ -2,6 +2,8 @@
 
 #include "a1.h"
 #include "highlight.h"
+#include "input.h"
+#include "line_diff.h"
 #include "mode_command.h"
 #include "operations.h"
 #include "output.h"
@@ -9,12 +11,15 @@
 #include "util.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <sys/xattr.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -34,37 +39,952 @@ void get_file_permissions(const char *file_path,
     file_permissions->can_write = access(file_path, W_OK) == 0;
 }
 
+// files of at least this size are opened in large-file mode
+#define LARGE_FILE_SIZE (256 * 1024 * 1024)
+
+// text split into rows at a time while loading (outside large-file mode)
+#define LOAD_BATCH_SIZE (1024 * 1024)
+
+// how often lines indexed in the background are added (large-file mode)
+#define LOAD_POLL_INTERVAL 100 // ms
+
+// files continue loading after being opened, so the first screen is shown
+// straight away, see editor_continue_loading()
+static bool loading = false;
+static size_t load_offset = 0; // bytes of original text loaded as rows
+static int loaded_lines = 0;   // indexed lines added as rows (large-file mode)
+
+// bytes read from a stream at a time
+#define STREAM_READ_SIZE (64 * 1024)
+
+// streams (e.g. a pipe to stdin) are read as their text arrives, with the
+// partial line at the end of what has been read held back for its newline
+static int stream_fd = -1;
+static char *stream_buf = NULL;
+static size_t stream_len = 0;
+static size_t stream_capacity = 0;
+// empty row shown until the first line of the stream arrives
+static bool stream_placeholder = false;
+
+// a followed file is read as a stream from the end of its text, with inotify
+// waking the editor when it is appended to
+static int follow_fd = -1;        // inotify instance, -1 when not following
+static off_t follow_offset = 0;   // bytes of the file already in the buffer
+static bool follow_joins = false; // appended text continues the last row
+
+// the open file is watched for changes made by other programs, compared with
+// the file as last loaded or saved
+static int watch_fd = -1;         // inotify instance
+static int watch_wd = -1;         // watch of the loaded file
+static struct stat disk_stat;     // file as last loaded or saved
+static bool disk_changed = false; // change found (and reported)
+
+// records the state of the file just loaded from fd, and watches for changes
+// to it, see editor_check_watched_file()
+static void editor_watch_file(const char *file_path, int fd) {
+    fstat(fd, &disk_stat);
+    disk_changed = false;
+
+    // without inotify, changes simply go unnoticed
+    if (watch_fd == -1) { watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); }
+    if (watch_fd == -1) { return; }
+
+    if (watch_wd != -1) { inotify_rm_watch(watch_fd, watch_wd); }
+    // a file replaced by renaming another over it (as many programs save)
+    // has its link count changed
+    watch_wd = inotify_add_watch(watch_fd, file_path,
+                                 IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+                                     IN_DELETE_SELF);
+}
+
+// whether st describes a different file, or different version of it, than
+// the one last loaded or saved
+static bool editor_disk_stat_differs(const struct stat *st) {
+    return st->st_dev != disk_stat.st_dev || st->st_ino != disk_stat.st_ino ||
+           st->st_size != disk_stat.st_size ||
+           st->st_mtim.tv_sec != disk_stat.st_mtim.tv_sec ||
+           st->st_mtim.tv_nsec != disk_stat.st_mtim.tv_nsec;
+}
+
+// whether the file was truncated in place, cutting short the text still mapped
+// (and viewed by rows), which can no longer be read beyond its new end
+static bool editor_disk_truncated(const struct stat *st) {
+    return st->st_dev == disk_stat.st_dev && st->st_ino == disk_stat.st_ino &&
+           st->st_size < disk_stat.st_size;
+}
+
+// returns path of the undo journal of file (named by the hash of its full
+// path), making the directories it is in, NULL if there is none
+static char *editor_get_journal_path(const char *file_path) {
+    char *xdg_state_dir = getenv("XDG_STATE_HOME");
+    char *home_dir = getenv("HOME");
+
+    char *dir;
+    if (xdg_state_dir) {
+        asprintf(&dir, "%s/%s/%s", xdg_state_dir, A1_CONFIG_DIR, A1_UNDO_DIR);
+    } else if (home_dir) {
+        asprintf(&dir, "%s/.local/state/%s/%s", home_dir, A1_CONFIG_DIR,
+                 A1_UNDO_DIR);
+    } else {
+        return NULL;
+    }
+
+    // directories are private, as journals hold text of files
+    for (char *slash = strchr(dir + 1, '/'); slash != NULL;
+         slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(dir, 0700);
+        *slash = '/';
+    }
+    char *real_path = realpath(file_path, NULL);
+    if ((mkdir(dir, 0700) == -1 && errno != EEXIST) || real_path == NULL) {
+        free(real_path);
+        free(dir);
+        return NULL;
+    }
+
+    char *journal_path;
+    asprintf(&journal_path, "%s/%016" PRIx64, dir,
+             editor_line_hash(real_path, strlen(real_path)));
+    free(real_path);
+    free(dir);
+    return journal_path;
+}
+
+// keeps undo history in the journal of file, whose text was just loaded (or
+// written) and is now the original text
+static void editor_attach_action_history(const char *file_path) {
+    char *journal_path = editor_get_journal_path(file_path);
+    if (journal_path == NULL) { return; }
+
+    size_t size;
+    const char *data =
+        editor_piece_table_original(editor_state.piece_table, &size);
+    editor_action_history_attach(editor_state.action_history, journal_path,
+                                 &disk_stat, data, size);
+    free(journal_path);
+}
+
+// maps the file, also indexing its lines in large-file mode, exits on failure
+static void editor_load_file(const char *file_path, bool large) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1) { terminal_die("open"); }
+
+    if (!editor_piece_table_load_file(editor_state.piece_table, fd)) {
+        terminal_die("editor_piece_table_load_file");
+    }
+    editor_watch_file(file_path, fd);
+    close(fd);
+
+    // appends are followed from the end of the text now in the buffer
+    size_t size;
+    const char *data =
+        editor_piece_table_original(editor_state.piece_table, &size);
+    follow_offset = size;
+    follow_joins = size == 0 || data[size - 1] != '\n'; // or the empty row
+    if (follow_fd != -1) {
+        lseek(stream_fd, follow_offset, SEEK_SET);
+        stream_len = 0;
+    }
+
+    if (!large) { return; }
+
+    if (editor_state.line_index != NULL) {
+        editor_line_index_destroy(editor_state.line_index);
+    }
+
+    editor_state.line_index = editor_line_index_create(data, size);
+}
+
+// waits for every line of the file to be indexed, exits on failure
+static void editor_wait_for_line_index(void) {
+    int error = editor_line_index_wait(editor_state.line_index);
+    if (error != 0) {
+        errno = error;
+        terminal_die("editor_line_index_create");
+    }
+}
+
+// adds rows for the lines indexed since the last call (large-file mode)
+// returns false once every line has been added
+static bool editor_load_indexed_lines(void) {
+    bool complete;
+    int count = editor_line_index_count(editor_state.line_index, &complete);
+
+    editor_append_unloaded_rows(loaded_lines, count - loaded_lines);
+    loaded_lines = count;
+
+    if (!complete) { return true; }
+
+    editor_wait_for_line_index();
+    return false;
+}
+
+// inserts rows for the next batch of lines, returns false once every line has
+// been inserted
+static bool editor_load_next_batch(void) {
+    size_t size;
+    const char *data =
+        editor_piece_table_original(editor_state.piece_table, &size);
+    if (load_offset == size) { return false; }
+
+    // batches end after a newline, unless at the end of the file
+    size_t len = MIN(LOAD_BATCH_SIZE, size - load_offset);
+    const char *batch = data + load_offset;
+    const char *newline = memrchr(batch, '\n', len);
+    if (newline == NULL) {
+        newline = memchr(batch + len, '\n', size - load_offset - len);
+    }
+    len = newline != NULL ? (size_t)(newline - batch) + 1 : size - load_offset;
+
+    // loading is not a modification
+    bool modified = editor_state.modified;
+    if (!editor_insert_rows_view(editor_state.num_rows, batch, len)) {
+        errno = EFBIG;
+        terminal_die("editor_open_text_file");
+    }
+    editor_state.modified = modified;
+
+    load_offset += len;
+    return load_offset < size;
+}
+
+// inserts rows for lines of text read from the stream
+static void editor_append_stream_text(const char *text, size_t len) {
+    // loading is not a modification
+    bool modified = editor_state.modified;
+    bool at_end = editor_state.cursor_y == editor_state.num_rows - 1;
+
+    // a followed file's last line may have been incomplete when it was read
+    if (follow_fd != -1 && follow_joins) {
+        follow_joins = false;
+        const char *newline = memchr(text, '\n', len);
+        size_t line_len = newline != NULL ? (size_t)(newline - text) : len;
+        size_t chars_len = line_len;
+        if (chars_len > 0 && text[chars_len - 1] == '\r') { chars_len--; }
+
+        editor_append_string_to_row(editor_get_row(editor_state.num_rows - 1),
+                                    text, chars_len);
+        text += MIN(line_len + 1, len);
+        len -= MIN(line_len + 1, len);
+    }
+
+    // kept compressed, as nothing else holds the text and most of it (e.g.
+    // of a log) will never be looked at
+    if (!editor_append_packed_rows(text, len)) {
+        errno = EFBIG;
+        terminal_die("editor_open_stream");
+    }
+
+    // placeholder is replaced, unless it has been typed into
+    if (stream_placeholder) {
+        stream_placeholder = false;
+        if (!modified) { editor_del_row(0); }
+    }
+    editor_state.modified = modified;
+
+    // like tail -f, the view keeps up with a followed file from its last line
+    if (follow_fd != -1 && at_end) {
+        editor_set_cursor_y(editor_state.num_rows - 1);
+    }
+}
+
+// every line has a row, an empty file is given its single empty row
+static void editor_end_loading(void) {
+    loading = false;
+
+    if (editor_state.num_rows == 0) {
+        bool modified = editor_state.modified;
+        editor_insert_row(0, "", 0);
+        editor_state.modified = modified;
+    }
+}
+
+// loads the file again in place of every row, keeping the cursor and scroll
+// offset where the file is still long enough, used where rows cannot be
+// compared with it (large-file mode) or may view text that can no longer be
+// read (the file was truncated)
+static void editor_reload_whole_file(void) {
+    // actions were made to text that is gone
+    editor_action_history_clear(editor_state.action_history);
+
+    editor_free_rows();
+    editor_state.rows = editor_line_tree_create(editor_load_row);
+
+    editor_piece_table_reset(editor_state.piece_table);
+    editor_load_file(editor_state.file_path, editor_state.line_index != NULL);
+    editor_attach_action_history(editor_state.file_path);
+
+    // enough is loaded for the cursor, the rest follows as when opened
+    loading = true;
+    load_offset = 0;
+    loaded_lines = 0;
+    bool more = true;
+    if (editor_state.line_index != NULL) {
+        editor_line_index_wait_for(
+            editor_state.line_index,
+            MAX(editor_state.cursor_y, editor_state.row_scroll_offset) +
+                editor_state.screen_rows);
+        more = editor_load_indexed_lines();
+    } else {
+        while ((more = editor_load_next_batch()) &&
+               editor_state.num_rows <= editor_state.cursor_y) {}
+    }
+    if (!more) { editor_end_loading(); }
+
+    editor_state.row_scroll_offset =
+        MIN(editor_state.row_scroll_offset, editor_state.num_rows - 1);
+    editor_set_cursor_y(MIN(editor_state.cursor_y, editor_state.num_rows - 1));
+    editor_state.modified = false;
+}
+
+// discards inotify events, which only signal that there may be more to read,
+// and reloads a followed file that was truncated (e.g. by log rotation)
+static void editor_check_followed_file(void) {
+    char events[4096];
+    while (read(follow_fd, events, sizeof(events)) > 0) {}
+
+    struct stat st;
+    off_t offset = lseek(stream_fd, 0, SEEK_CUR);
+    if (fstat(stream_fd, &st) == 0 && st.st_size < offset) {
+        editor_reload_whole_file();
+        editor_set_status_message(MSG_WARNING, "File truncated, reloaded");
+    }
+}
+
+// reports a change made to the open file by another program, once, reloading
+// straight away if rows can no longer be read
+static void editor_check_watched_file(void) {
+    char events[4096];
+    bool notified = false;
+    while (read(watch_fd, events, sizeof(events)) > 0) {
+        notified = true;
+    }
+
+    // a followed file is expected to change, see editor_check_followed_file()
+    if (!notified || disk_changed || follow_fd != -1) { return; }
+
+    struct stat st;
+    if (stat(editor_state.file_path, &st) == -1) {
+        disk_changed = true;
+        editor_set_status_message(MSG_WARNING, "File removed from disk");
+    } else if (editor_disk_truncated(&st)) {
+        editor_reload_whole_file();
+        editor_set_status_message(MSG_WARNING,
+                                  "File truncated on disk, reloaded");
+    } else if (editor_disk_stat_differs(&st)) {
+        disk_changed = true;
+        editor_set_status_message(
+            MSG_WARNING, "File changed on disk, use 'reload' to load it");
+    }
+}
+
+// stops reading the stream, or following the file
+static void editor_close_stream(void) {
+    if (follow_fd != -1) {
+        // held back text is read again if followed later
+        follow_offset = lseek(stream_fd, 0, SEEK_CUR) - stream_len;
+        close(follow_fd);
+        follow_fd = -1;
+    }
+
+    close(stream_fd);
+    stream_fd = -1;
+    free(stream_buf);
+    stream_buf = NULL;
+    stream_len = 0;
+    stream_capacity = 0;
+}
+
+// reads what is available of the stream, up to a batch, and inserts rows for
+// the complete lines read, sets blocked if waiting for the stream to be written
+// returns false once the end of the stream has been reached
+static bool editor_load_stream(bool *blocked) {
+    size_t start = stream_len;
+    bool end = false;
+    *blocked = false;
+
+    while (stream_len - start < LOAD_BATCH_SIZE) {
+        if (stream_capacity - stream_len < STREAM_READ_SIZE) {
+            stream_capacity = MAX(stream_capacity * 2, 2 * STREAM_READ_SIZE);
+            stream_buf = realloc(stream_buf, stream_capacity);
+            if (stream_buf == NULL) { terminal_die("realloc"); }
+        }
+
+        ssize_t bytes_read = read(stream_fd, stream_buf + stream_len,
+                                  stream_capacity - stream_len);
+        if (bytes_read > 0) {
+            stream_len += bytes_read;
+        } else if (bytes_read == 0 && follow_fd != -1) {
+            // the end of a followed file, until it is appended to
+            *blocked = true;
+            break;
+        } else if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        } else if (bytes_read == -1 && errno == EAGAIN) {
+            *blocked = true;
+            break;
+        } else {
+            if (bytes_read == -1) {
+                editor_set_status_message(MSG_ERROR, "Cannot read stdin: %s",
+                                          strerror(errno));
+            }
+            end = true;
+            break;
+        }
+    }
+
+    // held back text has no newline, so only what was just read is searched
+    const char *newline =
+        memrchr(stream_buf + start, '\n', stream_len - start);
+    size_t len = end       ? stream_len
+                 : newline ? (size_t)(newline - stream_buf) + 1
+                           : 0;
+    if (len > 0) {
+        editor_append_stream_text(stream_buf, len);
+        memmove(stream_buf, stream_buf + len, stream_len - len);
+        stream_len -= len;
+    }
+
+    // the buffer is up to date with the followed file
+    if (follow_fd != -1 && *blocked) { fstat(stream_fd, &disk_stat); }
+
+    if (!end) { return true; }
+
+    editor_close_stream();
+    return false;
+}
+
+bool editor_continue_loading(int *wait, int *wait_fd) {
+    *wait = 0;
+    *wait_fd = -1;
+
+    // before anything is drawn from text that may have been truncated
+    if (follow_fd != -1) { editor_check_followed_file(); }
+    if (watch_fd != -1 && editor_state.file_path != NULL) {
+        editor_check_watched_file();
+    }
+
+    if (loading) {
+        bool more = editor_state.line_index != NULL
+                        ? editor_load_indexed_lines()
+                        : editor_load_next_batch();
+        if (more) {
+            if (editor_state.line_index != NULL) { *wait = LOAD_POLL_INTERVAL; }
+            return true;
+        }
+
+        editor_end_loading();
+    }
+
+    // a followed file is read once all of its original text is loaded
+    bool blocked = true;
+    if (stream_fd != -1 && !editor_load_stream(&blocked)) { blocked = true; }
+    if (!blocked) { return true; }
+
+    // with nothing left to read until then, waits for input on the stream,
+    // an append to a followed file or a change to the watched file
+    *wait = -1;
+    *wait_fd = follow_fd != -1   ? follow_fd
+               : stream_fd != -1 ? stream_fd
+                                 : watch_fd;
+    return *wait_fd != -1;
+}
+
+void editor_finish_loading(void) {
+    if (loading && editor_state.line_index != NULL) {
+        editor_wait_for_line_index();
+    }
+
+    // streams may never end, so only what has been read of them is used
+    int wait, wait_fd;
+    while (loading && editor_continue_loading(&wait, &wait_fd)) {}
+}
+
+int editor_loading_progress(void) {
+    if (!loading) { return -1; }
+
+    size_t size;
+    editor_piece_table_original(editor_state.piece_table, &size);
+
+    size_t loaded = editor_state.line_index != NULL
+                        ? editor_line_index_indexed(editor_state.line_index)
+                        : load_offset;
+    return size > 0 ? (int)(loaded * 100 / size) : 0;
+}
+
 void editor_open_text_file(const char *file_path) {
     free(editor_state.file_path);
     editor_state.file_path = strdup(file_path);
     editor_state.file_name = file_name_from_file_path(editor_state.file_path);
 
+    struct stat st;
+    if (stat(file_path, &st) == -1) { terminal_die("stat"); }
+
+    // rather than creating a row for every line up front, large files only
+    // have the offsets of their lines found, with rows loaded as accessed
+    // (which also lets rows be unloaded again to keep within a memory limit)
+    editor_load_file(file_path, editor_state.arguments.large ||
+                                    st.st_size >= LARGE_FILE_SIZE);
     editor_set_syntax(editor_state.file_name);
+    // undo history carries on from when the file was last edited
+    editor_attach_action_history(file_path);
 
-    FILE *fp = fopen(file_path, "r");
-    if (!fp) { terminal_die("fopen"); }
+    // each line of the original text becomes a row viewing it, starting with
+    // enough for the first screen, the rest follow as the editor waits for
+    // input
+    loading = true;
+    load_offset = 0;
+    loaded_lines = 0;
+    if (editor_state.line_index != NULL) {
+        editor_line_index_wait_for(editor_state.line_index,
+                                   editor_state.screen_rows);
+    }
+    int wait, wait_fd;
+    editor_continue_loading(&wait, &wait_fd);
+
+    editor_state.modified = false;
+}
+
+void editor_open_hex_file(const char *file_path) {
+    free(editor_state.file_path);
+    editor_state.file_path = strdup(file_path);
+    editor_state.file_name = file_name_from_file_path(editor_state.file_path);
+
+    editor_state.hex_view = editor_hex_view_open(file_path);
+    if (editor_state.hex_view == NULL) { terminal_die("open"); }
+
+    // there is no text to edit
+    editor_state.file_permissions.can_write = false;
+    editor_state.modified = false;
+}
+
+void editor_open_stream(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        terminal_die("fcntl");
+    }
+
+    // nothing may have been written yet, and there is always at least one row
+    editor_insert_row(0, "", 0);
+    editor_state.modified = false;
+    stream_placeholder = true;
+
+    stream_fd = fd;
+    int wait, wait_fd;
+    editor_continue_loading(&wait, &wait_fd);
+}
+
+bool editor_is_following(void) {
+    return follow_fd != -1;
+}
+
+bool editor_start_following(void) {
+    if (editor_state.file_path == NULL) {
+        editor_set_status_message(MSG_WARNING, "No file to follow");
+        return false;
+    }
+    if (follow_fd != -1) { return true; }
+    if (stream_fd != -1) {
+        editor_set_status_message(MSG_WARNING,
+                                  "Cannot follow while reading stdin");
+        return false;
+    }
+
+    int fd = open(editor_state.file_path, O_RDONLY);
+    int watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1 || watch == -1 ||
+        inotify_add_watch(watch, editor_state.file_path, IN_MODIFY) == -1 ||
+        lseek(fd, follow_offset, SEEK_SET) == -1) {
+        editor_set_status_message(MSG_ERROR, "Cannot follow file: %s",
+                                  strerror(errno));
+        if (fd != -1) { close(fd); }
+        if (watch != -1) { close(watch); }
+        return false;
+    }
+
+    stream_fd = fd;
+    follow_fd = watch;
+    return true;
+}
+
+void editor_stop_following(void) {
+    if (follow_fd != -1) { editor_close_stream(); }
+}
+
+// moves a line, as numbered before a region of lines was replaced, to where it
+// is after, lines within the region stay within what replaced it
+static int editor_shift_line(int line, int start, int removed, int added) {
+    if (line >= start + removed) { return line + added - removed; }
+    if (line >= start) { return start + MIN(line - start, MAX(added - 1, 0)); }
+    return line;
+}
+
+// replaces the rows of the lines differing from the file now mapped (and split
+// into lines), returns number of lines replaced
+static int editor_replace_changed_rows(const char **lines, const size_t *lens,
+                                       int count) {
+    uint64_t *old_hashes = malloc(editor_state.num_rows * sizeof(uint64_t));
+    uint64_t *new_hashes = malloc(count * sizeof(uint64_t));
+    if ((old_hashes == NULL && editor_state.num_rows > 0) ||
+        (new_hashes == NULL && count > 0)) {
+        terminal_die("malloc");
+    }
 
-    char *line = NULL;
-    size_t line_cap = 0;
-    ssize_t line_len; // ssize_t = signed size type
-    while ((line_len = getline(&line, &line_cap, fp)) != -1) {
-        // strip line-ending characters
-        while (line_len > 0 &&
-               (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) {
-            line_len--;
+    // packed lines are hashed without being loaded
+    int row_idx = 0;
+    EditorLineRun run;
+    bool more = editor_line_tree_first_run(editor_state.rows, &run);
+    for (; more; more = editor_line_tree_next_run(&run)) {
+        if (run.row != NULL) {
+            old_hashes[row_idx++] =
+                editor_line_hash(run.row->chars, run.row->size);
+            continue;
         }
-        editor_insert_row(editor_state.num_rows, line, line_len);
+        for (int i = 0; i < run.count; i++) {
+            size_t len;
+            const char *chars = editor_unloaded_line(&run, i, &len);
+            old_hashes[row_idx++] = editor_line_hash(chars, len);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        new_hashes[i] = editor_line_hash(lines[i], lens[i]);
+    }
+
+    int match_count;
+    EditorDiffMatch *matches = editor_diff_lines(
+        old_hashes, editor_state.num_rows, new_hashes, count, &match_count);
+    free(old_hashes);
+    free(new_hashes);
+
+    // the regions between runs of equal lines are replaced, last first so
+    // that the lines before keep their numbers
+    int replaced = 0;
+    int old_end = editor_state.num_rows;
+    int new_end = count;
+    for (int i = match_count; i >= 0; i--) {
+        int old_start =
+            i > 0 ? matches[i - 1].old_line + matches[i - 1].count : 0;
+        int new_start =
+            i > 0 ? matches[i - 1].new_line + matches[i - 1].count : 0;
+        int removed = old_end - old_start;
+        int added = new_end - new_start;
+
+        for (int j = 0; j < removed; j++) {
+            editor_del_row(old_start);
+        }
+        if (added > 0) {
+            const char *text = lines[new_start];
+            size_t len = lines[new_end - 1] + lens[new_end - 1] - text;
+            editor_insert_rows_view(old_start, text, len);
+        }
+        replaced += added;
+
+        editor_state.cursor_y =
+            editor_shift_line(editor_state.cursor_y, old_start, removed, added);
+        editor_state.row_scroll_offset = editor_shift_line(
+            editor_state.row_scroll_offset, old_start, removed, added);
+
+        if (i > 0) {
+            old_end = matches[i - 1].old_line;
+            new_end = matches[i - 1].new_line;
+        }
+    }
+    free(matches);
+
+    return replaced;
+}
+
+// rows of lines which differ from the file on disk are replaced, the rest are
+// kept (with their render and highlight) and moved onto its new text
+static void editor_reload_changed_lines(void) {
+    // actions were made to lines which may have changed
+    editor_action_history_clear(editor_state.action_history);
+
+    editor_finish_loading();
+    editor_close_row_gap();
+
+    // the text currently viewed by rows stays readable until released
+    editor_load_file(editor_state.file_path, false);
+    editor_attach_action_history(editor_state.file_path);
+    size_t size;
+    const char *data =
+        editor_piece_table_original(editor_state.piece_table, &size);
+
+    // split as when loading, with carriage returns before newlines stripped
+    int count = 0;
+    int capacity = 1024;
+    const char **lines = malloc(capacity * sizeof(char *));
+    size_t *lens = malloc(capacity * sizeof(size_t));
+    for (const char *line = data, *end = data + size; line < end;) {
+        if (count == capacity) {
+            capacity *= 2;
+            lines = realloc(lines, capacity * sizeof(char *));
+            lens = realloc(lens, capacity * sizeof(size_t));
+        }
+        if (lines == NULL || lens == NULL) { terminal_die("realloc"); }
+
+        const char *newline = memchr(line, '\n', end - line);
+        size_t len = (newline != NULL ? newline : end) - line;
+        if (len > 0 && line[len - 1] == '\r') { len--; }
+
+        lines[count] = line;
+        lens[count] = len;
+        count++;
+        line = newline != NULL ? newline + 1 : end;
     }
 
-    // if empty file insert row
+    int replaced = editor_replace_changed_rows(lines, lens, count);
     if (editor_state.num_rows == 0) { editor_insert_row(0, "", 0); }
 
-    free(line);
-    fclose(fp);
+    // every row is now a line of the new text in order, packed lines are
+    // independent of it and stay packed
+    int row_idx = 0;
+    EditorLineRun run;
+    bool more = editor_line_tree_first_run(editor_state.rows, &run);
+    for (; more && row_idx < count; more = editor_line_tree_next_run(&run)) {
+        if (run.row != NULL) { editor_rebase_row(run.row, lines[row_idx]); }
+        row_idx += run.count;
+    }
+    free(lines);
+    free(lens);
+    editor_piece_table_release(editor_state.piece_table);
+
+    editor_state.row_scroll_offset =
+        MIN(editor_state.row_scroll_offset, editor_state.num_rows - 1);
+    editor_set_cursor_y(MIN(editor_state.cursor_y, editor_state.num_rows - 1));
     editor_state.modified = false;
+
+    editor_set_status_message(MSG_INFO, "Reloaded, %d of %d lines changed",
+                              replaced, count);
 }
 
-void editor_save_text_buffer(const char *file_path) {
+void editor_reload_file(void) {
+    if (editor_state.file_path == NULL) {
+        editor_set_status_message(MSG_WARNING, "No file to reload");
+        return;
+    }
+
+    struct stat st;
+    if (stat(editor_state.file_path, &st) == -1 ||
+        access(editor_state.file_path, R_OK) == -1) {
+        editor_set_status_message(MSG_ERROR, "Cannot reload: %s",
+                                  strerror(errno));
+        return;
+    }
+
+    // unloaded rows (large-file mode) would have to be loaded to be compared,
+    // costing more than loading the file again
+    if (editor_state.line_index != NULL || editor_disk_truncated(&st)) {
+        editor_reload_whole_file();
+        editor_set_status_message(MSG_INFO, "Reloaded");
+        return;
+    }
+
+    editor_reload_changed_lines();
+}
+
+// rebases every row onto the original text, which holds the text of the rows,
+// releasing the memory of modified rows and the add buffer
+static void editor_rebase_rows(void) {
+    // every line is needed to rebase unloaded rows
+    if (editor_state.line_index != NULL) { editor_wait_for_line_index(); }
+
+    size_t size;
+    const char *data =
+        editor_piece_table_original(editor_state.piece_table, &size);
+
+    int line = 0;
+    EditorLineRun run;
+    bool more = editor_line_tree_first_run(editor_state.rows, &run);
+    for (; more; more = editor_line_tree_next_run(&run)) {
+        if (run.row != NULL) {
+            editor_rebase_row(run.row, run.row->size > 0 ? data : "");
+            data += run.row->size + 1; // +1 for newline character
+        } else if (run.pack != NULL && editor_state.line_index == NULL) {
+            // packed lines are independent of the file and stay packed
+            for (int i = 0; i < run.count; i++) {
+                size_t len;
+                editor_unloaded_line(&run, i, &len);
+                data += len + 1;
+            }
+        } else {
+            // unloaded lines are found at the same lines of the written file
+            editor_line_tree_rebase_run(&run, line);
+            size_t len;
+            editor_line_index_lines(editor_state.line_index, line, run.count,
+                                    &len);
+            data += len + 1;
+        }
+        line += run.count;
+    }
+}
+
+// once written, the file becomes the new original text and every row is
+// rebased onto it
+static void editor_remap_written_file(const char *file_path) {
+    editor_piece_table_reset(editor_state.piece_table);
+    editor_load_file(file_path, editor_state.line_index != NULL);
+    editor_rebase_rows();
+}
+
+// makes text (the rows written to a string) the original text in place of the
+// file, unmapping it so that it can be written in place without rows viewing
+// it changing (or faulting, once truncated), even should writing fail
+static void editor_unmap_file(char *text, size_t len) {
+    editor_piece_table_load_text(editor_state.piece_table, text, len);
+
+    if (editor_state.line_index != NULL) {
+        editor_line_index_destroy(editor_state.line_index);
+        editor_state.line_index = editor_line_index_create(text, len);
+    }
+
+    editor_rebase_rows();
+    editor_piece_table_release(editor_state.piece_table);
+}
+
+// a single write() is cut short at around 2GB on Linux, so writes continue
+// until everything is written
+static bool write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written == -1) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        buf += written;
+        len -= written;
+    }
+    return true;
+}
+
+// copies the extended attributes (including ACLs) of the file at path to the
+// new file fd, returns false if any cannot be
+static bool editor_copy_file_xattrs(int fd, const char *path) {
+    ssize_t size = listxattr(path, NULL, 0);
+    if (size <= 0) { return size == 0 || errno == ENOTSUP; }
+
+    char *names = malloc(size);
+    size = listxattr(path, names, size);
+    bool copied = size != -1;
+
+    for (ssize_t i = 0; copied && i < size; i += strlen(&names[i]) + 1) {
+        const char *name = &names[i];
+        ssize_t len = getxattr(path, name, NULL, 0);
+        char *value = malloc(MAX(len, 1));
+        copied = len != -1 && getxattr(path, name, value, len) == len &&
+                 fsetxattr(fd, name, value, len, 0) == 0;
+        free(value);
+    }
+
+    free(names);
+    return copied;
+}
+
+// gives the new file fd the owner, mode and extended attributes of the file at
+// path (with st as its status), returns false if they cannot all be given
+static bool editor_copy_file_attributes(int fd, const char *path,
+                                        const struct stat *st) {
+    // only root may give a file away
+    if ((st->st_uid != geteuid() || st->st_gid != getegid()) &&
+        fchown(fd, st->st_uid, st->st_gid) == -1) {
+        return false;
+    }
+    return fchmod(fd, st->st_mode & 07777) == 0 &&
+           editor_copy_file_xattrs(fd, path);
+}
+
+// writes text to a new file beside the file at path and renames it over that
+// file, so that the file is never left partly written, and the mapping rows
+// view keeps the old file until the new one is complete
+// returns false with errno set on failure, leaving the file as it was, errno
+// being EXDEV if the file must be written in place instead, as a new file
+// cannot be made beside it or could not take its place unnoticed (as another
+// hard link to it, or with an owner or attributes that cannot be carried over)
+static bool editor_replace_file(const char *path, const char *buf,
+                                size_t len) {
+    struct stat st;
+    bool exists = stat(path, &st) == 0;
+    if (exists && st.st_nlink > 1) {
+        errno = EXDEV;
+        return false;
+    }
+
+    char *temp_path;
+    asprintf(&temp_path, "%s.a1-XXXXXX", path);
+
+    int fd = mkstemp(temp_path);
+    if (fd == -1) {
+        if (errno == EACCES || errno == EPERM || errno == EROFS) {
+            errno = EXDEV;
+        }
+        free(temp_path);
+        return false;
+    }
+
+    bool replaced;
+    if (exists) {
+        replaced = editor_copy_file_attributes(fd, path, &st);
+        if (!replaced) { errno = EXDEV; }
+    } else {
+        mode_t mask = umask(0);
+        umask(mask);
+        replaced = fchmod(fd, 0644 & ~mask) == 0;
+    }
+
+    replaced = replaced && write_all(fd, buf, len) && fsync(fd) == 0;
+    if (close(fd) == -1) { replaced = false; }
+    replaced = replaced && rename(temp_path, path) == 0;
+
+    if (!replaced) {
+        int error = errno;
+        unlink(temp_path);
+        errno = error;
+    }
+
+    free(temp_path);
+    return replaced;
+}
+
+// writes text over the file at path (as when it cannot be replaced, see
+// editor_replace_file()), once rows no longer view it
+// returns false with errno set on failure
+static bool editor_overwrite_file(const char *path, const char *buf,
+                                  size_t len) {
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) { return false; }
+
+    // truncated after writing, so that a failed write leaves the old file's
+    // tail rather than a hole
+    bool written = write_all(fd, buf, len) && ftruncate(fd, len) == 0 &&
+                   fsync(fd) == 0;
+    if (close(fd) == -1) { written = false; }
+    return written;
+}
+
+// writes text (taking it) to the file at path, returns false with errno set
+// on failure
+static bool editor_write_file(const char *file_path, char *buf, size_t len) {
+    // a symbolic link is kept, writing the file it points to instead
+    char *real_path = realpath(file_path, NULL);
+    const char *path = real_path != NULL ? real_path : file_path;
+
+    bool written = editor_replace_file(path, buf, len);
+    int error = errno;
+    if (!written && error == EXDEV) {
+        editor_unmap_file(buf, len);
+        written = editor_overwrite_file(path, buf, len);
+        error = errno;
+    } else {
+        free(buf);
+    }
+
+    free(real_path);
+    errno = error;
+    return written;
+}
+
+void editor_save_text_buffer(const char *file_path, bool force) {
     if (!editor_state.file_permissions.can_write) {
         editor_set_status_message(MSG_WARNING,
                                   "Cannot save, file is read-only.");
@@ -79,27 +999,51 @@ void editor_save_text_buffer(const char *file_path) {
         return;
     }
 
-    int len;
+    // changes made by another program would be lost
+    struct stat st;
+    if (editor_state.file_path != NULL &&
+        strcmp(file_path, editor_state.file_path) == 0 &&
+        stat(file_path, &st) == 0) {
+        if (editor_disk_truncated(&st)) {
+            // text viewed by rows is gone, see editor_check_watched_file()
+            editor_reload_whole_file();
+            editor_set_status_message(MSG_WARNING,
+                                      "File truncated on disk, reloaded");
+            return;
+        }
+        if (!force && (disk_changed || editor_disk_stat_differs(&st))) {
+            disk_changed = true;
+            editor_set_status_message(
+                MSG_WARNING, "File changed on disk, use 'save!' to overwrite");
+            return;
+        }
+    }
+
+    editor_finish_loading();
+
+    size_t len;
     char *buf = editor_rows_to_string(&len);
+    if (buf == NULL) {
+        editor_set_status_message(MSG_ERROR, "Cannot save! Out of memory");
+        return;
+    }
 
-    int fd = open(file_path, O_RDWR | O_CREAT, 0644);
-    if (fd != -1) {
-        // ftruncate() adds 0 padding or deletes data to set file size same as
-        // len
-        if (ftruncate(fd, len) != -1) {
-            if (write(fd, buf, len) == len) {
-                close(fd);
-                free(buf);
-                editor_state.modified = false;
-                editor_set_status_message(MSG_INFO, "%d bytes written to %s",
-                                          len, editor_state.file_path);
-                return;
-            }
+    if (editor_write_file(file_path, buf, len)) {
+        editor_remap_written_file(file_path);
+        editor_attach_action_history(file_path);
+        editor_state.modified = false;
+
+        // a followed file is read through a descriptor of the file replaced
+        if (editor_is_following()) {
+            editor_stop_following();
+            editor_start_following();
         }
-        close(fd);
+
+        editor_set_status_message(MSG_INFO, "%zu bytes written to %s", len,
+                                  editor_state.file_path);
+        return;
     }
 
-    free(buf);
     editor_set_status_message(MSG_ERROR, "Cannot save! I/O error: %s",
                               strerror(errno));
 }
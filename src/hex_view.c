@@ -0,0 +1,290 @@
+#define _GNU_SOURCE // memmem(), memrchr()
+
+#include "hex_view.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool editor_hex_view_is_binary(const char *file_path) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1) { return false; }
+
+    char buf[HEX_VIEW_SNIFF_SIZE];
+    ssize_t len = read(fd, buf, sizeof(buf));
+    close(fd);
+
+    return len > 0 && memchr(buf, '\0', len) != NULL;
+}
+
+// maps the file at its current size, leaving the view empty if it cannot
+static void editor_hex_view_map(EditorHexView *view, size_t size) {
+    view->data = NULL;
+    view->size = 0;
+
+    if (size > 0) {
+        void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, view->fd, 0);
+        if (data == MAP_FAILED) { return; }
+        view->data = data;
+        view->size = size;
+    }
+
+    view->offset_digits = 8;
+    while (view->offset_digits < 16 && view->size > 0 &&
+           (view->size - 1) >> (4 * view->offset_digits) != 0) {
+        view->offset_digits++;
+    }
+}
+
+static void editor_hex_view_unmap(EditorHexView *view) {
+    if (view->data != NULL) { munmap((void *)view->data, view->size); }
+    view->data = NULL;
+    view->size = 0;
+}
+
+EditorHexView *editor_hex_view_open(const char *file_path) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1) { return NULL; }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+
+    EditorHexView *view = malloc(sizeof(EditorHexView));
+    view->fd = fd;
+    view->cursor = 0;
+    view->scroll_line = 0;
+    view->pattern = NULL;
+    view->pattern_len = 0;
+
+    editor_hex_view_map(view, st.st_size);
+    if (view->data == NULL && st.st_size > 0) {
+        int error = errno;
+        close(fd);
+        free(view);
+        errno = error;
+        return NULL;
+    }
+
+    return view;
+}
+
+void editor_hex_view_close(EditorHexView *view) {
+    editor_hex_view_unmap(view);
+    close(view->fd);
+    free(view->pattern);
+    free(view);
+}
+
+bool editor_hex_view_refresh(EditorHexView *view) {
+    struct stat st;
+    if (fstat(view->fd, &st) == -1 || (size_t)st.st_size == view->size) {
+        return false;
+    }
+
+    editor_hex_view_unmap(view);
+    editor_hex_view_map(view, st.st_size);
+
+    view->cursor = MIN(view->cursor, view->size > 0 ? view->size - 1 : 0);
+    view->scroll_line =
+        MIN(view->scroll_line, editor_hex_view_lines(view) - 1);
+    return true;
+}
+
+size_t editor_hex_view_lines(const EditorHexView *view) {
+    return MAX((view->size + HEX_VIEW_LINE_BYTES - 1) / HEX_VIEW_LINE_BYTES,
+               1);
+}
+
+const unsigned char *editor_hex_view_line(const EditorHexView *view,
+                                          size_t line, size_t *len) {
+    size_t offset = line * HEX_VIEW_LINE_BYTES;
+    if (offset >= view->size) {
+        *len = 0;
+        return NULL;
+    }
+
+    *len = MIN(view->size - offset, HEX_VIEW_LINE_BYTES);
+    return &view->data[offset];
+}
+
+void editor_hex_view_byte_cols(const EditorHexView *view, int i, int *hex_col,
+                               int *ascii_col) {
+    // two spaces after the offset, and an extra one between halves of a line
+    int hex_start = view->offset_digits + 2;
+    *hex_col = hex_start + 3 * i + (i >= HEX_VIEW_LINE_BYTES / 2);
+
+    // hex is followed by a space, then ASCII between bars
+    *ascii_col = hex_start + 3 * HEX_VIEW_LINE_BYTES + 1 + 2 + i;
+}
+
+int editor_hex_view_format_line(const EditorHexView *view, size_t line,
+                                char *buf) {
+    static const char digits[] = "0123456789abcdef";
+
+    size_t len;
+    const unsigned char *bytes = editor_hex_view_line(view, line, &len);
+
+    int hex_col, ascii_col;
+    editor_hex_view_byte_cols(view, 0, &hex_col, &ascii_col);
+
+    // spaces where there are no bytes (the end of the last line)
+    memset(buf, ' ', ascii_col);
+    snprintf(buf, HEX_VIEW_LINE_MAX, "%0*zx", view->offset_digits,
+             line * HEX_VIEW_LINE_BYTES);
+    buf[view->offset_digits] = ' ';
+    buf[ascii_col - 1] = '|';
+
+    for (size_t i = 0; i < len; i++) {
+        editor_hex_view_byte_cols(view, i, &hex_col, &ascii_col);
+        buf[hex_col] = digits[bytes[i] >> 4];
+        buf[hex_col + 1] = digits[bytes[i] & 0xf];
+        // printable ASCII only, whatever the locale
+        buf[ascii_col] = bytes[i] >= ' ' && bytes[i] < 0x7f ? bytes[i] : '.';
+    }
+
+    editor_hex_view_byte_cols(view, len, &hex_col, &ascii_col);
+    buf[ascii_col] = '|';
+    return ascii_col + 1;
+}
+
+// returns value of hex digit, -1 if c is not one
+static int hex_digit_value(char c) {
+    if (c >= '0' && c <= '9') { return c - '0'; }
+    if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+    if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    return -1;
+}
+
+bool editor_hex_view_parse_offset(const char *string, size_t *offset) {
+    // decimal offsets may also have a K, M or G suffix
+    if (string[0] != '0' || (string[1] != 'x' && string[1] != 'X')) {
+        bool valid;
+        *offset = parse_size(string, &valid);
+        return valid;
+    }
+
+    const char *digits = &string[2];
+    if (*digits == '\0') { return false; }
+
+    size_t num = 0;
+    for (; *digits != '\0'; digits++) {
+        int value = hex_digit_value(*digits);
+        if (value == -1 || num > (SIZE_MAX >> 4)) { return false; }
+        num = (num << 4) | value;
+    }
+
+    *offset = num;
+    return true;
+}
+
+// appends bytes of word of pattern, returns false if it is invalid
+static bool editor_hex_view_parse_word(const char *word,
+                                       unsigned char *pattern, size_t *len) {
+    size_t word_len = strlen(word);
+
+    // quoted text is searched for as it is
+    if (word[0] == '"') {
+        if (word_len < 2 || word[word_len - 1] != '"') { return false; }
+        memcpy(&pattern[*len], &word[1], word_len - 2);
+        *len += word_len - 2;
+        return true;
+    }
+
+    if (word_len % 2 != 0) { return false; }
+    for (size_t i = 0; i < word_len; i += 2) {
+        int high = hex_digit_value(word[i]);
+        int low = hex_digit_value(word[i + 1]);
+        if (high == -1 || low == -1) { return false; }
+        pattern[(*len)++] = (high << 4) | low;
+    }
+    return true;
+}
+
+unsigned char *editor_hex_view_parse_pattern(char **words, int count,
+                                             size_t *len) {
+    size_t capacity = 0;
+    for (int i = 0; i < count; i++) {
+        capacity += strlen(words[i]);
+    }
+
+    unsigned char *pattern = malloc(MAX(capacity, 1));
+    *len = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (!editor_hex_view_parse_word(words[i], pattern, len)) {
+            free(pattern);
+            return NULL;
+        }
+    }
+
+    if (*len == 0) {
+        free(pattern);
+        return NULL;
+    }
+    return pattern;
+}
+
+// returns the first (or last) match of pattern starting within [from, to)
+static const unsigned char *editor_hex_view_find_within(
+    const EditorHexView *view, size_t from, size_t to, bool forward) {
+    size_t pattern_len = view->pattern_len;
+    if (view->size < pattern_len) { return NULL; }
+
+    to = MIN(to, view->size - pattern_len + 1);
+    if (from >= to) { return NULL; }
+
+    const unsigned char *text = &view->data[from];
+
+    // memmem() is vectorised by the C library
+    if (forward) {
+        return memmem(text, to - from + pattern_len - 1, view->pattern,
+                      pattern_len);
+    }
+
+    // backwards, candidates are found by their first byte
+    size_t end = to - from;
+    while (end > 0) {
+        const unsigned char *match = memrchr(text, view->pattern[0], end);
+        if (match == NULL) { return NULL; }
+        if (memcmp(match, view->pattern, pattern_len) == 0) { return match; }
+        end = match - text;
+    }
+    return NULL;
+}
+
+bool editor_hex_view_find(const EditorHexView *view, bool forward,
+                          size_t *offset, bool *wrapped) {
+    if (view->pattern == NULL) { return false; }
+
+    const unsigned char *match;
+    *wrapped = false;
+
+    if (forward) {
+        match =
+            editor_hex_view_find_within(view, view->cursor + 1, SIZE_MAX, true);
+        if (match == NULL) {
+            match = editor_hex_view_find_within(view, 0, view->cursor + 1,
+                                                true);
+            *wrapped = true;
+        }
+    } else {
+        match = editor_hex_view_find_within(view, 0, view->cursor, false);
+        if (match == NULL) {
+            match = editor_hex_view_find_within(view, view->cursor, SIZE_MAX,
+                                                false);
+            *wrapped = true;
+        }
+    }
+
+    if (match == NULL) { return false; }
+    *offset = match - view->data;
+    return true;
+}
@@ -1,5 +1,7 @@
 #include "highlight.h"
 #include "a1.h"
+#include "operations.h"
+#include "output.h"
 #include "syntaxes.h"
 #include "util.h"
 #include <ctype.h>
@@ -10,14 +12,86 @@ static bool is_separator(char ch) {
     return ch == SPACE || ch == '\0' || strchr(",.()+-/*=~%<>[];", ch) != NULL;
 }
 
-void editor_update_syntax_highlight(EditorRow *row) {
-    // minimum of 1 required since setting a size of 0 frees the pointer
-    row->highlight = realloc(row->highlight, MAX(row->render_size, 1));
+typedef struct {
+    EditorHighlightSpan *spans;
+    int count;
+    int capacity;
+} SpanBuffer;
+
+// spans of the row being highlighted, reused as they are copied into the row
+static SpanBuffer span_buffer = {NULL, 0, 0};
+
+// highlights columns [idx, idx + len), extending the last span where possible
+// columns are highlighted in order, so only the last span can be extended
+static void set_highlight(SpanBuffer *buffer, ssize_t idx, EditorHighlight hl,
+                          ssize_t len) {
+    if (buffer == NULL || hl == HL_NORMAL) { return; }
+
+    if (buffer->count > 0) {
+        EditorHighlightSpan *last = &buffer->spans[buffer->count - 1];
+        if (last->highlight == hl && last->start + last->len >= idx) {
+            last->len = MAX(last->start + last->len, idx + len) - last->start;
+            return;
+        }
+    }
+
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity = MAX(buffer->capacity * 2, 16);
+        buffer->spans = realloc(buffer->spans,
+                                buffer->capacity * sizeof(EditorHighlightSpan));
+    }
+    buffer->spans[buffer->count++] =
+        (EditorHighlightSpan){.start = idx, .len = len, .highlight = hl};
+}
+
+// returns highlight of column idx - 1, when columns up to idx are highlighted
+static EditorHighlight previous_highlight(const SpanBuffer *buffer,
+                                          ssize_t idx) {
+    if (buffer->count == 0) { return HL_NORMAL; }
+
+    EditorHighlightSpan *last = &buffer->spans[buffer->count - 1];
+    if (last->start + last->len == idx) { return last->highlight; }
+    return HL_NORMAL;
+}
+
+// whether string occurs at idx of text, without reading past len
+static bool text_matches(const char *text, ssize_t len, ssize_t idx,
+                         const char *string, int string_len) {
+    return idx + string_len <= len &&
+           memcmp(&text[idx], string, string_len) == 0;
+}
+
+// state a row starts being highlighted in
+static EditorScanState editor_scan_start(bool in_ml_comment) {
+    return (EditorScanState){
+        .skip = 0,
+        .prev_hl = HL_NORMAL,
+        .prev_sep = true, // beginning of line treated as separator
+        .in_str = false,
+        .str_ch = '\0',
+        .in_ml_comment = in_ml_comment,
+        .in_sl_comment = false,
+    };
+}
 
-    // fill row with 'normal' values
-    memset(row->highlight, HL_NORMAL, row->render_size);
+// scans text from state, up to stop (len - stop chars after it are only read
+// to finish a token started before it), adding spans to highlight unless NULL
+// (when only the multi-line comment state is wanted, which tabs and words do
+// not affect)
+// returns state reached, its skip being how far past stop a token ran
+static EditorScanState editor_scan_text(const char *text, ssize_t len,
+                                        ssize_t stop, EditorScanState state,
+                                        SpanBuffer *highlight) {
+    if (editor_state.syntax == NULL) { return state; }
+
+    // rest of row is a single-line comment
+    if (state.in_sl_comment) {
+        set_highlight(highlight, 0, HL_SL_COMMENT, len);
+        return state;
+    }
 
-    if (editor_state.syntax == NULL) { return; }
+    // token which ran into text, also giving the highlight a number continues
+    set_highlight(highlight, 0, state.prev_hl, state.skip);
 
     const char **highlight_words[] = {editor_state.syntax->keywords,
                                 editor_state.syntax->types};
@@ -38,24 +112,21 @@ void editor_update_syntax_highlight(EditorRow *row) {
     // multi-line comment end length
     int mlce_len = mlce ? strlen(mlce) : 0;
 
-    bool prev_sep = true; // beginning of line treated as separator
+    bool prev_sep = state.prev_sep;
+    bool in_ml_comment = state.in_ml_comment;
+    bool in_str = state.in_str;
+    char str_ch = state.str_ch; // will be ', " or perhaps something else
 
-    bool in_str = false;
-    char str_ch = '\0'; // will be ', " or perhaps something else
-
-    // in multi-line comment
-    bool in_ml_comment =
-        row->index > 0 && editor_state.rows[row->index - 1].hl_open_comment;
-
-    int i = 0;
-    while (i < row->render_size) {
-        char ch = row->render[i];
-        unsigned char prev_hl = i > 0 ? row->highlight[i - 1] : HL_NORMAL;
+    ssize_t i = state.skip;
+    while (i < stop) {
+        char ch = text[i];
 
         // single-line comment check
         if (slcs_len > 0 && !in_str && !in_ml_comment) {
-            if (strncmp(&row->render[i], slcs, slcs_len) == 0) {
-                memset(&row->highlight[i], HL_SL_COMMENT, row->render_size - i);
+            if (text_matches(text, len, i, slcs, slcs_len)) {
+                set_highlight(highlight, i, HL_SL_COMMENT, len - i);
+                state.in_sl_comment = true;
+                i = stop;
                 break;
             }
         }
@@ -63,11 +134,11 @@ void editor_update_syntax_highlight(EditorRow *row) {
         // multi-line comment check
         if (mlcs_len > 0 && mlce_len > 0 && !in_str) {
             if (in_ml_comment) {
-                row->highlight[i] = HL_ML_COMMENT;
+                set_highlight(highlight, i, HL_ML_COMMENT, 1);
 
                 // if at end
-                if (strncmp(&row->render[i], mlce, mlce_len) == 0) {
-                    memset(&row->highlight[i], HL_ML_COMMENT, mlce_len);
+                if (text_matches(text, len, i, mlce, mlce_len)) {
+                    set_highlight(highlight, i, HL_ML_COMMENT, mlce_len);
                     i += mlce_len;
                     in_ml_comment = false;
                     prev_sep = true;
@@ -78,8 +149,8 @@ void editor_update_syntax_highlight(EditorRow *row) {
                 }
             }
             // if at start
-            else if (strncmp(&row->render[i], mlcs, mlcs_len) == 0) {
-                memset(&row->highlight[i], HL_ML_COMMENT, mlcs_len);
+            else if (text_matches(text, len, i, mlcs, mlcs_len)) {
+                set_highlight(highlight, i, HL_ML_COMMENT, mlcs_len);
                 i += mlcs_len;
                 in_ml_comment = true;
                 goto continue_iteration;
@@ -89,11 +160,11 @@ void editor_update_syntax_highlight(EditorRow *row) {
         // string check
         if (editor_state.syntax->flags & SYNTAX_HIGHLIGHT_STRINGS) {
             if (in_str) {
-                row->highlight[i] = HL_STRING;
+                set_highlight(highlight, i, HL_STRING, 1);
 
                 // if string char escaped, skip
-                if (ch == '\\' && i + 1 < row->render_size) {
-                    row->highlight[i + 1] = HL_STRING;
+                if (ch == '\\' && i + 1 < len) {
+                    set_highlight(highlight, i + 1, HL_STRING, 1);
                     i += 2;
                     goto continue_iteration;
                 }
@@ -106,18 +177,26 @@ void editor_update_syntax_highlight(EditorRow *row) {
                 if (ch == '"' || ch == '\'') {
                     in_str = true;
                     str_ch = ch;
-                    row->highlight[i] = HL_STRING;
+                    set_highlight(highlight, i, HL_STRING, 1);
                     i++;
                     goto continue_iteration;
                 }
             }
         }
 
+        // numbers and words cannot start or end comments or strings
+        if (highlight == NULL) {
+            i++;
+            goto continue_iteration;
+        }
+
+        EditorHighlight prev_hl = previous_highlight(highlight, i);
+
         // numeric literal check
         if (editor_state.syntax->flags & SYNTAX_HIGHLIGHT_NUMBERS) {
             if ((isdigit(ch) && (prev_sep || prev_hl == HL_NUMBER)) ||
                 (ch == '.' && prev_hl == HL_NUMBER)) {
-                row->highlight[i] = HL_NUMBER;
+                set_highlight(highlight, i, HL_NUMBER, 1);
                 i++;
                 prev_sep = false;
                 goto continue_iteration;
@@ -130,13 +209,13 @@ void editor_update_syntax_highlight(EditorRow *row) {
                 for (int k = 0; highlight_words[j][k]; k++) {
                     int word_len = strlen(highlight_words[j][k]);
                     // if space for keyword
-                    if (i + word_len < row->render_size) {
-                        if (strncmp(&row->render[i], highlight_words[j][k],
+                    if (i + word_len < len) {
+                        if (strncmp(&text[i], highlight_words[j][k],
                                     word_len) == 0) {
                             // if keyword followed by separator
-                            if (is_separator(row->render[i + word_len])) {
-                                memset(&row->highlight[i], highlights[j],
-                                       word_len);
+                            if (is_separator(text[i + word_len])) {
+                                set_highlight(highlight, i, highlights[j],
+                                              word_len);
                                 i += word_len;
                                 prev_sep = true;
                                 goto continue_iteration;
@@ -154,28 +233,168 @@ void editor_update_syntax_highlight(EditorRow *row) {
         continue;
     }
 
-    // update following rows when multiline comment is updated
-    bool changed = row->hl_open_comment != in_ml_comment;
-    row->hl_open_comment = in_ml_comment;
-    if (changed && row->index + 1 < editor_state.num_rows) {
-        editor_update_syntax_highlight(&editor_state.rows[row->index + 1]);
+    state.skip = i - stop;
+    state.prev_hl =
+        highlight != NULL ? previous_highlight(highlight, i) : HL_NORMAL;
+    state.prev_sep = prev_sep;
+    state.in_str = in_str;
+    state.str_ch = str_ch;
+    state.in_ml_comment = in_ml_comment;
+    return state;
+}
+
+static bool editor_starts_in_ml_comment(const EditorRow *row) {
+    EditorRow *prev_row = editor_line_tree_prev(row);
+    return prev_row != NULL && prev_row->hl_open_comment;
+}
+
+static bool editor_scan_states_equal(const EditorScanState *a,
+                                     const EditorScanState *b) {
+    return a->skip == b->skip && a->prev_hl == b->prev_hl &&
+           a->prev_sep == b->prev_sep && a->in_str == b->in_str &&
+           a->str_ch == b->str_ch && a->in_ml_comment == b->in_ml_comment &&
+           a->in_sl_comment == b->in_sl_comment;
+}
+
+// chars of a chunk being scanned, and of the spans they are highlighted with
+// (which give the state of highlighting at its end)
+static char chunk_text[2 * ROW_CHUNK_SIZE + ROW_CHUNK_LOOKAHEAD];
+static SpanBuffer chunk_spans = {NULL, 0, 0};
+
+// scans chunk from its entry state, returns state reached at its end
+static EditorScanState editor_scan_chunk(const EditorRow *row,
+                                         const EditorRowChunk *chunk) {
+    ssize_t len =
+        MIN(chunk->len + ROW_CHUNK_LOOKAHEAD, row->size - chunk->start);
+
+    // tabs are rendered as spaces, which is what highlighting sees
+    for (ssize_t i = 0; i < len; i++) {
+        char c = editor_row_char_at(row, chunk->start + i);
+        chunk_text[i] = c == TAB ? SPACE : c;
     }
+
+    chunk_spans.count = 0;
+    return editor_scan_text(chunk_text, len, chunk->len, chunk->entry,
+                            &chunk_spans);
 }
 
-void editor_update_syntax_highlight_all(void) {
-    for (int row_index = 0; row_index < editor_state.num_rows; row_index++) {
-        editor_update_syntax_highlight(&editor_state.rows[row_index]);
+// brings the highlighting states of long row's chunks up to date, scanning on
+// from the first chunk changed only until reaching a state it had before
+static void editor_scan_row_chunks(const EditorRow *row,
+                                   EditorRowChunks *chunks,
+                                   bool in_ml_comment) {
+    // states scanned with another syntax are unknown
+    if (chunks->syntax != editor_state.syntax) {
+        chunks->syntax = editor_state.syntax;
+        chunks->dirty = 0;
+        for (int i = 0; i < chunks->count; i++) {
+            chunks->chunks[i].entry.skip = -1;
+        }
+        chunks->exit.skip = -1;
     }
+
+    EditorScanState start = editor_scan_start(in_ml_comment);
+    if (!editor_scan_states_equal(&chunks->chunks[0].entry, &start)) {
+        chunks->chunks[0].entry = start;
+        chunks->dirty = 0;
+    }
+
+    for (int i = chunks->dirty; i < chunks->count; i++) {
+        EditorScanState state = editor_scan_chunk(row, &chunks->chunks[i]);
+
+        EditorScanState *next = i + 1 < chunks->count
+                                    ? &chunks->chunks[i + 1].entry
+                                    : &chunks->exit;
+        // following chunks are unchanged, so scan as they did before
+        if (editor_scan_states_equal(&state, next)) { break; }
+        *next = state;
+    }
+
+    chunks->dirty = chunks->count;
+}
+
+const EditorHighlightSpan *editor_highlight_row(const EditorRow *row,
+                                               int *count) {
+    span_buffer.count = 0;
+    EditorScanState state =
+        editor_scan_start(editor_starts_in_ml_comment(row));
+
+    // long row is rendered from the start of a chunk, so is highlighted from
+    // the state at that chunk
+    EditorRowChunks *chunks = row->chunks;
+    if (row->render_start > 0 && editor_state.syntax != NULL) {
+        editor_scan_row_chunks(row, chunks, state.in_ml_comment);
+        int chunk = editor_row_chunks_find_col(chunks, row->render_start);
+        state = chunks->chunks[chunk].entry;
+    }
+
+    editor_scan_text(row->render, row->render_size, row->render_size, state,
+                     &span_buffer);
+
+    for (int i = 0; i < span_buffer.count; i++) {
+        span_buffer.spans[i].start += row->render_start;
+    }
+
+    *count = span_buffer.count;
+    return span_buffer.spans;
+}
+
+// rescans row for its multi-line comment state, returns whether it changed
+static bool editor_update_ml_comment_state(EditorRow *row) {
+    bool in_ml_comment = editor_starts_in_ml_comment(row);
+    EditorRowChunks *chunks = NULL;
+
+    if (editor_state.syntax == NULL) {
+        in_ml_comment = false;
+    } else if ((chunks = editor_row_chunks(row)) != NULL) {
+        // long rows are only rescanned from the chunk changed
+        editor_scan_row_chunks(row, chunks, in_ml_comment);
+        in_ml_comment = chunks->exit.in_ml_comment;
+    } else if (row->gap_start != row->size) {
+        // chars split by an open gap are scanned through render instead
+        editor_prepare_row(row);
+        in_ml_comment =
+            editor_scan_text(row->render, row->render_size, row->render_size,
+                             editor_scan_start(in_ml_comment), NULL)
+                .in_ml_comment;
+    } else {
+        in_ml_comment = editor_scan_text(row->chars, row->size, row->size,
+                                         editor_scan_start(in_ml_comment), NULL)
+                            .in_ml_comment;
+    }
+
+    bool changed = row->hl_open_comment != in_ml_comment;
+    row->hl_open_comment = in_ml_comment;
+    return changed;
 }
 
-void editor_apply_find_mode_highlights(void) {
-    int match_len = strlen(editor_state.find_state.string);
+void editor_update_syntax_highlight(EditorRow *row) {
+    editor_update_syntax_highlight_rows(row, 1);
+}
 
-    for (int match_index = 0;
-         match_index < editor_state.find_state.matches_count; match_index++) {
-        FindMatch *match = &editor_state.find_state.matches[match_index];
-        EditorRow *row = &editor_state.rows[match->row];
-        memset(&row->highlight[match->col], HL_MATCH, match_len);
+void editor_update_syntax_highlight_rows(EditorRow *first, int count) {
+    EditorRow *row = first;
+    bool changed = false;
+
+    for (int i = 0; i < count && row != NULL; i++) {
+        editor_invalidate_row(row);
+        changed = editor_update_ml_comment_state(row);
+        row = editor_line_tree_next(row);
+    }
+
+    // following rows are highlighted differently while the multi-line comment
+    // state they start in keeps changing
+    while (changed && row != NULL) {
+        editor_invalidate_row(row);
+        changed = editor_update_ml_comment_state(row);
+        row = editor_line_tree_next(row);
+    }
+}
+
+void editor_update_syntax_highlight_all(void) {
+    EditorRow *first = editor_get_row(0);
+    if (first != NULL) {
+        editor_update_syntax_highlight_rows(first, editor_state.num_rows);
     }
 }
 
@@ -233,6 +452,16 @@ void editor_set_syntax(char *file_name) {
             }
 
             if (match) {
+                // multi-line comment state would depend on every line above,
+                // so large files are left unhighlighted rather than read in
+                // full
+                if (editor_state.line_index != NULL) {
+                    editor_set_status_message(
+                        MSG_INFO,
+                        "Syntax highlighting is off in large-file mode");
+                    return;
+                }
+
                 editor_state.syntax = syntax;
                 editor_update_syntax_highlight_all();
                 return;
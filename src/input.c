@@ -1,13 +1,77 @@
+#define _POSIX_C_SOURCE 200809L // poll()
+
 #include "a1.h"
+#include "file_io.h"
+#include "operations.h"
+#include "output.h"
 #include "terminal.h"
+#include "utf8.h"
 #include "util.h"
 #include <errno.h>
+#include <poll.h>
 #include <unistd.h>
 
+// how long no key must be pressed for before rows are compacted
+#define COMPACT_IDLE_DELAY 250 // ms
+
+// moves row buffers out of sparsely used slabs (e.g. after mass deletions) once
+// no key has been pressed for a moment, as it takes time in proportion to all
+// the text rather than to what was just done
+static void editor_compact_when_idle(void) {
+    if (!editor_arena_is_fragmented(editor_state.arena)) { return; }
+
+    struct pollfd fd = {.fd = STDIN_FILENO, .events = POLLIN};
+    if (poll(&fd, 1, COMPACT_IDLE_DELAY) == 0) { editor_compact_rows(); }
+}
+
+// the opened file continues loading (and is watched) until a key is pressed
+static void editor_load_until_keypress(void) {
+    int wait, wait_fd;
+    bool more = editor_continue_loading(&wait, &wait_fd);
+
+    while (more) {
+        // a negative descriptor is ignored by poll()
+        struct pollfd fds[2] = {{.fd = STDIN_FILENO, .events = POLLIN},
+                                {.fd = wait_fd, .events = POLLIN}};
+        if (poll(fds, 2, wait) > 0 && fds[0].revents != 0) { return; }
+
+        // drawn only after the file has been checked for changes, as rows may
+        // view text which has since been truncated
+        more = editor_continue_loading(&wait, &wait_fd);
+        editor_refresh_screen();
+    }
+}
+
+// reads the rest of a UTF-8 sequence starting with lead, returns its code point
+static int editor_read_code_point(char lead) {
+    char seq[UTF8_MAX_LEN] = {lead};
+    int len = 1;
+    if ((lead & 0xE0) == 0xC0) {
+        len = 2;
+    } else if ((lead & 0xF0) == 0xE0) {
+        len = 3;
+    } else if ((lead & 0xF8) == 0xF0) {
+        len = 4;
+    }
+
+    for (int i = 1; i < len; i++) {
+        if (read(STDIN_FILENO, &seq[i], 1) != 1) { break; }
+    }
+
+    uint32_t code_point;
+    if (editor_utf8_decode(seq, len, &code_point) == 0) {
+        return 0xFFFD; // replacement character
+    }
+    return code_point;
+}
+
 static int editor_read_key(void) {
     int bytes_read;
     char c;
 
+    editor_compact_when_idle();
+    editor_load_until_keypress();
+
     // blocking
     while ((bytes_read = read(STDIN_FILENO, &c, 1)) != 1) {
         // EAGAIN = "try again error" (required for Cygwin)
@@ -69,6 +133,8 @@ static int editor_read_key(void) {
             }
         }
         return ESCAPE;
+    } else if ((unsigned char)c & 0x80) {
+        return editor_read_code_point(c);
     } else {
         return c;
     }
@@ -82,22 +148,23 @@ void editor_process_keypress(void) {
 void editor_set_cursor_x(int x) {
     editor_state.cursor_x = x;
     editor_state.target_x = editor_row_cx_to_rx(
-        &editor_state.rows[editor_state.cursor_y], editor_state.cursor_x);
+        editor_get_row(editor_state.cursor_y), editor_state.cursor_x);
 }
 
 void editor_set_cursor_y(int y) {
     editor_state.cursor_y = y;
-    EditorRow *row = &editor_state.rows[editor_state.cursor_y];
-    if (editor_state.target_x > row->size - 1) {
-        editor_state.cursor_x = MAX(row->size - 1, 0);
-    } else {
-        editor_state.cursor_x = editor_row_rx_to_cx(row, editor_state.target_x);
-    }
+    EditorRow *row = editor_get_row(editor_state.cursor_y);
+    ssize_t cx = editor_row_rx_to_cx(row, editor_state.target_x);
+
+    // past the end of row, cursor stays on its last char
+    if (cx >= row->size) { cx = editor_row_prev_char(row, row->size); }
+    editor_state.cursor_x = cx;
 }
 
 void editor_move_new_position(EditorRow *row,
-                              void move_fn(EditorRow *, int *, int *)) {
-    int new_cx, new_cy;
+                              void move_fn(EditorRow *, ssize_t *, int *)) {
+    ssize_t new_cx;
+    int new_cy;
     move_fn(row, &new_cx, &new_cy);
     if (new_cx != -1 && new_cy != -1) {
         editor_set_cursor_y(new_cy);
@@ -0,0 +1,169 @@
+#include "line_diff.h"
+#include "util.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// edits searched for between the common start and end of the texts, beyond
+// which the lines between are all treated as differing, as the search takes
+// memory quadratic in the number of edits
+#define MAX_DIFF_EDITS 1024
+
+// FNV-1a
+uint64_t editor_line_hash(const char *chars, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)chars[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+typedef struct {
+    EditorDiffMatch *matches;
+    int count;
+    int capacity;
+} DiffMatchList;
+
+// adds a single pair of equal lines, extending the last run if adjacent
+static bool add_match(DiffMatchList *list, int old_line, int new_line,
+                      int count) {
+    if (count == 0) { return true; }
+
+    if (list->count > 0) {
+        EditorDiffMatch *last = &list->matches[list->count - 1];
+        if (last->old_line + last->count == old_line &&
+            last->new_line + last->count == new_line) {
+            last->count += count;
+            return true;
+        }
+    }
+
+    if (list->count == list->capacity) {
+        int capacity = MAX(list->capacity * 2, 16);
+        EditorDiffMatch *matches =
+            realloc(list->matches, capacity * sizeof(EditorDiffMatch));
+        if (matches == NULL) { return false; }
+        list->matches = matches;
+        list->capacity = capacity;
+    }
+
+    list->matches[list->count++] =
+        (EditorDiffMatch){old_line, new_line, count};
+    return true;
+}
+
+// Myers' O(ND) algorithm over a and b, with the furthest reaching x of each
+// diagonal k kept for every number of edits d, to walk back along afterwards
+// adds matches in reverse order, returns false if there are too many edits
+static bool add_shortest_edit_matches(DiffMatchList *list, const uint64_t *a,
+                                      int n, const uint64_t *b, int m,
+                                      int offset) {
+    int max = MIN(n + m, MAX_DIFF_EDITS);
+    int **trace = calloc(max + 1, sizeof(int *));
+    int *v = calloc(2 * max + 3, sizeof(int));
+    if (trace == NULL || v == NULL) {
+        free(trace);
+        free(v);
+        return false;
+    }
+    v += max + 1; // indexed by diagonal, -max - 1 to max + 1
+
+    int edits = -1;
+    for (int d = 0; d <= max && edits == -1; d++) {
+        // diagonals -d - 1 to d + 1, as reached with d - 1 edits
+        trace[d] = malloc((2 * d + 3) * sizeof(int));
+        if (trace[d] == NULL) { break; }
+        memcpy(trace[d], &v[-d - 1], (2 * d + 3) * sizeof(int));
+
+        for (int k = -d; k <= d; k += 2) {
+            // down from diagonal k + 1 (an insertion), or right from k - 1
+            bool down = k == -d || (k != d && v[k - 1] < v[k + 1]);
+            int x = down ? v[k + 1] : v[k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                x++;
+                y++;
+            }
+            v[k] = x;
+
+            if (x >= n && y >= m) {
+                edits = d;
+                break;
+            }
+        }
+    }
+
+    bool found = edits != -1;
+    if (found) {
+        int x = n, y = m;
+        for (int d = edits; d > 0; d--) {
+            const int *prev = trace[d] + d + 1; // indexed by diagonal
+            int k = x - y;
+            bool down = k == -d || (k != d && prev[k - 1] < prev[k + 1]);
+            int prev_k = down ? k + 1 : k - 1;
+            int prev_x = prev[prev_k];
+            int prev_y = prev_x - prev_k;
+
+            // lines followed along the diagonal after the edit are equal
+            int snake = MIN(x - prev_x, y - prev_y);
+            x -= snake;
+            y -= snake;
+            found = found && add_match(list, offset + x, offset + y, snake);
+
+            x = prev_x;
+            y = prev_y;
+        }
+        found = found && add_match(list, offset, offset, x);
+    }
+
+    for (int d = 0; d <= max && trace[d] != NULL; d++) {
+        free(trace[d]);
+    }
+    free(trace);
+    free(v - max - 1);
+    return found;
+}
+
+EditorDiffMatch *editor_diff_lines(const uint64_t *old_hashes, int old_count,
+                                   const uint64_t *new_hashes, int new_count,
+                                   int *count) {
+    // common start and end are matched directly, leaving only the lines
+    // between to be searched
+    int start = 0;
+    while (start < old_count && start < new_count &&
+           old_hashes[start] == new_hashes[start]) {
+        start++;
+    }
+
+    int end = 0;
+    while (end < old_count - start && end < new_count - start &&
+           old_hashes[old_count - 1 - end] == new_hashes[new_count - 1 - end]) {
+        end++;
+    }
+
+    DiffMatchList list = {NULL, 0, 0};
+    DiffMatchList middle = {NULL, 0, 0};
+
+    bool ok = add_match(&list, 0, 0, start);
+    if (ok && add_shortest_edit_matches(
+                  &middle, old_hashes + start, old_count - start - end,
+                  new_hashes + start, new_count - start - end, start)) {
+        // found back to front
+        for (int i = middle.count - 1; ok && i >= 0; i--) {
+            ok = add_match(&list, middle.matches[i].old_line,
+                           middle.matches[i].new_line, middle.matches[i].count);
+        }
+    }
+    ok = ok && add_match(&list, old_count - end, new_count - end, end);
+    free(middle.matches);
+
+    if (!ok || list.count == 0) {
+        free(list.matches);
+        *count = 0;
+        return NULL;
+    }
+
+    *count = list.count;
+    return list.matches;
+}
@@ -0,0 +1,369 @@
+#define _POSIX_C_SOURCE 200809L // sysconf()
+
+#include "line_index.h"
+#include "util.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// text is indexed in segments of growing size, each becoming available once
+// indexed, so that the first lines are available almost immediately
+#define FIRST_SEGMENT_SIZE (1024 * 1024)
+#define MAX_SEGMENT_SIZE (64 * 1024 * 1024)
+
+// a segment is split between threads in chunks of at least this size, so that
+// smaller segments are scanned without starting any
+#define MIN_SCAN_CHUNK (16 * 1024 * 1024)
+#define MAX_SCAN_THREADS 16
+
+// line starts are stored in blocks which never move once allocated, so that
+// indexed lines can be read while the rest of the text is being indexed
+#define INDEX_BLOCK_LINES 65536
+
+struct EditorLineIndex {
+    const char *text;
+    size_t size;
+    size_t **blocks;   // offset of each line, followed by end of last line
+    size_t num_blocks; // length of blocks, enough for every line of text
+    size_t found;      // line starts stored (indexing thread only)
+
+    // shared with the indexing thread, only accessed while holding mutex
+    pthread_mutex_t mutex;
+    pthread_cond_t progressed; // signalled as lines become available
+    int count;                 // lines available
+    size_t indexed;            // bytes of text indexed
+    bool complete;             // indexing has finished (or failed)
+    bool cancelled;            // indexing should stop
+    int error;                 // errno value if indexing failed
+    bool carriage_returns;
+
+    pthread_t thread;
+    bool joined; // thread has been joined (or was never started)
+};
+
+// part of a segment scanned by one thread
+typedef struct {
+    const char *text;
+    size_t size;  // size of whole text
+    size_t start; // chunk is [start, end) of text
+    size_t end;
+    size_t *starts; // starts of lines following newlines within chunk
+    size_t count;
+    size_t capacity;
+    bool carriage_returns;
+    bool failed; // ran out of memory
+} ScanChunk;
+
+static void *scan_chunk(void *arg) {
+    ScanChunk *chunk = arg;
+    const char *text = chunk->text;
+    size_t offset = chunk->start;
+
+    while (offset < chunk->end) {
+        // memchr() is vectorised by the C library
+        const char *newline =
+            memchr(text + offset, '\n', chunk->end - offset);
+        if (newline == NULL) { break; }
+
+        size_t line_end = newline - text;
+        if (line_end > 0 && text[line_end - 1] == '\r') {
+            chunk->carriage_returns = true;
+        }
+        offset = line_end + 1;
+
+        if (offset == chunk->size) { break; } // no line after final newline
+
+        if (chunk->count == chunk->capacity) {
+            size_t capacity = chunk->capacity * 2;
+            size_t *starts = realloc(chunk->starts, capacity * sizeof(size_t));
+            if (starts == NULL) {
+                chunk->failed = true;
+                break;
+            }
+            chunk->starts = starts;
+            chunk->capacity = capacity;
+        }
+        chunk->starts[chunk->count++] = offset;
+    }
+
+    return NULL;
+}
+
+// number of threads to scan a segment of size with
+static int scan_thread_count(size_t size) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = size / MIN_SCAN_CHUNK;
+
+    threads = MIN(threads, (size_t)MAX(cpus, 1));
+    threads = MIN(threads, MAX_SCAN_THREADS);
+    return MAX((int)threads, 1);
+}
+
+// stores the start of the next line, returns false if out of memory
+static bool store_line_start(EditorLineIndex *index, size_t start) {
+    size_t block = index->found / INDEX_BLOCK_LINES;
+
+    if (index->blocks[block] == NULL) {
+        index->blocks[block] = malloc(INDEX_BLOCK_LINES * sizeof(size_t));
+        if (index->blocks[block] == NULL) { return false; }
+    }
+
+    index->blocks[block][index->found % INDEX_BLOCK_LINES] = start;
+    index->found++;
+    return true;
+}
+
+// scans [start, end) of text in parallel, storing the line starts found
+// returns errno value on failure, else 0
+static int index_segment(EditorLineIndex *index, size_t start, size_t end,
+                         bool *carriage_returns) {
+    int num_chunks = scan_thread_count(end - start);
+    ScanChunk chunks[MAX_SCAN_THREADS];
+    pthread_t threads[MAX_SCAN_THREADS];
+    bool started[MAX_SCAN_THREADS];
+
+    size_t chunk_size = (end - start) / num_chunks;
+    for (int i = 0; i < num_chunks; i++) {
+        size_t chunk_start = start + chunk_size * i;
+        size_t chunk_end =
+            i == num_chunks - 1 ? end : chunk_start + chunk_size;
+        size_t capacity = MAX((chunk_end - chunk_start) / 64, 1024);
+
+        chunks[i] = (ScanChunk){.text = index->text,
+                                .size = index->size,
+                                .start = chunk_start,
+                                .end = chunk_end,
+                                .starts = malloc(capacity * sizeof(size_t)),
+                                .count = 0,
+                                .capacity = capacity,
+                                .carriage_returns = false,
+                                .failed = false};
+        chunks[i].failed = chunks[i].starts == NULL;
+    }
+
+    // first chunk is scanned by this thread, as is any chunk whose thread
+    // could not be started
+    for (int i = 1; i < num_chunks; i++) {
+        started[i] = !chunks[i].failed &&
+                     pthread_create(&threads[i], NULL, scan_chunk,
+                                    &chunks[i]) == 0;
+    }
+    if (!chunks[0].failed) { scan_chunk(&chunks[0]); }
+    for (int i = 1; i < num_chunks; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else if (!chunks[i].failed) {
+            scan_chunk(&chunks[i]);
+        }
+    }
+
+    // merge offsets of chunks in order
+    int error = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        if (chunks[i].failed) { error = ENOMEM; }
+        *carriage_returns |= chunks[i].carriage_returns;
+
+        for (size_t j = 0; j < chunks[i].count && error == 0; j++) {
+            if (!store_line_start(index, chunks[i].starts[j])) {
+                error = ENOMEM;
+            }
+        }
+        free(chunks[i].starts);
+    }
+
+    return error;
+}
+
+static void *index_text(void *arg) {
+    EditorLineIndex *index = arg;
+    const char *text = index->text;
+    size_t size = index->size;
+
+    bool carriage_returns = false;
+    int error = 0;
+
+    if (size > 0 && !store_line_start(index, 0)) { error = ENOMEM; }
+
+    size_t segment_size = FIRST_SEGMENT_SIZE;
+    size_t offset = 0;
+    while (offset < size && error == 0) {
+        size_t end = offset + MIN(segment_size, size - offset);
+        error = index_segment(index, offset, end, &carriage_returns);
+        segment_size = MIN(segment_size * 2, MAX_SEGMENT_SIZE);
+        offset = end;
+
+        // the last line found is only available once its end is known
+        if (error == 0 && index->found - 1 > INT_MAX) { error = EFBIG; }
+
+        pthread_mutex_lock(&index->mutex);
+        if (error == 0) {
+            index->count = index->found - 1;
+            index->indexed = offset;
+            pthread_cond_broadcast(&index->progressed);
+        }
+        bool cancelled = index->cancelled;
+        pthread_mutex_unlock(&index->mutex);
+
+        if (cancelled) { error = ECANCELED; }
+    }
+
+    // a final line without a newline may still end in a carriage return
+    bool final_newline = size > 0 && text[size - 1] == '\n';
+    if (!final_newline && size > 0 && text[size - 1] == '\r') {
+        carriage_returns = true;
+    }
+
+    // so that the end of each line is found from the start of the next
+    size_t count = index->found;
+    if (error == 0 && count > INT_MAX) { error = EFBIG; }
+    if (error == 0 &&
+        !store_line_start(index, size + (size > 0 && !final_newline))) {
+        error = ENOMEM;
+    }
+
+    pthread_mutex_lock(&index->mutex);
+    if (error == 0) {
+        index->count = count;
+        index->indexed = size;
+        index->carriage_returns = carriage_returns;
+    }
+    index->complete = true;
+    index->error = error;
+    pthread_cond_broadcast(&index->progressed);
+    pthread_mutex_unlock(&index->mutex);
+
+    return NULL;
+}
+
+EditorLineIndex *editor_line_index_create(const char *text, size_t size) {
+    EditorLineIndex *index = malloc(sizeof *index);
+
+    // every line start, and the end of the last line, fit in the blocks
+    index->num_blocks = (size + 2) / INDEX_BLOCK_LINES + 1;
+    index->blocks = calloc(index->num_blocks, sizeof(size_t *));
+
+    index->text = text;
+    index->size = size;
+    index->found = 0;
+
+    pthread_mutex_init(&index->mutex, NULL);
+    pthread_cond_init(&index->progressed, NULL);
+    index->count = 0;
+    index->indexed = 0;
+    index->complete = false;
+    index->cancelled = false;
+    index->error = 0;
+    index->carriage_returns = false;
+
+    index->joined =
+        pthread_create(&index->thread, NULL, index_text, index) != 0;
+    if (index->joined) { index_text(index); }
+
+    return index;
+}
+
+int editor_line_index_count(EditorLineIndex *index, bool *complete) {
+    pthread_mutex_lock(&index->mutex);
+    int count = index->count;
+    if (complete != NULL) { *complete = index->complete; }
+    pthread_mutex_unlock(&index->mutex);
+    return count;
+}
+
+size_t editor_line_index_indexed(EditorLineIndex *index) {
+    pthread_mutex_lock(&index->mutex);
+    size_t indexed = index->indexed;
+    pthread_mutex_unlock(&index->mutex);
+    return indexed;
+}
+
+int editor_line_index_wait_for(EditorLineIndex *index, int count) {
+    pthread_mutex_lock(&index->mutex);
+    while (index->count < count && !index->complete) {
+        pthread_cond_wait(&index->progressed, &index->mutex);
+    }
+    count = index->count;
+    pthread_mutex_unlock(&index->mutex);
+    return count;
+}
+
+int editor_line_index_wait(EditorLineIndex *index) {
+    if (!index->joined) {
+        pthread_join(index->thread, NULL);
+        index->joined = true;
+    }
+    return index->error;
+}
+
+// start of line, or end of text for the line after the last
+static size_t line_start(const EditorLineIndex *index, int line) {
+    return index->blocks[line / INDEX_BLOCK_LINES][line % INDEX_BLOCK_LINES];
+}
+
+const char *editor_line_index_line(const EditorLineIndex *index, int line,
+                                   size_t *len) {
+    const char *start = index->text + line_start(index, line);
+
+    // strip line-ending characters
+    *len = line_start(index, line + 1) - line_start(index, line) - 1;
+    while (*len > 0 && start[*len - 1] == '\r') {
+        (*len)--;
+    }
+
+    return start;
+}
+
+int editor_line_index_find(EditorLineIndex *index, const char *start) {
+    uintptr_t text = (uintptr_t)index->text;
+    if ((uintptr_t)start < text || (uintptr_t)start > text + index->size) {
+        return -1;
+    }
+
+    size_t offset = (uintptr_t)start - text;
+    int low = 0;
+    int high = editor_line_index_count(index, NULL) - 1;
+
+    // line starts are ascending
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        size_t mid_start = line_start(index, mid);
+
+        if (mid_start == offset) { return mid; }
+        if (mid_start < offset) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return -1;
+}
+
+const char *editor_line_index_lines(const EditorLineIndex *index, int line,
+                                    int count, size_t *len) {
+    *len = line_start(index, line + count) - line_start(index, line) - 1;
+    return index->text + line_start(index, line);
+}
+
+bool editor_line_index_has_carriage_returns(const EditorLineIndex *index) {
+    return index->carriage_returns;
+}
+
+void editor_line_index_destroy(EditorLineIndex *index) {
+    pthread_mutex_lock(&index->mutex);
+    index->cancelled = true;
+    pthread_mutex_unlock(&index->mutex);
+    editor_line_index_wait(index);
+
+    for (size_t i = 0; i < index->num_blocks; i++) {
+        free(index->blocks[i]);
+    }
+    free(index->blocks);
+    pthread_cond_destroy(&index->progressed);
+    pthread_mutex_destroy(&index->mutex);
+    free(index);
+}
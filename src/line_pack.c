@@ -0,0 +1,276 @@
+#define _GNU_SOURCE // mkostemp(), fallocate()
+
+#include "line_pack.h"
+#include "lz.h"
+#include "terminal.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct EditorLinePack {
+    int references;
+    int count;           // number of lines
+    size_t size;         // size of text
+    size_t packed_size;  // size of data
+    bool compressed;     // false if compressing did not help, data being text
+    unsigned char *data; // NULL once moved to the spill file
+    off_t offset;        // of the data in the spill file, once moved to it
+    // packs whose data is in memory, oldest first
+    EditorLinePack *older;
+    EditorLinePack *newer;
+};
+
+// pack last read, decompressed, with the start of each of its lines
+static const EditorLinePack *cached_pack = NULL;
+static char *cached_text = NULL;
+static size_t cached_capacity = 0;
+static size_t *cached_starts = NULL; // start of each line, then end + 1
+static int cached_starts_capacity = 0;
+
+// totals over every live pack
+static size_t packs_size = 0; // in memory
+static size_t packs_text_size = 0;
+
+static EditorLinePack *oldest_resident = NULL;
+static EditorLinePack *newest_resident = NULL;
+static size_t resident_size = 0; // data in memory
+
+// unlinked temporary file the data of the oldest packs is moved to, appended
+// to, with the data of freed packs punched out (and the file emptied once no
+// pack is left in it)
+static int spill_fd = -1;
+static bool spill_failed = false; // not moving data, once a write has failed
+static off_t spill_end = 0;
+static size_t spilled_size = 0;
+static unsigned char *spill_buf = NULL; // data of the cached pack, read back
+static size_t spill_capacity = 0;
+
+// counts lines as editor_insert_rows() does, a final newline ends the last
+static int editor_count_lines(const char *text, size_t len) {
+    int count = 0;
+    const char *end = text + len;
+    for (const char *p = text; p < end; count++) {
+        const char *newline = memchr(p, '\n', end - p);
+        p = newline != NULL ? newline + 1 : end;
+    }
+    return count;
+}
+
+static void editor_unlink_resident(EditorLinePack *pack) {
+    if (pack->older != NULL) {
+        pack->older->newer = pack->newer;
+    } else {
+        oldest_resident = pack->newer;
+    }
+    if (pack->newer != NULL) {
+        pack->newer->older = pack->older;
+    } else {
+        newest_resident = pack->older;
+    }
+    resident_size -= pack->packed_size;
+}
+
+// opens the spill file, returns false if it cannot be made
+static bool editor_open_spill_file(void) {
+    if (spill_fd != -1) { return true; }
+
+    const char *dir = getenv("TMPDIR");
+    char *path;
+    if (asprintf(&path, "%s/a1-packs-XXXXXX",
+                 dir != NULL && *dir != '\0' ? dir : "/tmp") == -1) {
+        return false;
+    }
+
+    spill_fd = mkostemp(path, O_CLOEXEC);
+    if (spill_fd != -1) { unlink(path); }
+    free(path);
+    return spill_fd != -1;
+}
+
+// moves the data of pack to the end of the spill file, returns false (leaving
+// the data in memory) if it cannot be written
+static bool editor_spill_pack(EditorLinePack *pack) {
+    if (spill_failed || !editor_open_spill_file()) {
+        spill_failed = true;
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < pack->packed_size) {
+        ssize_t n = pwrite(spill_fd, pack->data + written,
+                           pack->packed_size - written, spill_end + written);
+        if (n == -1) {
+            // e.g. the disk is full, packs are then kept in memory
+            spill_failed = true;
+            return false;
+        }
+        written += n;
+    }
+
+    editor_unlink_resident(pack);
+    free(pack->data);
+    pack->data = NULL;
+    pack->offset = spill_end;
+    spill_end += pack->packed_size;
+    spilled_size += pack->packed_size;
+    packs_size -= pack->packed_size;
+    return true;
+}
+
+EditorLinePack *editor_line_pack_create(const char *text, size_t len) {
+    if (len == 0) { return NULL; }
+
+    EditorLinePack *pack = malloc(sizeof(EditorLinePack));
+    unsigned char *data = malloc(editor_lz_bound(len));
+    if (pack == NULL || data == NULL) {
+        terminal_die("editor_line_pack_create");
+    }
+    pack->references = 1;
+    pack->count = editor_count_lines(text, len);
+    pack->size = len;
+    pack->packed_size = editor_lz_compress(text, len, data);
+    pack->compressed = pack->packed_size < len;
+
+    if (!pack->compressed) {
+        memcpy(data, text, len);
+        pack->packed_size = len;
+    }
+
+    // the bound is only needed while compressing
+    unsigned char *shrunk = realloc(data, pack->packed_size);
+    pack->data = shrunk != NULL ? shrunk : data;
+
+    pack->older = newest_resident;
+    pack->newer = NULL;
+    if (newest_resident != NULL) {
+        newest_resident->newer = pack;
+    } else {
+        oldest_resident = pack;
+    }
+    newest_resident = pack;
+    resident_size += pack->packed_size;
+
+    packs_size += sizeof(EditorLinePack) + pack->packed_size;
+    packs_text_size += len;
+
+    while (resident_size > LINE_PACKS_RESIDENT_SIZE) {
+        if (!editor_spill_pack(oldest_resident)) { break; }
+    }
+    return pack;
+}
+
+int editor_line_pack_count(const EditorLinePack *pack) {
+    return pack->count;
+}
+
+// makes pack the cached pack, decompressing it and finding its lines
+static void editor_line_pack_cache(const EditorLinePack *pack) {
+    if (cached_pack == pack) { return; }
+
+    if (pack->size > cached_capacity) {
+        cached_capacity = pack->size;
+        cached_text = realloc(cached_text, cached_capacity);
+    }
+    if (pack->count + 1 > cached_starts_capacity) {
+        cached_starts_capacity = pack->count + 1;
+        cached_starts =
+            realloc(cached_starts, cached_starts_capacity * sizeof(size_t));
+    }
+    if (cached_text == NULL || cached_starts == NULL) {
+        terminal_die("editor_line_pack_cache");
+    }
+
+    const unsigned char *data = pack->data;
+    if (data == NULL) {
+        if (pack->packed_size > spill_capacity) {
+            spill_capacity = pack->packed_size;
+            spill_buf = realloc(spill_buf, spill_capacity);
+            if (spill_buf == NULL) { terminal_die("editor_line_pack_cache"); }
+        }
+        size_t read_size = 0;
+        while (read_size < pack->packed_size) {
+            ssize_t n = pread(spill_fd, spill_buf + read_size,
+                              pack->packed_size - read_size,
+                              pack->offset + read_size);
+            if (n <= 0) { terminal_die("pread"); }
+            read_size += n;
+        }
+        data = spill_buf;
+    }
+
+    if (!pack->compressed) {
+        memcpy(cached_text, data, pack->size);
+    } else if (!editor_lz_decompress(data, pack->packed_size, cached_text,
+                                     pack->size)) {
+        terminal_die("editor_lz_decompress");
+    }
+
+    int line = 0;
+    size_t start = 0;
+    while (start < pack->size) {
+        cached_starts[line++] = start;
+        const char *newline =
+            memchr(cached_text + start, '\n', pack->size - start);
+        start = newline != NULL ? (size_t)(newline - cached_text) + 1
+                                : pack->size + 1;
+    }
+    cached_starts[line] = start;
+
+    cached_pack = pack;
+}
+
+const char *editor_line_pack_line(EditorLinePack *pack, int line,
+                                  size_t *len) {
+    editor_line_pack_cache(pack);
+
+    const char *start = cached_text + cached_starts[line];
+
+    // strip line-ending characters
+    *len = cached_starts[line + 1] - cached_starts[line] - 1;
+    while (*len > 0 && start[*len - 1] == '\r') {
+        (*len)--;
+    }
+
+    return start;
+}
+
+void editor_line_pack_retain(EditorLinePack *pack) {
+    pack->references++;
+}
+
+void editor_line_pack_release(EditorLinePack *pack) {
+    if (--pack->references > 0) { return; }
+
+    // a new pack could be given the same address
+    if (cached_pack == pack) { cached_pack = NULL; }
+
+    if (pack->data != NULL) {
+        editor_unlink_resident(pack);
+        packs_size -= pack->packed_size;
+        free(pack->data);
+    } else {
+        spilled_size -= pack->packed_size;
+        if (spilled_size == 0) {
+            ftruncate(spill_fd, 0);
+            spill_end = 0;
+        } else {
+            // frees the disk space, if the file system can
+            fallocate(spill_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      pack->offset, pack->packed_size);
+        }
+    }
+
+    packs_size -= sizeof(EditorLinePack);
+    packs_text_size -= pack->size;
+    free(pack);
+}
+
+size_t editor_line_pack_memory(size_t *text_size, size_t *spilled) {
+    if (text_size != NULL) { *text_size = packs_text_size; }
+    if (spilled != NULL) { *spilled = spilled_size; }
+    return packs_size + cached_capacity +
+           cached_starts_capacity * sizeof(size_t) + spill_capacity;
+}
@@ -0,0 +1,674 @@
+#include "line_tree.h"
+#include "a1.h"
+#include "util.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// maximum number of children (internal nodes) or rows (leaves) in a node
+#define LINE_NODE_CAPACITY 64
+
+struct EditorLineNode {
+    EditorLineTree *tree;
+    EditorLineNode *parent;
+    EditorLineNode *prev; // neighbouring leaves (only used by leaves)
+    EditorLineNode *next;
+    bool leaf;
+    bool unloaded;           // leaf holds no rows, standing for source lines
+    int source_line;         // first line of source text (unloaded leaves only)
+    EditorLinePack *pack;    // source of an unloaded leaf's lines if packed
+    int count;               // number of children or rows
+    int line_count;          // total number of rows beneath node
+    unsigned long last_used; // tree's clock when leaf was last accessed
+    union {
+        EditorLineNode *children[LINE_NODE_CAPACITY];
+        EditorRow *rows[LINE_NODE_CAPACITY];
+    } slots;
+};
+
+struct EditorLineTree {
+    EditorLineNode *root;
+    EditorLineLoader load_row;
+    unsigned long clock; // advanced by editor_line_tree_tick()
+};
+
+static EditorLineNode *editor_line_node_create(EditorLineTree *tree,
+                                               bool leaf) {
+    EditorLineNode *node = malloc(sizeof *node);
+    node->tree = tree;
+    node->parent = NULL;
+    node->prev = NULL;
+    node->next = NULL;
+    node->leaf = leaf;
+    node->unloaded = false;
+    node->source_line = 0;
+    node->pack = NULL;
+    node->count = 0;
+    node->line_count = 0;
+    node->last_used = tree->clock;
+    return node;
+}
+
+static int editor_line_node_child_position(const EditorLineNode *parent,
+                                           const EditorLineNode *child) {
+    for (int i = 0; i < parent->count; i++) {
+        if (parent->slots.children[i] == child) { return i; }
+    }
+    return -1;
+}
+
+static int editor_line_node_row_position(const EditorLineNode *leaf,
+                                         const EditorRow *row) {
+    for (int i = 0; i < leaf->count; i++) {
+        if (leaf->slots.rows[i] == row) { return i; }
+    }
+    return -1;
+}
+
+// adds delta to line count of node and all of its ancestors
+static void editor_line_node_add_lines(EditorLineNode *node, int delta) {
+    while (node != NULL) {
+        node->line_count += delta;
+        node = node->parent;
+    }
+}
+
+// finds leaf containing index, setting index to the position within it
+static EditorLineNode *editor_line_tree_find_leaf(const EditorLineTree *tree,
+                                                  int *index) {
+    EditorLineNode *node = tree->root;
+
+    while (!node->leaf) {
+        int i = 0;
+        // last child also accepts index one past its end (for appending)
+        while (i < node->count - 1 &&
+               *index >= node->slots.children[i]->line_count) {
+            *index -= node->slots.children[i]->line_count;
+            i++;
+        }
+        node = node->slots.children[i];
+    }
+
+    return node;
+}
+
+// moves slots from keep onwards into a new node, which is not yet in the tree
+static EditorLineNode *editor_line_node_detach_tail(EditorLineNode *node,
+                                                    int keep) {
+    EditorLineNode *sibling = editor_line_node_create(node->tree, node->leaf);
+    int move = node->count - keep;
+    int moved_lines = 0;
+
+    if (node->leaf) {
+        memcpy(sibling->slots.rows, &node->slots.rows[keep],
+               move * sizeof(EditorRow *));
+        for (int i = 0; i < move; i++) {
+            sibling->slots.rows[i]->leaf = sibling;
+        }
+        moved_lines = move;
+    } else {
+        memcpy(sibling->slots.children, &node->slots.children[keep],
+               move * sizeof(EditorLineNode *));
+        for (int i = 0; i < move; i++) {
+            sibling->slots.children[i]->parent = sibling;
+            moved_lines += sibling->slots.children[i]->line_count;
+        }
+    }
+
+    node->count = keep;
+    editor_line_node_add_lines(node, -moved_lines);
+    sibling->count = move;
+    sibling->line_count = moved_lines;
+
+    return sibling;
+}
+
+static void editor_line_node_split(EditorLineTree *tree, EditorLineNode *node);
+
+// places sibling directly after node, splitting node's parent if full
+static void editor_line_node_insert_after(EditorLineTree *tree,
+                                          EditorLineNode *node,
+                                          EditorLineNode *sibling) {
+    EditorLineNode *parent = node->parent;
+
+    if (parent == NULL) {
+        parent = editor_line_node_create(tree, false);
+        parent->slots.children[0] = node;
+        parent->count = 1;
+        parent->line_count = node->line_count;
+        node->parent = parent;
+        tree->root = parent;
+    } else if (parent->count == LINE_NODE_CAPACITY) {
+        editor_line_node_split(tree, parent);
+        parent = node->parent;
+    }
+
+    int position = editor_line_node_child_position(parent, node) + 1;
+    memmove(&parent->slots.children[position + 1],
+            &parent->slots.children[position],
+            (parent->count - position) * sizeof(EditorLineNode *));
+    parent->slots.children[position] = sibling;
+    parent->count++;
+    sibling->parent = parent;
+
+    if (node->leaf) {
+        sibling->prev = node;
+        sibling->next = node->next;
+        if (node->next != NULL) { node->next->prev = sibling; }
+        node->next = sibling;
+    }
+
+    editor_line_node_add_lines(parent, sibling->line_count);
+}
+
+// moves the upper half of a full node into a new sibling placed after it
+static void editor_line_node_split(EditorLineTree *tree,
+                                   EditorLineNode *node) {
+    EditorLineNode *sibling =
+        editor_line_node_detach_tail(node, node->count / 2);
+    editor_line_node_insert_after(tree, node, sibling);
+}
+
+// removes an empty node from its parent, or merges a sparse node into a
+// neighbouring sibling, keeping the tree from filling with near-empty nodes
+static void editor_line_node_rebalance(EditorLineTree *tree,
+                                       EditorLineNode *node) {
+    EditorLineNode *parent = node->parent;
+
+    if (parent == NULL) {
+        // collapse root with a single child
+        if (!node->leaf && node->count == 1) {
+            tree->root = node->slots.children[0];
+            tree->root->parent = NULL;
+            free(node);
+        } else if (!node->leaf && node->count == 0) {
+            tree->root = editor_line_node_create(tree, true);
+            free(node);
+        }
+        return;
+    }
+
+    if (node->count >= LINE_NODE_CAPACITY / 4) { return; }
+
+    int position = editor_line_node_child_position(parent, node);
+    EditorLineNode *target = NULL; // node to move remaining slots into
+    bool append = false;           // whether to add slots after target's
+
+    // rows cannot be moved into an unloaded leaf
+    if (position > 0) {
+        EditorLineNode *left = parent->slots.children[position - 1];
+        if (!left->unloaded &&
+            left->count + node->count <= LINE_NODE_CAPACITY) {
+            target = left;
+            append = true;
+        }
+    }
+    if (target == NULL && position + 1 < parent->count) {
+        EditorLineNode *right = parent->slots.children[position + 1];
+        if (!right->unloaded &&
+            right->count + node->count <= LINE_NODE_CAPACITY) {
+            target = right;
+        }
+    }
+
+    if (target == NULL && node->count > 0) { return; }
+
+    if (target != NULL && node->count > 0) {
+        size_t slot_size =
+            node->leaf ? sizeof(EditorRow *) : sizeof(EditorLineNode *);
+        char *target_slots = (char *)&target->slots;
+        char *node_slots = (char *)&node->slots;
+
+        if (append) {
+            memcpy(target_slots + target->count * slot_size, node_slots,
+                   node->count * slot_size);
+        } else {
+            memmove(target_slots + node->count * slot_size, target_slots,
+                    target->count * slot_size);
+            memcpy(target_slots, node_slots, node->count * slot_size);
+        }
+
+        for (int i = 0; i < node->count; i++) {
+            if (node->leaf) {
+                node->slots.rows[i]->leaf = target;
+            } else {
+                node->slots.children[i]->parent = target;
+            }
+        }
+
+        target->count += node->count;
+        target->line_count += node->line_count;
+    }
+
+    if (node->leaf) {
+        if (node->prev != NULL) { node->prev->next = node->next; }
+        if (node->next != NULL) { node->next->prev = node->prev; }
+    }
+
+    memmove(&parent->slots.children[position],
+            &parent->slots.children[position + 1],
+            (parent->count - position - 1) * sizeof(EditorLineNode *));
+    parent->count--;
+    free(node);
+
+    editor_line_node_rebalance(tree, parent);
+}
+
+// loads the leaf's worth of rows around position of an unloaded leaf, leaving
+// any lines before and after them unloaded in leaves of their own
+// returns the loaded leaf, setting position to the position within it
+static EditorLineNode *editor_line_node_load(EditorLineTree *tree,
+                                             EditorLineNode *node,
+                                             int *position) {
+    int lines = node->line_count;
+
+    // lines are loaded in aligned groups, a position one past the end (for
+    // appending) loads the group containing the last line
+    int last = MIN(*position, lines - 1);
+    int first = last - last % LINE_NODE_CAPACITY;
+    int count = MIN(LINE_NODE_CAPACITY, lines - first);
+    int source_line = node->source_line + first;
+    EditorLinePack *pack = node->pack;
+
+    if (first + count < lines) {
+        EditorLineNode *tail = editor_line_node_create(tree, true);
+        tail->unloaded = true;
+        tail->source_line = source_line + count;
+        tail->pack = pack;
+        if (pack != NULL) { editor_line_pack_retain(pack); }
+        tail->line_count = lines - first - count;
+        editor_line_node_add_lines(node, -tail->line_count);
+        editor_line_node_insert_after(tree, node, tail);
+    }
+
+    EditorLineNode *loaded = node;
+    if (first > 0) {
+        loaded = editor_line_node_create(tree, true);
+        loaded->line_count = count;
+        editor_line_node_add_lines(node, -count);
+        editor_line_node_insert_after(tree, node, loaded);
+    }
+
+    loaded->unloaded = false;
+    for (int i = 0; i < count; i++) {
+        EditorRow *row = tree->load_row(pack, source_line + i);
+        row->leaf = loaded;
+        loaded->slots.rows[i] = row;
+    }
+    loaded->count = count;
+
+    // rows hold their own copies of packed lines
+    if (loaded->pack != NULL) {
+        editor_line_pack_release(loaded->pack);
+        loaded->pack = NULL;
+    }
+
+    *position -= first;
+    return loaded;
+}
+
+// as editor_line_tree_find_leaf(), loading the leaf's rows if it is unloaded
+static EditorLineNode *editor_line_tree_find_loaded_leaf(EditorLineTree *tree,
+                                                         int *index) {
+    EditorLineNode *leaf = editor_line_tree_find_leaf(tree, index);
+    if (leaf->unloaded) { leaf = editor_line_node_load(tree, leaf, index); }
+    leaf->last_used = tree->clock;
+    return leaf;
+}
+
+EditorLineTree *editor_line_tree_create(EditorLineLoader load_row) {
+    EditorLineTree *tree = malloc(sizeof *tree);
+    tree->load_row = load_row;
+    tree->clock = 0;
+    tree->root = editor_line_node_create(tree, true);
+    return tree;
+}
+
+int editor_line_tree_count(const EditorLineTree *tree) {
+    return tree->root->line_count;
+}
+
+EditorRow *editor_line_tree_get(EditorLineTree *tree, int index) {
+    if (index < 0 || index >= tree->root->line_count) { return NULL; }
+
+    EditorLineNode *leaf = editor_line_tree_find_loaded_leaf(tree, &index);
+    return leaf->slots.rows[index];
+}
+
+void editor_line_tree_insert(EditorLineTree *tree, int index, EditorRow *row) {
+    if (index < 0 || index > tree->root->line_count) { return; }
+
+    int position = index;
+    EditorLineNode *leaf = editor_line_tree_find_loaded_leaf(tree, &position);
+
+    if (leaf->count == LINE_NODE_CAPACITY) {
+        editor_line_node_split(tree, leaf);
+        // position may now lie within the new sibling
+        if (position > leaf->count) {
+            position -= leaf->count;
+            leaf = leaf->next;
+        }
+    }
+
+    memmove(&leaf->slots.rows[position + 1], &leaf->slots.rows[position],
+            (leaf->count - position) * sizeof(EditorRow *));
+    leaf->slots.rows[position] = row;
+    leaf->count++;
+    row->leaf = leaf;
+
+    editor_line_node_add_lines(leaf, 1);
+}
+
+void editor_line_tree_insert_many(EditorLineTree *tree, int index,
+                                  EditorRow **rows, int count) {
+    if (index < 0 || index > tree->root->line_count || count <= 0) { return; }
+
+    int position = index;
+    EditorLineNode *leaf = editor_line_tree_find_loaded_leaf(tree, &position);
+    EditorLineNode *tail = NULL;
+
+    if (position < leaf->count) {
+        if (leaf->count + count <= LINE_NODE_CAPACITY) {
+            memmove(&leaf->slots.rows[position + count],
+                    &leaf->slots.rows[position],
+                    (leaf->count - position) * sizeof(EditorRow *));
+            memcpy(&leaf->slots.rows[position], rows,
+                   count * sizeof(EditorRow *));
+            for (int i = 0; i < count; i++) {
+                rows[i]->leaf = leaf;
+            }
+            leaf->count += count;
+            editor_line_node_add_lines(leaf, count);
+            return;
+        }
+
+        // rows after the insertion point are moved aside once, rather than
+        // being shifted along for every inserted row
+        tail = editor_line_node_detach_tail(leaf, position);
+    }
+
+    // fill leaf, then as many new leaves as needed
+    int inserted = 0;
+    while (inserted < count) {
+        if (leaf->count == LINE_NODE_CAPACITY) {
+            EditorLineNode *sibling = editor_line_node_create(tree, true);
+            editor_line_node_insert_after(tree, leaf, sibling);
+            leaf = sibling;
+        }
+
+        int take = MIN(LINE_NODE_CAPACITY - leaf->count, count - inserted);
+        memcpy(&leaf->slots.rows[leaf->count], &rows[inserted],
+               take * sizeof(EditorRow *));
+        for (int i = 0; i < take; i++) {
+            rows[inserted + i]->leaf = leaf;
+        }
+        leaf->count += take;
+        editor_line_node_add_lines(leaf, take);
+        inserted += take;
+    }
+
+    if (tail != NULL) { editor_line_node_insert_after(tree, leaf, tail); }
+}
+
+void editor_line_tree_append_unloaded(EditorLineTree *tree,
+                                      EditorLinePack *pack, int source_line,
+                                      int count) {
+    if (count <= 0) { return; }
+
+    int position = tree->root->line_count;
+    EditorLineNode *last = editor_line_tree_find_leaf(tree, &position);
+
+    // lines continuing those of the last leaf simply extend it
+    if (last->unloaded && last->pack == pack &&
+        last->source_line + last->line_count == source_line) {
+        editor_line_node_add_lines(last, count);
+        return;
+    }
+
+    if (pack != NULL) { editor_line_pack_retain(pack); }
+
+    // the leaf of an empty tree is reused
+    if (!last->unloaded && last->count == 0) {
+        last->unloaded = true;
+        last->source_line = source_line;
+        last->pack = pack;
+        editor_line_node_add_lines(last, count);
+        return;
+    }
+
+    EditorLineNode *node = editor_line_node_create(tree, true);
+    node->unloaded = true;
+    node->source_line = source_line;
+    node->pack = pack;
+    node->line_count = count;
+    editor_line_node_insert_after(tree, last, node);
+}
+
+EditorRow *editor_line_tree_remove(EditorLineTree *tree, int index) {
+    if (index < 0 || index >= tree->root->line_count) { return NULL; }
+
+    EditorLineNode *leaf = editor_line_tree_find_loaded_leaf(tree, &index);
+    EditorRow *row = leaf->slots.rows[index];
+
+    memmove(&leaf->slots.rows[index], &leaf->slots.rows[index + 1],
+            (leaf->count - index - 1) * sizeof(EditorRow *));
+    leaf->count--;
+    row->leaf = NULL;
+
+    editor_line_node_add_lines(leaf, -1);
+    editor_line_node_rebalance(tree, leaf);
+
+    return row;
+}
+
+int editor_line_tree_index_of(const EditorRow *row) {
+    const EditorLineNode *node = row->leaf;
+    int index = editor_line_node_row_position(node, row);
+
+    while (node->parent != NULL) {
+        const EditorLineNode *parent = node->parent;
+        for (int i = 0; parent->slots.children[i] != node; i++) {
+            index += parent->slots.children[i]->line_count;
+        }
+        node = parent;
+    }
+
+    return index;
+}
+
+EditorRow *editor_line_tree_next(const EditorRow *row) {
+    const EditorLineNode *leaf = row->leaf;
+    int position = editor_line_node_row_position(leaf, row);
+
+    if (position + 1 < leaf->count) { return leaf->slots.rows[position + 1]; }
+    if (leaf->next == NULL) { return NULL; }
+
+    EditorLineNode *next = leaf->next;
+    int next_position = 0;
+    if (next->unloaded) {
+        next = editor_line_node_load(leaf->tree, next, &next_position);
+    }
+    next->last_used = leaf->tree->clock;
+    return next->slots.rows[next_position];
+}
+
+EditorRow *editor_line_tree_prev(const EditorRow *row) {
+    const EditorLineNode *leaf = row->leaf;
+    int position = editor_line_node_row_position(leaf, row);
+
+    if (position > 0) { return leaf->slots.rows[position - 1]; }
+    if (leaf->prev == NULL) { return NULL; }
+
+    EditorLineNode *prev = leaf->prev;
+    int prev_position = prev->line_count - 1;
+    if (prev->unloaded) {
+        prev = editor_line_node_load(leaf->tree, prev, &prev_position);
+    }
+    prev->last_used = leaf->tree->clock;
+    return prev->slots.rows[prev_position];
+}
+
+// sets run to the row at position of a loaded leaf, or the lines of an
+// unloaded one, returns false past the last leaf or for an empty tree
+static bool editor_line_run_set(EditorLineRun *run, EditorLineNode *leaf,
+                                int position) {
+    if (leaf == NULL || (!leaf->unloaded && leaf->count == 0)) {
+        return false;
+    }
+
+    run->leaf = leaf;
+    run->position = position;
+    if (leaf->unloaded) {
+        run->row = NULL;
+        run->source_line = leaf->source_line;
+        run->pack = leaf->pack;
+        run->count = leaf->line_count;
+    } else {
+        run->row = leaf->slots.rows[position];
+        run->source_line = -1;
+        run->pack = NULL;
+        run->count = 1;
+    }
+    return true;
+}
+
+bool editor_line_tree_first_run(const EditorLineTree *tree,
+                                EditorLineRun *run) {
+    EditorLineNode *node = tree->root;
+    while (!node->leaf) {
+        node = node->slots.children[0];
+    }
+    return editor_line_run_set(run, node, 0);
+}
+
+bool editor_line_tree_next_run(EditorLineRun *run) {
+    EditorLineNode *leaf = run->leaf;
+    if (!leaf->unloaded && run->position + 1 < leaf->count) {
+        return editor_line_run_set(run, leaf, run->position + 1);
+    }
+    return editor_line_run_set(run, leaf->next, 0);
+}
+
+void editor_line_tree_rebase_run(EditorLineRun *run, int source_line) {
+    if (run->pack != NULL) {
+        editor_line_pack_release(run->pack);
+        run->leaf->pack = NULL;
+        run->pack = NULL;
+    }
+    run->leaf->source_line = source_line;
+    run->source_line = source_line;
+}
+
+void editor_line_tree_tick(EditorLineTree *tree) {
+    tree->clock++;
+}
+
+bool editor_line_node_used_since_tick(const EditorLineNode *leaf) {
+    return leaf->last_used == leaf->tree->clock;
+}
+
+static int editor_line_node_compare_use(const void *a, const void *b) {
+    unsigned long a_used = (*(EditorLineNode *const *)a)->last_used;
+    unsigned long b_used = (*(EditorLineNode *const *)b)->last_used;
+    return (a_used > b_used) - (a_used < b_used);
+}
+
+EditorLineNode **editor_line_tree_loaded_leaves(const EditorLineTree *tree,
+                                                int *count) {
+    EditorLineNode *leaf = tree->root;
+    while (!leaf->leaf) {
+        leaf = leaf->slots.children[0];
+    }
+
+    int capacity = 64;
+    EditorLineNode **leaves = malloc(capacity * sizeof(EditorLineNode *));
+    *count = 0;
+
+    for (; leaf != NULL; leaf = leaf->next) {
+        if (leaf->unloaded || leaf->count == 0) { continue; }
+
+        if (*count == capacity) {
+            capacity *= 2;
+            leaves = realloc(leaves, capacity * sizeof(EditorLineNode *));
+        }
+        leaves[(*count)++] = leaf;
+    }
+
+    qsort(leaves, *count, sizeof(EditorLineNode *),
+          editor_line_node_compare_use);
+    return leaves;
+}
+
+EditorRow **editor_line_node_rows(EditorLineNode *leaf, int *count) {
+    *count = leaf->unloaded ? 0 : leaf->count;
+    return leaf->slots.rows;
+}
+
+// merges right into left, both being unloaded leaves of the same parent with
+// right's lines following on from left's
+static void editor_line_node_merge_unloaded(EditorLineNode *left,
+                                            EditorLineNode *right) {
+    EditorLineNode *parent = left->parent;
+    int position = editor_line_node_child_position(parent, right);
+
+    // lines stay beneath the same parent, so no ancestor's count changes
+    left->line_count += right->line_count;
+    left->next = right->next;
+    if (right->next != NULL) { right->next->prev = left; }
+
+    memmove(&parent->slots.children[position],
+            &parent->slots.children[position + 1],
+            (parent->count - position - 1) * sizeof(EditorLineNode *));
+    parent->count--;
+    free(right);
+}
+
+// whether leaf is unloaded and its lines run on into those of next
+static bool editor_line_node_continues(const EditorLineNode *leaf,
+                                       const EditorLineNode *next) {
+    return leaf != NULL && next != NULL && leaf->unloaded && next->unloaded &&
+           leaf->pack == NULL && next->pack == NULL && leaf->parent != NULL &&
+           leaf->parent == next->parent &&
+           leaf->source_line + leaf->line_count == next->source_line;
+}
+
+void editor_line_tree_unload(EditorLineNode *leaf, EditorLinePack *pack,
+                             int source_line) {
+    EditorLineTree *tree = leaf->tree;
+
+    leaf->unloaded = true;
+    leaf->source_line = source_line;
+    leaf->pack = pack;
+    leaf->count = 0;
+    if (pack != NULL) { editor_line_pack_retain(pack); }
+
+    // neighbouring unloaded lines are rejoined, so that paging through a file
+    // and back out of memory does not leave a leaf behind for every page
+    if (editor_line_node_continues(leaf->prev, leaf)) {
+        EditorLineNode *prev = leaf->prev;
+        editor_line_node_merge_unloaded(prev, leaf);
+        leaf = prev;
+    }
+    if (editor_line_node_continues(leaf, leaf->next)) {
+        editor_line_node_merge_unloaded(leaf, leaf->next);
+    }
+
+    if (leaf->parent != NULL) {
+        editor_line_node_rebalance(tree, leaf->parent);
+    }
+}
+
+static void editor_line_node_destroy(EditorLineNode *node) {
+    if (!node->leaf) {
+        for (int i = 0; i < node->count; i++) {
+            editor_line_node_destroy(node->slots.children[i]);
+        }
+    }
+    if (node->pack != NULL) { editor_line_pack_release(node->pack); }
+    free(node);
+}
+
+void editor_line_tree_destroy(EditorLineTree *tree) {
+    editor_line_node_destroy(tree->root);
+    free(tree);
+}
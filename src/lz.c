@@ -0,0 +1,170 @@
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+// a run of misses makes the search skip ahead faster, so that incompressible
+// text is passed over quickly
+#define LZ_SKIP_SHIFT 6
+
+size_t editor_lz_bound(size_t len) {
+    // literals only, with a length byte for every 255 and a token
+    return len + len / 255 + 16;
+}
+
+static uint32_t lz_read32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// writes the part of a length not held by the token
+static unsigned char *lz_write_length(unsigned char *out, size_t len) {
+    while (len >= 255) {
+        *out++ = 255;
+        len -= 255;
+    }
+    *out++ = (unsigned char)len;
+    return out;
+}
+
+// match_len is 0 for the last sequence, which has no match
+static unsigned char *lz_write_sequence(unsigned char *out,
+                                        const unsigned char *literals,
+                                        size_t literal_len, size_t match_len,
+                                        size_t offset) {
+    unsigned char *token = out++;
+    *token = (unsigned char)((literal_len < 15 ? literal_len : 15) << 4);
+    if (literal_len >= 15) { out = lz_write_length(out, literal_len - 15); }
+
+    memcpy(out, literals, literal_len);
+    out += literal_len;
+
+    if (match_len == 0) { return out; }
+
+    *out++ = (unsigned char)(offset & 0xff);
+    *out++ = (unsigned char)(offset >> 8);
+
+    size_t stored_len = match_len - LZ_MIN_MATCH;
+    *token |= (unsigned char)(stored_len < 15 ? stored_len : 15);
+    if (stored_len >= 15) { out = lz_write_length(out, stored_len - 15); }
+
+    return out;
+}
+
+size_t editor_lz_compress(const char *src, size_t len, unsigned char *dst) {
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char *out = dst;
+
+    // position + 1 of the last sequence with each hash, 0 if none yet
+    size_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    size_t anchor = 0; // start of literals not yet written
+    size_t pos = 0;
+    size_t misses = 0;
+
+    while (len >= LZ_MIN_MATCH && pos <= len - LZ_MIN_MATCH) {
+        uint32_t sequence = lz_read32(in + pos);
+        uint32_t hash = lz_hash(sequence);
+        size_t candidate = table[hash];
+        table[hash] = pos + 1;
+
+        if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET ||
+            lz_read32(in + candidate - 1) != sequence) {
+            pos += 1 + (misses++ >> LZ_SKIP_SHIFT);
+            continue;
+        }
+
+        size_t match = candidate - 1;
+        size_t match_len = LZ_MIN_MATCH;
+        while (pos + match_len < len &&
+               in[match + match_len] == in[pos + match_len]) {
+            match_len++;
+        }
+
+        out = lz_write_sequence(out, in + anchor, pos - anchor, match_len,
+                                pos - match);
+        pos += match_len;
+        anchor = pos;
+        misses = 0;
+
+        // the end of a match often starts the next, as in repeated lines
+        if (pos >= 2 && pos + 2 <= len) {
+            table[lz_hash(lz_read32(in + pos - 2))] = pos - 1;
+        }
+    }
+
+    out = lz_write_sequence(out, in + anchor, len - anchor, 0, 0);
+    return out - dst;
+}
+
+// adds length bytes to len, returns false if they run past the end of block
+static bool lz_read_length(const unsigned char **in, const unsigned char *end,
+                           size_t *len) {
+    unsigned char byte;
+    do {
+        if (*in == end) { return false; }
+        byte = *(*in)++;
+        *len += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool editor_lz_decompress(const unsigned char *src, size_t src_len, char *dst,
+                          size_t len) {
+    const unsigned char *in = src;
+    const unsigned char *end = src + src_len;
+    size_t out = 0;
+
+    while (in < end) {
+        unsigned char token = *in++;
+
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !lz_read_length(&in, end, &literal_len)) {
+            return false;
+        }
+        if (literal_len > (size_t)(end - in) || literal_len > len - out) {
+            return false;
+        }
+        memcpy(dst + out, in, literal_len);
+        in += literal_len;
+        out += literal_len;
+
+        if (in == end) { break; } // last sequence
+
+        if (end - in < 2) { return false; }
+        size_t offset = in[0] | (size_t)in[1] << 8;
+        in += 2;
+
+        size_t match_len = token & 0x0f;
+        if (match_len == 15 && !lz_read_length(&in, end, &match_len)) {
+            return false;
+        }
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || match_len > len - out) {
+            return false;
+        }
+
+        char *dest = dst + out;
+        const char *match = dest - offset;
+        if (offset >= match_len) {
+            memcpy(dest, match, match_len);
+        } else {
+            // overlapping match repeats the bytes it has just written
+            for (size_t i = 0; i < match_len; i++) {
+                dest[i] = match[i];
+            }
+        }
+        out += match_len;
+    }
+
+    return out == len;
+}
@@ -9,6 +9,7 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 EditorState editor_state;
@@ -22,7 +23,7 @@ static void editor_init(void) {
     editor_state.col_scroll_offset = 0;
     editor_state.num_col_width = 0;
     editor_state.num_rows = 0;
-    editor_state.rows = NULL;
+    editor_state.rows = editor_line_tree_create(editor_load_row);
 
     editor_state.find_state.string = NULL;
     editor_state.find_state.matches = NULL;
@@ -42,11 +43,16 @@ static void editor_init(void) {
     editor_state.options.line_numbers = true;
     editor_state.options.tab_character = false;
     editor_state.options.tab_stop = 4;
+    editor_state.options.memory_limit = 0;
+    editor_state.options.undo_limit = 16 * 1024 * 1024;
 
     // default arguments
     editor_state.arguments.clean = false;
     editor_state.arguments.config_file_path = NULL;
     editor_state.arguments.manual = false;
+    editor_state.arguments.large = false;
+    editor_state.arguments.follow = false;
+    editor_state.arguments.hex = false;
     editor_state.arguments.file_path = NULL;
 
     // default permissions
@@ -54,19 +60,17 @@ static void editor_init(void) {
     editor_state.file_permissions.can_write = true;
 
     // action history
-    editor_state.action_history = NULL;
+    editor_state.action_history =
+        editor_action_history_create(editor_state.options.undo_limit);
+
+    editor_state.piece_table = editor_piece_table_create();
+    editor_state.line_index = NULL;
+    editor_state.arena = editor_arena_create();
+    editor_state.hex_view = NULL;
 }
 
 static void editor_free(void) {
-    if (editor_state.rows) {
-        for (int i = 0; i < editor_state.num_rows; i++) {
-            EditorRow *row = &editor_state.rows[i];
-            if (row->chars) { free(row->chars); }
-            if (row->render) { free(row->render); }
-            if (row->highlight) { free(row->highlight); }
-        }
-        free(editor_state.rows);
-    }
+    if (editor_state.rows) { editor_free_rows(); }
 
     if (editor_state.file_path) { free(editor_state.file_path); }
     if (editor_state.file_name) { free(editor_state.file_name); }
@@ -74,6 +78,19 @@ static void editor_free(void) {
     if (editor_state.action_history) {
         editor_action_history_destroy(editor_state.action_history);
     }
+
+    if (editor_state.line_index) {
+        editor_line_index_destroy(editor_state.line_index);
+    }
+
+    if (editor_state.hex_view) { editor_hex_view_close(editor_state.hex_view); }
+
+    if (editor_state.piece_table) {
+        editor_piece_table_destroy(editor_state.piece_table);
+    }
+
+    // after rows, as it does not track allocations passed through to malloc
+    if (editor_state.arena) { editor_arena_destroy(editor_state.arena); }
 }
 
 static void handle_window_change(int sig) {
@@ -140,9 +157,21 @@ int main(int argc, char *argv[]) {
     // if manual specified, print it and exit
     if (editor_state.arguments.manual) { print_manual(); }
 
-    // if file specified for editing
-    if (editor_state.arguments.file_path != NULL) {
-        manage_file(editor_state.arguments.file_path);
+    // text piped to stdin (or given '-') is read as a stream rather than a file
+    char *file_path = editor_state.arguments.file_path;
+    bool read_stdin = file_path != NULL ? strcmp(file_path, "-") == 0
+                                        : !isatty(STDIN_FILENO);
+    int stream_fd = -1;
+
+    if (read_stdin) {
+        if (isatty(STDIN_FILENO)) {
+            printf("Nothing piped to stdin\n");
+            exit(EXIT_FAILURE);
+        }
+        stream_fd = terminal_detach_stdin();
+    } else if (file_path != NULL) {
+        // if file specified for editing
+        manage_file(file_path);
     }
 
     // apply configuration
@@ -157,8 +186,15 @@ int main(int argc, char *argv[]) {
 
     mode_transition(&normal_mode, NULL); // start editor in normal mode
 
-    if (editor_state.arguments.file_path != NULL) {
-        editor_open_text_file(editor_state.arguments.file_path);
+    if (stream_fd != -1) {
+        editor_open_stream(stream_fd);
+    } else if (file_path != NULL && (editor_state.arguments.hex ||
+                                     editor_hex_view_is_binary(file_path))) {
+        editor_open_hex_file(file_path);
+        mode_transition(&hex_mode, NULL);
+    } else if (file_path != NULL) {
+        editor_open_text_file(file_path);
+        if (editor_state.arguments.follow) { editor_start_following(); }
     } else {
         editor_insert_row(0, "", 0);   // empty new file
         editor_state.modified = false; // override insert_row() setting modified
@@ -18,12 +18,13 @@ const char *manual_text[] = {
     "with 'q' or forcefully quit with 'Q'.\n",
 
     "=== MODES ===",
-    "A1 has four modes, with their purposes described below\n",
+    "A1 has five modes, with their purposes described below\n",
 
     "NORMAL:  To navigate the text buffer",
     "INSERT:  To modify the text buffer",
     "COMMAND: To enter various editor commands",
-    "FIND:    To find matches in the text buffer\n",
+    "FIND:    To find matches in the text buffer",
+    "HEX:     To view a binary file as hex\n",
 
     "These modes are described in greater detail below.\n",
 
@@ -77,6 +78,10 @@ const char *manual_text[] = {
     "D      -> Delete to end of line",
     "x      -> Delete character under cursor\n",
 
+    "u      -> Undo last change (text typed without moving the cursor or",
+    "          pausing is one change)",
+    "C-r    -> Redo last change undone\n",
+
     "o      -> Insert new line below and enter INSERT mode there",
     "O      -> Insert new line above and enter INSERT mode there\n",
 
@@ -102,7 +107,9 @@ const char *manual_text[] = {
 
     "Arguments surrounded by square brackets are optional.\n",
 
-    "save [FILE] -> Save text buffer\n",
+    "save [FILE] -> Save text buffer",
+    "- Refuses to overwrite changes made to the file by another program,",
+    "  use 'save!' to overwrite them anyway\n",
 
     "find STRING [i/I] -> Enter FIND mode and search for STRING.",
     "- Case insensitive/sensitive search can be set by adding i/I afterwards",
@@ -115,6 +122,20 @@ const char *manual_text[] = {
     "get OPTION -> Get the current value of an editor option.",
     "set OPTION VALUE -> Set the value of an editor option.\n",
 
+    "memory -> Show how much memory is held for line text and undo history.",
+    "compact -> Release memory left unused after deleting many lines.\n",
+
+    "follow -> Start or stop following text appended to the file.\n",
+
+    "reload -> Load changes made to the file by another program. Only the",
+    "lines which changed are replaced, keeping the cursor in place. Use",
+    "'reload!' to discard unsaved changes.\n",
+
+    "earlier [N] -> Go back N changes in the order they were made (default",
+    "1), or back in time if N ends with s, m, h or d (e.g. 'earlier 5m').",
+    "later [N] -> Same as 'earlier', but forward.",
+    "branch -> Switch the branch redo follows (see UNDO HISTORY).\n",
+
     "=== FIND MODE ===",
     "Here you can jump between matches of the searched string.\n",
 
@@ -127,6 +148,26 @@ const char *manual_text[] = {
 
     "c      -> Centre view vertically (like NORMAL mode)\n",
 
+    "=== HEX MODE ===",
+    "Binary files (those with a null byte near their start), or any file",
+    "when A1 is started with the --hex flag, are viewed read-only as hex",
+    "and ASCII, 16 bytes to a line. The file is mapped rather than read, so",
+    "even files of many gigabytes open instantly.\n",
+
+    "h/j/k/l, C-d/C-u/C-f/C-b, H/M/L, g/G, 0/$ and c move as in NORMAL",
+    "mode, by bytes and lines of bytes. The following are in addition.\n",
+
+    "f      -> Enter COMMAND mode with 'find' prompt",
+    "o      -> Enter COMMAND mode with 'goto' prompt",
+    "n      -> Jump to next match of last search",
+    "p      -> Jump to previous match of last search\n",
+
+    "In HEX mode, 'goto' takes an offset, in decimal (with an optional K,",
+    "M or G suffix) or hex (e.g. 'goto 0x1f00'). 'find' takes bytes, as",
+    "pairs of hex digits or quoted text (e.g. 'find 7f \"ELF\"'), and",
+    "wraps around the end of the file. 'save', 'follow', 'reload' and the",
+    "undo history commands are not available.\n",
+
     "=== CONFIGURATION ===",
     "A1 can be configured by setting various options.\n",
 
@@ -147,6 +188,14 @@ const char *manual_text[] = {
     "'tabstop' (alias 'ts') -> How far to indent a line when TAB is pressed",
     "Default '4'.\n",
 
+    "'memlimit' (alias 'ml') -> How much memory lines may take (e.g. '512M',",
+    "with K, M or G suffixes) before the least recently viewed are freed.",
+    "'0' for no limit. Default '0'.\n",
+
+    "'undolimit' (alias 'ul') -> How large undo history may grow",
+    "(e.g. '64M') before the oldest changes are dropped. '0' for no limit.",
+    "Default '16M'.\n",
+
     "In COMMAND mode you can set these options using the 'set' command.",
     "You can also set them more permanently by writing 'set' commands in",
     "a configuration file, which is executed automatically upon starting.\n",
@@ -158,6 +207,54 @@ const char *manual_text[] = {
     "in the file. Anything else other than comments (prefixed with '#') will",
     "prevent any further execution of the commands in the file.\n",
 
+    "=== UNDO HISTORY ===",
+    "Undo history is kept on disk, so changes can still be undone after",
+    "the file is closed and opened again, as long as it has not been",
+    "changed by another program since. Changes made but not saved can be",
+    "redone from the file as it was last saved.\n",
+
+    "Changes undone are never lost. Making a change after undoing starts a",
+    "new branch of history, leaving the changes undone on the old one.",
+    "Redo follows the branch last made or undone along, 'branch' switches",
+    "to the next branch from the current change, and 'earlier' and 'later'",
+    "move through every change in the order it was made, across branches.\n",
+
+    "History is kept in $XDG_STATE_HOME/a1/undo if $XDG_STATE_HOME is set,",
+    "otherwise in $HOME/.local/state/a1/undo, with a file for each file",
+    "edited.\n",
+
+    "=== LARGE FILES ===",
+    "Files of 256MB or more, or any file when A1 is started with the",
+    "--large flag, are opened in large-file mode. Only the positions of",
+    "lines are found when opening, with lines read from the file as they",
+    "are viewed or edited. Syntax highlighting is disabled in this mode.\n",
+
+    "With a memory limit set (see 'memlimit'), unmodified lines not viewed",
+    "recently are dropped in large-file mode, to be read from the file",
+    "again when next viewed. In other files only what is built to draw",
+    "lines (their rendering and highlighting) is dropped, as lines are read",
+    "from the file when it is opened. Modified lines are always kept. The",
+    "limit does not open files in large-file mode itself, use --large for",
+    "that.\n",
+
+    "=== FOLLOWING FILES ===",
+    "When A1 is started with the --follow flag, or after the 'follow'",
+    "command, text appended to the file (e.g. a log) by other programs is",
+    "added as it is written, like 'tail -f'. If the cursor is on the last",
+    "line, it moves to the new last line. Running 'follow' again stops.\n",
+
+    "=== PIPES ===",
+    "Text piped to A1 (e.g. 'make | a1'), or read from stdin with 'a1 -',",
+    "is shown as it arrives, with keys read from the terminal. Saving",
+    "requires a file name, and writes what has been read so far.\n",
+
+    "Piped text, and text appended to a followed file, is kept compressed",
+    "until viewed. Past 16MB of compressed text, the oldest is moved to a",
+    "temporary file (in $TMPDIR, or /tmp) deleted on exit, so that memory",
+    "does not grow with long logs beyond a small index of where their lines",
+    "are. With a memory limit set, lines not viewed recently are compressed",
+    "again.\n",
+
     "=== OTHER ===",
     "A1 has basic syntax highlighting support for C and Python."};
 
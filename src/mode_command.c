@@ -5,9 +5,11 @@
 #include "file_io.h"
 #include "highlight.h"
 #include "input.h"
+#include "mode_hex.h"
 #include "modes.h"
 #include "operations.h"
 #include "output.h"
+#include "utf8.h"
 #include "util.h"
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +21,14 @@ enum EditorCommandType {
     CMD_GOTO,
     CMD_GET,
     CMD_SET,
+    CMD_MEMORY,
+    CMD_COMPACT,
+    CMD_FOLLOW,
+    CMD_RELOAD,
+    CMD_EARLIER,
+    CMD_LATER,
+    CMD_BRANCH,
+    CMD_UNAVAILABLE,
     CMD_UNKNOWN
 };
 
@@ -28,16 +38,26 @@ enum EditorOptionType {
     OPTION_LINE_NUMBERS,
     OPTION_TAB_CHARACTER,
     OPTION_TAB_STOP,
+    OPTION_MEMORY_LIMIT,
+    OPTION_UNDO_LIMIT,
     OPTION_UNKNOWN
 };
 
 static enum EditorCommandType parse_command(char *command);
 static enum EditorOptionType parse_option(char *command);
-static bool save_command(char **words, int count);
+static bool save_command(char **words, int count, bool force);
 static bool find_command(char **words, int count);
 static bool goto_command(char **words, int count);
+static bool hex_find_command(char **words, int count);
+static bool hex_goto_command(char **words, int count);
 static bool get_command(char **words, int count);
 static bool set_command(char **words, int count);
+static bool memory_command(void);
+static bool compact_command(void);
+static bool follow_command(void);
+static bool reload_command(bool force);
+static bool history_command(char **words, int count, bool later);
+static bool branch_command(void);
 
 void mode_command_entry(void *data) {
     write(STDOUT_FILENO, "\x1b[?25h", 6); // show cursor
@@ -61,7 +81,7 @@ void mode_command_entry(void *data) {
 void mode_command_input(int input) {
     switch (input) {
     case ESCAPE:
-        mode_transition(&normal_mode, NULL);
+        mode_transition(mode_default(), NULL);
         break;
 
     case ENTER:
@@ -74,6 +94,14 @@ void mode_command_input(int input) {
             '\0';
         editor_state.command_state.cursor_x =
             MAX(0, editor_state.command_state.cursor_x - 1);
+
+        // back over the rest of a multi-byte char
+        while (editor_state.command_state.cursor_x > 0 &&
+               UTF8_IS_CONTINUATION(
+                   editor_state.command_state
+                       .buffer[editor_state.command_state.cursor_x])) {
+            editor_state.command_state.cursor_x--;
+        }
         break;
 
     case TAB:
@@ -84,21 +112,28 @@ void mode_command_input(int input) {
         editor_state.command_state.cursor_x = 0;
         break;
 
-    default:
+    default: {
+        if (input > UTF8_MAX_CODE_POINT) { break; }
+
+        char seq[UTF8_MAX_LEN];
+        int len = editor_utf8_encode(input, seq);
+
         // prevent input if cursor at end
-        if (editor_state.command_state.cursor_x + 1 >=
+        if (editor_state.command_state.cursor_x + len >=
             (int)(sizeof(editor_state.command_state.buffer) /
                   sizeof(editor_state.command_state.buffer[0]))) {
             break;
         }
 
-        editor_state.command_state.buffer[editor_state.command_state.cursor_x] =
-            input;
-        editor_state.command_state.cursor_x++;
+        memcpy(&editor_state.command_state
+                    .buffer[editor_state.command_state.cursor_x],
+               seq, len);
+        editor_state.command_state.cursor_x += len;
         editor_state.command_state.buffer[editor_state.command_state.cursor_x] =
             '\0';
         break;
     }
+    }
 }
 
 void mode_command_exit(void) {}
@@ -109,15 +144,31 @@ bool execute_command(char *command_buffer) {
 
     if (words == NULL) {
         editor_set_status_message(MSG_WARNING, "Invalid input");
-        mode_transition(&normal_mode, NULL);
+        mode_transition(mode_default(), NULL);
         return false;
     }
 
+    // a trailing '!' forces a command, e.g. to discard changes
+    size_t command_len = strlen(words[0]);
+    bool force = command_len > 1 && words[0][command_len - 1] == '!';
+    if (force) { words[0][command_len - 1] = '\0'; }
+
     bool valid_command;
+    enum EditorCommandType command_type = parse_command(words[0]);
+
+    // the hex view has no text to save, reload or change
+    if (editor_state.hex_view != NULL &&
+        (command_type == CMD_SAVE || command_type == CMD_FOLLOW ||
+         command_type == CMD_RELOAD || command_type == CMD_EARLIER ||
+         command_type == CMD_LATER || command_type == CMD_BRANCH)) {
+        editor_set_status_message(MSG_WARNING, "'%s' not available in hex view",
+                                  words[0]);
+        command_type = CMD_UNAVAILABLE;
+    }
 
-    switch (parse_command(words[0])) {
+    switch (command_type) {
     case CMD_SAVE:
-        valid_command = save_command(words, count);
+        valid_command = save_command(words, count, force);
         break;
     case CMD_FIND:
         valid_command = find_command(words, count);
@@ -131,10 +182,35 @@ bool execute_command(char *command_buffer) {
     case CMD_SET:
         valid_command = set_command(words, count);
         break;
+    case CMD_MEMORY:
+        valid_command = memory_command();
+        break;
+    case CMD_COMPACT:
+        valid_command = compact_command();
+        break;
+    case CMD_FOLLOW:
+        valid_command = follow_command();
+        break;
+    case CMD_RELOAD:
+        valid_command = reload_command(force);
+        break;
+    case CMD_EARLIER:
+        valid_command = history_command(words, count, false);
+        break;
+    case CMD_LATER:
+        valid_command = history_command(words, count, true);
+        break;
+    case CMD_BRANCH:
+        valid_command = branch_command();
+        break;
+    case CMD_UNAVAILABLE:
+        mode_transition(mode_default(), NULL);
+        valid_command = false;
+        break;
     default:
         editor_set_status_message(MSG_WARNING, "Unknown command '%s'",
                                   words[0]);
-        mode_transition(&normal_mode, NULL);
+        mode_transition(mode_default(), NULL);
         valid_command = false;
         break;
     }
@@ -153,6 +229,13 @@ static enum EditorCommandType parse_command(char *command) {
     if (strcmp(command, "goto") == 0) { return CMD_GOTO; }
     if (strcmp(command, "get") == 0) { return CMD_GET; }
     if (strcmp(command, "set") == 0) { return CMD_SET; }
+    if (strcmp(command, "memory") == 0) { return CMD_MEMORY; }
+    if (strcmp(command, "compact") == 0) { return CMD_COMPACT; }
+    if (strcmp(command, "follow") == 0) { return CMD_FOLLOW; }
+    if (strcmp(command, "reload") == 0) { return CMD_RELOAD; }
+    if (strcmp(command, "earlier") == 0) { return CMD_EARLIER; }
+    if (strcmp(command, "later") == 0) { return CMD_LATER; }
+    if (strcmp(command, "branch") == 0) { return CMD_BRANCH; }
     return CMD_UNKNOWN;
 }
 
@@ -169,14 +252,18 @@ static enum EditorOptionType parse_option(char *command) {
     if (!strcmp(command, "tabcharacter")) { return OPTION_TAB_CHARACTER; }
     if (!strcmp(command, "ts")) { return OPTION_TAB_STOP; }
     if (!strcmp(command, "tabstop")) { return OPTION_TAB_STOP; }
+    if (!strcmp(command, "ml")) { return OPTION_MEMORY_LIMIT; }
+    if (!strcmp(command, "memlimit")) { return OPTION_MEMORY_LIMIT; }
+    if (!strcmp(command, "ul")) { return OPTION_UNDO_LIMIT; }
+    if (!strcmp(command, "undolimit")) { return OPTION_UNDO_LIMIT; }
 
     return OPTION_UNKNOWN;
 }
 
-static bool save_command(char **words, int count) {
+static bool save_command(char **words, int count, bool force) {
     // if saving to current file
     if (count == 1) {
-        editor_save_text_buffer(NULL);
+        editor_save_text_buffer(NULL, force);
     }
     // if saving with a potentially new file name
     else if (count >= 2) {
@@ -186,7 +273,7 @@ static bool save_command(char **words, int count) {
             editor_set_status_message(MSG_WARNING, "File '%s' already exists",
                                       file_path);
         } else {
-            editor_save_text_buffer(file_path);
+            editor_save_text_buffer(file_path, force);
 
             if (editor_state.file_path != NULL) {
                 free(editor_state.file_path);
@@ -202,14 +289,18 @@ static bool save_command(char **words, int count) {
         }
     }
 
-    mode_transition(&normal_mode, NULL);
+    mode_transition(mode_default(), NULL);
     return true;
 }
 
 static bool find_command(char **words, int count) {
+    if (editor_state.hex_view != NULL) {
+        return hex_find_command(words, count);
+    }
+
     if (count < 2) {
         editor_set_status_message(MSG_WARNING, "Search text not specified");
-        mode_transition(&normal_mode, NULL);
+        mode_transition(mode_default(), NULL);
         return false;
     }
 
@@ -246,9 +337,13 @@ static bool find_command(char **words, int count) {
 }
 
 static bool goto_command(char **words, int count) {
+    if (editor_state.hex_view != NULL) {
+        return hex_goto_command(words, count);
+    }
+
     if (count < 2) {
         editor_set_status_message(MSG_WARNING, "Line number not specified");
-        mode_transition(&normal_mode, NULL);
+        mode_transition(mode_default(), NULL);
         return false;
     }
 
@@ -257,19 +352,59 @@ static bool goto_command(char **words, int count) {
 
     if (!valid_num || line_num <= 0 || line_num > editor_state.num_rows) {
         editor_set_status_message(MSG_WARNING, "Invalid line number");
-        mode_transition(&normal_mode, NULL);
+        mode_transition(mode_default(), NULL);
         return false;
     }
 
     editor_set_cursor_y(line_num - 1);
-    mode_transition(&normal_mode, NULL);
+    mode_transition(mode_default(), NULL);
+    return true;
+}
+
+// searches for bytes, given in hex or as quoted text, e.g. 'find 7f "ELF"'
+static bool hex_find_command(char **words, int count) {
+    EditorHexView *view = editor_state.hex_view;
+
+    size_t len;
+    unsigned char *pattern =
+        editor_hex_view_parse_pattern(&words[1], count - 1, &len);
+
+    if (pattern == NULL) {
+        editor_set_status_message(MSG_WARNING, "Invalid byte pattern");
+        mode_transition(&hex_mode, NULL);
+        return false;
+    }
+
+    free(view->pattern);
+    view->pattern = pattern;
+    view->pattern_len = len;
+
+    mode_transition(&hex_mode, NULL);
+    mode_hex_find_next(true);
+    return true;
+}
+
+// moves to byte at offset, in decimal or hex, e.g. 'goto 0x1f00'
+static bool hex_goto_command(char **words, int count) {
+    EditorHexView *view = editor_state.hex_view;
+
+    size_t offset;
+    if (count < 2 || !editor_hex_view_parse_offset(words[1], &offset) ||
+        (offset >= view->size && offset > 0)) {
+        editor_set_status_message(MSG_WARNING, "Invalid offset");
+        mode_transition(&hex_mode, NULL);
+        return false;
+    }
+
+    view->cursor = offset;
+    mode_transition(&hex_mode, NULL);
     return true;
 }
 
 static bool get_command(char **words, int count) {
     if (count < 2) {
         editor_set_status_message(MSG_WARNING, "Missing option");
-        mode_transition(&normal_mode, NULL);
+        mode_transition(mode_default(), NULL);
         return false;
     }
 
@@ -302,27 +437,39 @@ static bool get_command(char **words, int count) {
         editor_set_status_message(MSG_INFO, "%s=%d", words[1],
                                   editor_state.options.tab_stop);
         break;
+    case OPTION_MEMORY_LIMIT: {
+        char size[32];
+        size_to_str(editor_state.options.memory_limit, size, sizeof(size));
+        editor_set_status_message(MSG_INFO, "%s=%s", words[1], size);
+        break;
+    }
+    case OPTION_UNDO_LIMIT: {
+        char size[32];
+        size_to_str(editor_state.options.undo_limit, size, sizeof(size));
+        editor_set_status_message(MSG_INFO, "%s=%s", words[1], size);
+        break;
+    }
     case OPTION_UNKNOWN:
         valid_command = false;
         editor_set_status_message(MSG_WARNING, "Unknown option '%s'", words[1]);
         break;
     }
 
-    mode_transition(&normal_mode, NULL);
+    mode_transition(mode_default(), NULL);
     return valid_command;
 }
 
 static bool set_command(char **words, int count) {
     if (count < 3) {
         editor_set_status_message(MSG_WARNING, "Missing option or value");
-        mode_transition(&normal_mode, NULL);
+        mode_transition(mode_default(), NULL);
         return false;
     }
 
     enum EditorOptionType option_type = parse_option(words[1]);
     if (option_type == OPTION_UNKNOWN) {
         editor_set_status_message(MSG_WARNING, "Unknown option '%s'", words[1]);
-        mode_transition(&normal_mode, NULL);
+        mode_transition(mode_default(), NULL);
         return false;
     }
 
@@ -362,12 +509,33 @@ static bool set_command(char **words, int count) {
                 break;
             }
             editor_state.options.tab_stop = option_value;
-            for (int i = 0; i < editor_state.num_rows; i++) {
-                editor_update_row(&editor_state.rows[i]);
+            EditorLineRun run;
+            bool more = editor_line_tree_first_run(editor_state.rows, &run);
+            for (; more; more = editor_line_tree_next_run(&run)) {
+                if (run.row != NULL) { editor_invalidate_row(run.row); }
             }
         }
         break;
     }
+    case OPTION_MEMORY_LIMIT: {
+        // 0 removes the limit
+        size_t option_value = parse_size(words[2], &is_valid);
+        if (is_valid) {
+            editor_state.options.memory_limit = option_value;
+            editor_limit_rows_memory();
+        }
+        break;
+    }
+    case OPTION_UNDO_LIMIT: {
+        // 0 removes the limit
+        size_t option_value = parse_size(words[2], &is_valid);
+        if (is_valid) {
+            editor_state.options.undo_limit = option_value;
+            editor_action_history_set_limit(editor_state.action_history,
+                                            option_value);
+        }
+        break;
+    }
     case OPTION_UNKNOWN:
         is_valid = false;
         break;
@@ -378,6 +546,165 @@ static bool set_command(char **words, int count) {
                                   words[2], words[1]);
     }
 
-    mode_transition(&normal_mode, NULL);
+    mode_transition(mode_default(), NULL);
     return is_valid;
 }
+
+static bool memory_command(void) {
+    EditorArenaStats stats;
+    editor_arena_get_stats(editor_state.arena, &stats);
+
+    size_t packed_text, spilled;
+    size_t packed = editor_line_pack_memory(&packed_text, &spilled);
+
+    editor_set_status_message(
+        MSG_INFO,
+        "Rows %zuK (%zuK of %zuK in %zu slabs, %zuK large), packed %zuK/%zuK "
+        "(%zuK on disk), undo %zuK",
+        editor_rows_memory() / 1024, stats.used_bytes / 1024,
+        stats.slab_bytes / 1024, stats.slabs, stats.large_bytes / 1024,
+        packed / 1024, packed_text / 1024, spilled / 1024,
+        editor_action_history_memory(editor_state.action_history) / 1024);
+
+    mode_transition(mode_default(), NULL);
+    return true;
+}
+
+static bool compact_command(void) {
+    size_t released = editor_compact_rows();
+    editor_set_status_message(MSG_INFO, "Released %zuK", released / 1024);
+
+    mode_transition(mode_default(), NULL);
+    return true;
+}
+
+// toggles following appends to the file
+static bool follow_command(void) {
+    bool valid_command = true;
+
+    if (editor_is_following()) {
+        editor_stop_following();
+        editor_set_status_message(MSG_INFO, "Stopped following file");
+    } else {
+        valid_command = editor_start_following();
+        if (valid_command) {
+            editor_set_status_message(MSG_INFO, "Following file");
+        }
+    }
+
+    mode_transition(mode_default(), NULL);
+    return valid_command;
+}
+
+static bool reload_command(bool force) {
+    if (editor_state.modified && !force) {
+        editor_set_status_message(
+            MSG_WARNING, "Unsaved changes, use 'reload!' to discard them");
+        mode_transition(mode_default(), NULL);
+        return false;
+    }
+
+    editor_reload_file();
+
+    mode_transition(mode_default(), NULL);
+    return true;
+}
+
+// parses a number of changes, or of seconds if followed by s, m, h or d (e.g.
+// '30s', '5m'), returns false if invalid
+static bool parse_history_step(const char *string, size_t *num,
+                               bool *seconds) {
+    size_t len = strlen(string);
+    size_t unit = 0;
+
+    if (len > 0) {
+        switch (string[len - 1]) {
+        case 's':
+            unit = 1;
+            break;
+        case 'm':
+            unit = 60;
+            break;
+        case 'h':
+            unit = 60 * 60;
+            break;
+        case 'd':
+            unit = 24 * 60 * 60;
+            break;
+        }
+        if (unit != 0) { len--; }
+    }
+
+    if (len == 0 || len > 9) { return false; }
+
+    *num = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (string[i] < '0' || string[i] > '9') { return false; }
+        *num = *num * 10 + (string[i] - '0');
+    }
+
+    *seconds = unit != 0;
+    if (*seconds) { *num *= unit; }
+    return true;
+}
+
+// moves back (or forward) through the text as it was over time, by changes or
+// by time, whichever branches they were made on
+static bool history_command(char **words, int count, bool later) {
+    EditorActionHistory *ah = editor_state.action_history;
+    size_t state = editor_action_history_state(ah);
+    size_t last = editor_action_history_states(ah) - 1;
+
+    size_t num = 1;
+    bool seconds = false;
+    if (count >= 2 && !parse_history_step(words[1], &num, &seconds)) {
+        editor_set_status_message(MSG_WARNING, "Invalid count or time '%s'",
+                                  words[1]);
+        mode_transition(mode_default(), NULL);
+        return false;
+    }
+
+    size_t target;
+    if (seconds) {
+        time_t time = editor_action_history_state_time(ah, state);
+        time = later ? time + (time_t)num : time - (time_t)num;
+        target = editor_action_history_state_at(ah, time);
+        target = later ? MAX(target, state) : MIN(target, state);
+    } else {
+        target = later ? state + MIN(num, last - state)
+                       : state - MIN(num, state);
+    }
+
+    if (target == state) {
+        editor_set_status_message(MSG_INFO, later ? "Already at newest change"
+                                                  : "Already at oldest change");
+    } else if (!editor_action_history_goto(ah, target, editor_apply_action)) {
+        editor_action_history_drop(ah);
+        editor_set_status_message(MSG_WARNING,
+                                  "Undo history does not match the text, "
+                                  "dropped");
+    } else {
+        editor_set_status_message(MSG_INFO, "At change %zu of %zu", target,
+                                  last);
+    }
+
+    mode_transition(mode_default(), NULL);
+    return true;
+}
+
+// switches the branch redo follows from the current change
+static bool branch_command(void) {
+    int count;
+    int branch =
+        editor_action_history_next_branch(editor_state.action_history, &count);
+
+    if (branch == 0) {
+        editor_set_status_message(MSG_INFO, "No branches from this change");
+    } else {
+        editor_set_status_message(MSG_INFO, "Redo follows branch %d of %d",
+                                  branch, count);
+    }
+
+    mode_transition(mode_default(), NULL);
+    return true;
+}
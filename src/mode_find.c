@@ -2,55 +2,104 @@
 
 #include "mode_find.h"
 #include "a1.h"
-#include "highlight.h"
+#include "file_io.h"
 #include "modes.h"
+#include "operations.h"
 #include "output.h"
 #include "terminal.h"
 #include "util.h"
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
-static FindMatch *find_matches(const char *string, int *count,
-                               char *(*search_fn)(const char *, const char *)) {
+// case-insensitive equivalent of memmem()
+static void *memcasemem(const void *haystack, size_t haystack_len,
+                        const void *needle, size_t needle_len) {
+    const char *h = haystack;
+    const char *n = needle;
+
+    if (needle_len == 0) { return (void *)h; }
+
+    for (size_t i = 0; i + needle_len <= haystack_len; i++) {
+        if (strncasecmp(&h[i], n, needle_len) == 0) { return (void *)&h[i]; }
+    }
+    return NULL;
+}
+
+typedef void *(*SearchFn)(const void *, size_t, const void *, size_t);
+
+typedef struct {
+    FindMatch *matches;
+    int count;
+    int capacity;
+} FindMatchList;
 
-    int capacity = 2; // initial memory allocation for 2 FindMatch structs
-    int matches_count = 0;
+// adds every match of string within the chars of row
+// chars are searched with a length as they may be a view of the file which is
+// not null-terminated
+static void find_line_matches(FindMatchList *list, const char *chars,
+                              ssize_t size, int row, const char *string,
+                              SearchFn search_fn) {
+    size_t string_len = strlen(string);
+    ssize_t col = 0;
 
-    FindMatch *matches = malloc(capacity * sizeof(FindMatch));
+    while (col < size) {
+        char *match = search_fn(&chars[col], size - col, string, string_len);
 
-    for (int row = 0; row < editor_state.num_rows; row++) {
-        int col = 0;
+        if (match == NULL) { break; }
 
-        while (true) {
-            char *match = search_fn(&editor_state.rows[row].chars[col], string);
+        col = match - chars;
 
-            if (match == NULL) { break; }
+        list->matches[list->count].col = col;
+        list->matches[list->count].row = row;
 
-            col = match - editor_state.rows[row].chars;
+        // so as to not match the same string
+        col++;
 
-            matches[matches_count].col = col;
-            matches[matches_count].row = row;
+        // expand matches array when required
+        list->count++;
+        if (list->count == list->capacity) {
+            list->capacity *= 2;
+            list->matches =
+                realloc(list->matches, list->capacity * sizeof(FindMatch));
+        }
+    }
+}
 
-            // so as to not match the same string
-            col++;
+static FindMatch *find_matches(const char *string, int *count,
+                               SearchFn search_fn) {
+    // initial memory allocation for 2 FindMatch structs
+    FindMatchList list = {malloc(2 * sizeof(FindMatch)), 0, 2};
+
+    // lines not yet loaded are searched in the mapped file (large-file mode) or
+    // their pack
+    int row = 0;
+    EditorLineRun run;
+    bool more = editor_line_tree_first_run(editor_state.rows, &run);
+    for (; more; more = editor_line_tree_next_run(&run)) {
+        if (run.row != NULL) {
+            find_line_matches(&list, run.row->chars, run.row->size, row,
+                              string, search_fn);
+            row++;
+            continue;
+        }
 
-            // expand matches array when required
-            matches_count++;
-            if (matches_count == capacity) {
-                capacity *= 2;
-                matches = realloc(matches, capacity * sizeof(FindMatch));
-            }
+        for (int i = 0; i < run.count; i++) {
+            size_t len;
+            const char *chars = editor_unloaded_line(&run, i, &len);
+            find_line_matches(&list, chars, len, row, string, search_fn);
+            row++;
         }
     }
 
-    if (matches_count == 0) {
-        free(matches);
+    if (list.count == 0) {
+        free(list.matches);
         *count = 0;
         return NULL;
     } else {
-        *count = matches_count;
-        return matches;
+        *count = list.count;
+        return list.matches;
     }
 }
 
@@ -65,9 +114,9 @@ void mode_find_entry(void *data) {
     fs->string = mode_data->string;
 
     int matches_count;
-    char *(*search_fn)(const char *, const char *) =
-        mode_data->case_insensitive ? strcasestr : strstr;
+    SearchFn search_fn = mode_data->case_insensitive ? memcasemem : memmem;
 
+    editor_finish_loading(); // so that the whole file is searched
     FindMatch *matches = find_matches(fs->string, &matches_count, search_fn);
 
     if (matches == NULL) {
@@ -94,8 +143,6 @@ void mode_find_entry(void *data) {
 
     // if haven't found match past cursor position, loop around to first
     if (fs->match_index == -1) { fs->match_index = 0; }
-
-    editor_apply_find_mode_highlights();
 }
 
 void mode_find_input(int input) {
@@ -158,6 +205,4 @@ void mode_find_exit(void) {
 
     editor_state.find_state.matches_count = -1;
     editor_state.find_state.match_index = -1;
-
-    editor_update_syntax_highlight_all();
 }
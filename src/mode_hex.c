@@ -0,0 +1,213 @@
+#include "mode_hex.h"
+#include "a1.h"
+#include "input.h"
+#include "mode_command.h"
+#include "modes.h"
+#include "output.h"
+#include "terminal.h"
+#include "util.h"
+#include <unistd.h>
+
+// offset of last byte (0 if the file is empty)
+static size_t hex_last_byte(const EditorHexView *view) {
+    return view->size > 0 ? view->size - 1 : 0;
+}
+
+static void hex_set_cursor(EditorHexView *view, size_t offset) {
+    view->cursor = MIN(offset, hex_last_byte(view));
+}
+
+// moves cursor by lines, keeping its column where the last line is long enough
+static void hex_move_lines(EditorHexView *view, size_t lines, bool down) {
+    size_t bytes = lines * HEX_VIEW_LINE_BYTES;
+
+    if (down) {
+        size_t line = view->cursor / HEX_VIEW_LINE_BYTES;
+        size_t last_line = hex_last_byte(view) / HEX_VIEW_LINE_BYTES;
+        if (line + lines > last_line) {
+            bytes = (last_line - line) * HEX_VIEW_LINE_BYTES;
+        }
+        hex_set_cursor(view, view->cursor + bytes);
+    } else {
+        size_t line = view->cursor / HEX_VIEW_LINE_BYTES;
+        if (lines > line) { bytes = line * HEX_VIEW_LINE_BYTES; }
+        view->cursor -= bytes;
+    }
+}
+
+// scrolls page (or half page) along with cursor
+static void hex_page_scroll(EditorHexView *view, bool down, bool half) {
+    size_t lines = MAX(editor_state.screen_rows / (half ? 2 : 1), 1);
+    size_t last_scroll =
+        editor_hex_view_lines(view) > (size_t)editor_state.screen_rows
+            ? editor_hex_view_lines(view) - editor_state.screen_rows
+            : 0;
+
+    hex_move_lines(view, lines, down);
+    if (down) {
+        view->scroll_line = MIN(view->scroll_line + lines, last_scroll);
+    } else {
+        view->scroll_line -= MIN(lines, view->scroll_line);
+    }
+}
+
+// moves cursor to line on screen, keeping its column
+static void hex_move_to_screen_line(EditorHexView *view, size_t screen_line) {
+    size_t column = view->cursor % HEX_VIEW_LINE_BYTES;
+    size_t line = MIN(view->scroll_line + screen_line,
+                      hex_last_byte(view) / HEX_VIEW_LINE_BYTES);
+    hex_set_cursor(view, line * HEX_VIEW_LINE_BYTES + column);
+}
+
+bool mode_hex_find_next(bool forward) {
+    EditorHexView *view = editor_state.hex_view;
+
+    size_t offset;
+    bool wrapped;
+    if (!editor_hex_view_find(view, forward, &offset, &wrapped)) {
+        editor_set_status_message(MSG_INFO, "Pattern not found");
+        return false;
+    }
+
+    view->cursor = offset;
+    if (wrapped) {
+        editor_set_status_message(MSG_INFO, "Search wrapped");
+    } else {
+        editor_set_status_message(MSG_INFO, "Match at 0x%zx", offset);
+    }
+    return true;
+}
+
+void mode_hex_entry(void *data) {
+    if (data != NULL) { terminal_die("hex_mode_entry"); }
+
+    write(STDOUT_FILENO, "\x1b[?25l", 6); // hide cursor
+}
+
+void mode_hex_input(int input) {
+    EditorHexView *view = editor_state.hex_view;
+    size_t line_start = view->cursor - view->cursor % HEX_VIEW_LINE_BYTES;
+
+    switch (input) {
+
+    // helpful message like in Neovim
+    case CTRL_KEY('c'):
+        editor_set_status_message(MSG_INFO, "Press 'q' to quit.");
+        break;
+
+    // scroll down/up half page
+    case CTRL_KEY('d'):
+        hex_page_scroll(view, true, true);
+        break;
+    case CTRL_KEY('u'):
+        hex_page_scroll(view, false, true);
+        break;
+
+    // scroll down/up full page
+    case CTRL_KEY('f'):
+    case PAGE_DOWN:
+        hex_page_scroll(view, true, false);
+        break;
+    case CTRL_KEY('b'):
+    case PAGE_UP:
+        hex_page_scroll(view, false, false);
+        break;
+
+    // enter command mode
+    case SPACE:
+        mode_transition(&command_mode, NULL);
+        break;
+
+    // jump to beginning/end of line
+    case '0':
+    case HOME_KEY:
+        view->cursor = line_start;
+        break;
+    case '$':
+    case END_KEY:
+        hex_set_cursor(view, line_start + HEX_VIEW_LINE_BYTES - 1);
+        break;
+
+    // (vertically) centre view
+    case 'c': {
+        size_t line = view->cursor / HEX_VIEW_LINE_BYTES;
+        size_t half = editor_state.screen_rows / 2;
+        if (editor_hex_view_lines(view) > (size_t)editor_state.screen_rows) {
+            view->scroll_line = line > half ? line - half : 0;
+        }
+        break;
+    }
+
+    // enter command mode with 'find ' prompt
+    case 'f': {
+        CommandModeData data = {.prompt = "find "};
+        mode_transition(&command_mode, &data);
+        break;
+    }
+
+    // enter command mode with 'goto ' prompt (an offset)
+    case 'o': {
+        CommandModeData data = {.prompt = "goto "};
+        mode_transition(&command_mode, &data);
+        break;
+    }
+
+    // jump to next/previous match
+    case 'n':
+        mode_hex_find_next(true);
+        break;
+    case 'p':
+    case 'N':
+        mode_hex_find_next(false);
+        break;
+
+    // jump to first/last byte
+    case 'g':
+        view->cursor = 0;
+        break;
+    case 'G':
+        view->cursor = hex_last_byte(view);
+        break;
+
+    // basic movement
+    case 'h':
+    case ARROW_LEFT:
+        if (view->cursor > 0) { view->cursor--; }
+        break;
+    case 'j':
+    case ARROW_DOWN:
+        hex_move_lines(view, 1, true);
+        break;
+    case 'k':
+    case ARROW_UP:
+        hex_move_lines(view, 1, false);
+        break;
+    case 'l':
+    case ARROW_RIGHT:
+        hex_set_cursor(view, view->cursor + 1);
+        break;
+
+    // move to visible top/middle/bottom
+    case 'H': // high
+        hex_move_to_screen_line(view, 0);
+        break;
+    case 'M': // middle
+        hex_move_to_screen_line(view, editor_state.screen_rows / 2);
+        break;
+    case 'L': // low
+        hex_move_to_screen_line(view, MAX(editor_state.screen_rows - 1, 0));
+        break;
+
+    // nothing to save, the file is viewed read-only
+    case 's':
+        editor_set_status_message(MSG_INFO, "Hex view is read-only.");
+        break;
+
+    case 'q':
+    case 'Q':
+        terminal_quit();
+        break;
+    }
+}
+
+void mode_hex_exit(void) {}
@@ -4,25 +4,47 @@
 #include "operations.h"
 #include "output.h"
 #include "terminal.h"
+#include "utf8.h"
 #include "util.h"
 #include <unistd.h>
 
 void mode_insert_entry(void *data) {
     if (data != NULL) { terminal_die("insert_mode_entry"); }
     write(STDOUT_FILENO, "\x1b[?25h", 6); // show cursor
+    editor_action_history_break(editor_state.action_history);
 }
 
 void mode_insert_input(int input) {
-    EditorRow *row = &editor_state.rows[editor_state.cursor_y];
+    EditorRow *row = editor_get_row(editor_state.cursor_y);
 
+    // moving the cursor ends the run of typing undone in one step
     switch (input) {
-    case ENTER:
+    case HOME_KEY:
+    case END_KEY:
+    case PAGE_UP:
+    case PAGE_DOWN:
+    case ARROW_UP:
+    case ARROW_DOWN:
+    case ARROW_LEFT:
+    case ARROW_RIGHT:
+        editor_action_history_break(editor_state.action_history);
+        break;
+    }
+
+    switch (input) {
+    case ENTER: {
+        // chars of row are referenced directly below
+        editor_close_row_gap();
+
+        int old_cy = editor_state.cursor_y;
+        ssize_t old_cx = editor_state.cursor_x;
+
         if (editor_state.cursor_x == row->size) {
             editor_insert_row(editor_state.cursor_y + 1, "", 0);
 
             if (editor_state.options.auto_indent) {
-                int new_cx =
-                    editor_auto_indent_row(&editor_state.rows[row->index + 1]);
+                int new_cx = editor_auto_indent_row(
+                    editor_get_row(editor_state.cursor_y + 1));
                 editor_set_cursor_y(editor_state.cursor_y + 1);
                 editor_set_cursor_x(new_cx);
             } else {
@@ -33,43 +55,48 @@ void mode_insert_input(int input) {
             if (editor_state.options.auto_indent) {
                 editor_insert_row(editor_state.cursor_y + 1, "", 0);
 
-                EditorRow *new_row =
-                    &editor_state.rows[editor_state.cursor_y + 1];
+                EditorRow *new_row = editor_get_row(editor_state.cursor_y + 1);
                 int new_cx = editor_auto_indent_row(new_row);
 
                 editor_append_string_to_row(new_row,
                                             &row->chars[editor_state.cursor_x],
                                             row->size - editor_state.cursor_x);
-                editor_del_to_end_of_row(
-                    &editor_state.rows[editor_state.cursor_y],
-                    editor_state.cursor_x);
+                editor_del_to_end_of_row(row, editor_state.cursor_x);
                 editor_set_cursor_y(editor_state.cursor_y + 1);
                 editor_set_cursor_x(new_cx);
             } else {
                 editor_insert_row(editor_state.cursor_y + 1,
                                   &row->chars[editor_state.cursor_x],
                                   row->size - editor_state.cursor_x);
-                editor_del_to_end_of_row(
-                    &editor_state.rows[editor_state.cursor_y],
-                    editor_state.cursor_x);
+                editor_del_to_end_of_row(row, editor_state.cursor_x);
                 editor_set_cursor_y(editor_state.cursor_y + 1);
                 editor_set_cursor_x(0);
             }
         }
+
+        // a newline followed by any indentation of the new row
+        editor_record_insert(ACTION_NEXT_LINE, old_cy, old_cx,
+                             1 + editor_state.cursor_x);
         break;
+    }
 
     case TAB: {
         if (editor_state.options.tab_character) {
             editor_insert_char_in_row(row, editor_state.cursor_x, input);
+            editor_record_insert(ACTION_MODIFY_LINE, editor_state.cursor_y,
+                                 editor_state.cursor_x, 1);
             editor_move_cursor(DIR_RIGHT);
             break;
         }
 
         // if not inserting tab character, insert spaces up to next tab stop
+        // (by column, as chars before may take more or less than one each)
         do {
             editor_insert_char_in_row(row, editor_state.cursor_x, ' ');
+            editor_record_insert(ACTION_MODIFY_LINE, editor_state.cursor_y,
+                                 editor_state.cursor_x, 1);
             editor_move_cursor(DIR_RIGHT);
-        } while ((editor_state.cursor_x + editor_state.options.tab_stop) %
+        } while (editor_row_cx_to_rx(row, editor_state.cursor_x) %
                      editor_state.options.tab_stop !=
                  0);
 
@@ -88,11 +115,11 @@ void mode_insert_input(int input) {
     case CTRL_KEY('h'): {
         // if joining onto previous line
         if (editor_state.cursor_x == 0 && editor_state.cursor_y != 0) {
-            EditorRow *row_above =
-                &editor_state.rows[editor_state.cursor_y - 1];
-            int new_cx = row_above->size;
+            EditorRow *row_above = editor_line_tree_prev(row);
+            ssize_t new_cx = row_above->size;
             int new_cy = editor_state.cursor_y - 1;
 
+            editor_record_delete(ACTION_PREVIOUS_LINE, new_cy, new_cx, 1);
             editor_del_to_previous_row(editor_state.cursor_y);
 
             editor_set_cursor_y(new_cy);
@@ -101,8 +128,13 @@ void mode_insert_input(int input) {
             int count =
                 editor_get_backspace_deletion_count(row, editor_state.cursor_x);
             for (int i = 0; i < count; i++) {
-                editor_del_char_at_row(row, editor_state.cursor_x - 1);
                 editor_move_cursor(DIR_LEFT);
+                editor_record_delete(
+                    ACTION_MODIFY_LINE, editor_state.cursor_y,
+                    editor_state.cursor_x,
+                    editor_row_next_char(row, editor_state.cursor_x) -
+                        editor_state.cursor_x);
+                editor_del_char_at_row(row, editor_state.cursor_x);
             }
         }
 
@@ -114,9 +146,16 @@ void mode_insert_input(int input) {
         if (editor_state.cursor_x == row->size) {
             // if line below, add it to focused one
             if (editor_state.cursor_y < editor_state.num_rows - 1) {
+                editor_record_delete(ACTION_PREVIOUS_LINE,
+                                     editor_state.cursor_y, row->size, 1);
                 editor_del_to_previous_row(editor_state.cursor_y + 1);
             }
         } else {
+            editor_record_delete(
+                ACTION_MODIFY_LINE, editor_state.cursor_y,
+                editor_state.cursor_x,
+                editor_row_next_char(row, editor_state.cursor_x) -
+                    editor_state.cursor_x);
             editor_del_char_at_row(row, editor_state.cursor_x);
         }
         break;
@@ -147,13 +186,19 @@ void mode_insert_input(int input) {
         break;
 
     default:
-        // only allow ASCII character input
-        if (input >= SPACE && input <= '~') {
+        // only allow printable character input (not control characters)
+        if (input <= UTF8_MAX_CODE_POINT && editor_utf8_is_printable(input)) {
+            ssize_t old_size = row->size;
             editor_insert_char_in_row(row, editor_state.cursor_x, input);
+            editor_record_insert(ACTION_MODIFY_LINE, editor_state.cursor_y,
+                                 editor_state.cursor_x, row->size - old_size);
             editor_move_cursor(DIR_RIGHT);
         }
         break;
     }
 }
 
-void mode_insert_exit(void) {}
+void mode_insert_exit(void) {
+    editor_close_row_gap();
+    editor_action_history_break(editor_state.action_history);
+}
@@ -9,22 +9,43 @@
 #include "util.h"
 #include <unistd.h>
 
+// undoes the last action (or redoes the last undone), moving the cursor to
+// where it was made
+static void editor_step_history(bool redo) {
+    EditorActionHistory *ah = editor_state.action_history;
+    EditorAction action;
+
+    if (redo ? !editor_redo_action(ah, &action)
+             : !editor_undo_action(ah, &action)) {
+        editor_set_status_message(MSG_INFO, redo ? "Already at newest change"
+                                                 : "Already at oldest change");
+        return;
+    }
+
+    if (!editor_apply_action(&action)) {
+        editor_action_history_drop(ah);
+        editor_set_status_message(MSG_WARNING,
+                                  "Undo history does not match the text, "
+                                  "dropped");
+    }
+}
+
 void mode_normal_entry(void *data) {
     if (data != NULL) { terminal_die("normal_mode_entry"); }
 
     write(STDOUT_FILENO, "\x1b[?25l", 6); // hide cursor
 
     // move back from end of line (needed for transitioning from insert mode)
-    if (editor_state.rows != NULL) {
+    if (editor_state.num_rows > 0) {
         if (editor_state.cursor_x ==
-            editor_state.rows[editor_state.cursor_y].size) {
+            editor_get_row(editor_state.cursor_y)->size) {
             editor_move_cursor(DIR_LEFT);
         }
     }
 }
 
 void mode_normal_input(int input) {
-    EditorRow *row = &editor_state.rows[editor_state.cursor_y];
+    EditorRow *row = editor_get_row(editor_state.cursor_y);
 
     switch (input) {
 
@@ -53,11 +74,12 @@ void mode_normal_input(int input) {
 
     // jump to beginning of visible line
     case CTRL_KEY('h'):
-        editor_set_cursor_x(editor_state.col_scroll_offset);
+        editor_set_cursor_x(
+            editor_row_rx_to_cx(row, editor_state.col_scroll_offset));
         break;
     // jump to end of visible line
     case CTRL_KEY('l'): {
-        int new_x = row->render_size - 1;
+        ssize_t new_x = editor_row_cx_to_rx(row, row->size) - 1;
         if (new_x > editor_state.screen_cols - editor_state.num_col_width) {
             new_x = editor_state.screen_cols - editor_state.num_col_width - 1 +
                     editor_state.col_scroll_offset;
@@ -67,6 +89,11 @@ void mode_normal_input(int input) {
         break;
     }
 
+    // redo
+    case CTRL_KEY('r'):
+        editor_step_history(true);
+        break;
+
     // enter command mode
     case SPACE:
         mode_transition(&command_mode, NULL);
@@ -86,7 +113,7 @@ void mode_normal_input(int input) {
 
     // jump to end of line
     case '$':
-        editor_set_cursor_x(row->size - 1);
+        editor_set_cursor_x(editor_row_prev_char(row, row->size));
         break;
 
     // enter insert mode to the right
@@ -125,24 +152,42 @@ void mode_normal_input(int input) {
     // delete line
     case 'd':
         if (editor_state.num_rows > 1) {
+            // along with the newline before it if the last line
+            if (editor_state.cursor_y < editor_state.num_rows - 1) {
+                editor_record_delete(ACTION_DELETE_LINE, editor_state.cursor_y,
+                                     0, row->size + 1);
+            } else {
+                editor_record_delete(ACTION_DELETE_LINE,
+                                     editor_state.cursor_y - 1,
+                                     editor_line_tree_prev(row)->size,
+                                     row->size + 1);
+            }
             editor_del_row(editor_state.cursor_y);
             if (editor_state.cursor_y == editor_state.num_rows) {
                 editor_move_cursor(DIR_UP);
             }
-            editor_set_cursor_x(
-                MIN(editor_state.cursor_x,
-                    editor_state.rows[editor_state.cursor_y].size - 1));
+            EditorRow *new_row = editor_get_row(editor_state.cursor_y);
+            editor_set_cursor_x(editor_row_char_start(
+                new_row, MIN(editor_state.cursor_x,
+                             editor_row_prev_char(new_row, new_row->size))));
         }
         // only clear line if only line
         else {
+            editor_record_delete(ACTION_DELETE_LINE, editor_state.cursor_y, 0,
+                                 row->size);
             editor_clear_row(row);
             editor_set_cursor_x(0);
         }
         break;
     // delete to end of line
     case 'D':
+        if (editor_state.cursor_x < row->size) {
+            editor_record_delete(ACTION_DELETE_END_LINE, editor_state.cursor_y,
+                                 editor_state.cursor_x,
+                                 row->size - editor_state.cursor_x);
+        }
         editor_del_to_end_of_row(row, editor_state.cursor_x);
-        editor_set_cursor_x(MAX(0, row->size - 1));
+        editor_set_cursor_x(editor_row_prev_char(row, row->size));
         break;
 
     // enter command mode with 'find ' prompt
@@ -194,24 +239,31 @@ void mode_normal_input(int input) {
     case 'O':
         editor_insert_row(editor_state.cursor_y, "", 0);
         if (editor_state.options.auto_indent) {
-            int new_cx = editor_auto_indent_row(row);
+            int new_cx =
+                editor_auto_indent_row(editor_get_row(editor_state.cursor_y));
             editor_set_cursor_x(new_cx);
         } else {
             editor_set_cursor_x(0);
         }
+        // any indentation of the new row followed by a newline
+        editor_record_insert(ACTION_NEXT_LINE, editor_state.cursor_y, 0,
+                             editor_state.cursor_x + 1);
         mode_transition(&insert_mode, NULL);
         break;
     case 'o':
         editor_insert_row(editor_state.cursor_y + 1, "", 0);
         if (editor_state.options.auto_indent) {
-            int new_cx =
-                editor_auto_indent_row(&editor_state.rows[row->index + 1]);
+            int new_cx = editor_auto_indent_row(
+                editor_get_row(editor_state.cursor_y + 1));
             editor_set_cursor_y(editor_state.cursor_y + 1);
             editor_set_cursor_x(new_cx);
         } else {
             editor_set_cursor_x(0);
             editor_set_cursor_y(editor_state.cursor_y + 1);
         }
+        // a newline followed by any indentation of the new row
+        editor_record_insert(ACTION_NEXT_LINE, editor_state.cursor_y - 1,
+                             row->size, 1 + editor_state.cursor_x);
         mode_transition(&insert_mode, NULL);
         break;
 
@@ -237,7 +289,7 @@ void mode_normal_input(int input) {
 
     // save
     case 's':
-        editor_save_text_buffer(NULL);
+        editor_save_text_buffer(NULL, false);
         break;
     // enter command mode with 'set ' prompt
     case 'S': {
@@ -269,8 +321,20 @@ void mode_normal_input(int input) {
         }
         break;
 
+    // undo
+    case 'u':
+        editor_step_history(false);
+        break;
+
     // delete char
     case 'x':
+        if (editor_state.cursor_x < row->size) {
+            editor_record_delete(
+                ACTION_DELETE_CHAR, editor_state.cursor_y,
+                editor_state.cursor_x,
+                editor_row_next_char(row, editor_state.cursor_x) -
+                    editor_state.cursor_x);
+        }
         editor_del_char_at_row(row, editor_state.cursor_x);
         if (editor_state.cursor_x == row->size) {
             editor_move_cursor(DIR_LEFT);
@@ -288,11 +352,19 @@ void mode_normal_input(int input) {
         break;
 
     // invert case
-    case '~':
+    case '~': {
+        char c = editor_state.cursor_x < row->size
+                     ? editor_row_char_at(row, editor_state.cursor_x)
+                     : '\0';
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+            editor_record_replace(ACTION_INVERT_LETTER, editor_state.cursor_y,
+                                  editor_state.cursor_x, c ^ 0x20);
+        }
         editor_invert_letter_at_row(row, editor_state.cursor_x);
         editor_move_cursor(DIR_RIGHT);
         break;
     }
+    }
 }
 
 void mode_normal_exit(void) {}
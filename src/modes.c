@@ -2,6 +2,7 @@
 #include "a1.h"
 #include "mode_command.h"
 #include "mode_find.h"
+#include "mode_hex.h"
 #include "mode_insert.h"
 #include "mode_normal.h"
 #include <unistd.h>
@@ -26,8 +27,17 @@ const EditorMode find_mode = {.entry_fn = mode_find_entry,
                               .exit_fn = mode_find_exit,
                               .name = "FIND"};
 
+const EditorMode hex_mode = {.entry_fn = mode_hex_entry,
+                             .input_fn = mode_hex_input,
+                             .exit_fn = mode_hex_exit,
+                             .name = "HEX"};
+
 void mode_transition(const EditorMode *new_mode, void *data) {
     if (editor_state.mode != NULL) { editor_state.mode->exit_fn(); }
     editor_state.mode = new_mode;
     if (editor_state.mode != NULL) { editor_state.mode->entry_fn(data); }
 }
+
+const EditorMode *mode_default(void) {
+    return editor_state.hex_view != NULL ? &hex_mode : &normal_mode;
+}
@@ -1,10 +1,11 @@
 #include "movement.h"
 #include "a1.h"
 #include "input.h"
+#include "operations.h"
 #include "util.h"
 
 void editor_move_cursor(EditorDirection dir) {
-    EditorRow *row = &editor_state.rows[editor_state.cursor_y];
+    EditorRow *row = editor_get_row(editor_state.cursor_y);
 
     switch (dir) {
     case DIR_UP:
@@ -13,17 +14,18 @@ void editor_move_cursor(EditorDirection dir) {
         }
         break;
 
-    case DIR_RIGHT:
+    case DIR_RIGHT: {
+        // over a whole char, and any combining chars after it
+        ssize_t next = editor_row_next_char(row, editor_state.cursor_x);
         if (editor_state.mode == &normal_mode) {
-            if (editor_state.cursor_x + 1 < row->size) {
-                editor_set_cursor_x(editor_state.cursor_x + 1);
-            }
+            if (next < row->size) { editor_set_cursor_x(next); }
         } else if (editor_state.mode == &insert_mode) {
             if (editor_state.cursor_x < row->size) {
-                editor_set_cursor_x(editor_state.cursor_x + 1);
+                editor_set_cursor_x(next);
             }
         }
         break;
+    }
 
     case DIR_DOWN:
         if (editor_state.cursor_y + 1 < editor_state.num_rows) {
@@ -33,20 +35,22 @@ void editor_move_cursor(EditorDirection dir) {
 
     case DIR_LEFT:
         if (editor_state.cursor_x > 0) {
-            editor_set_cursor_x(editor_state.cursor_x - 1);
+            editor_set_cursor_x(
+                editor_row_prev_char(row, editor_state.cursor_x));
         }
         break;
     }
 }
 
-void editor_get_previous_word_start(EditorRow *row, int *new_cx, int *new_cy) {
-    int cx = editor_state.cursor_x;
+void editor_get_previous_word_start(EditorRow *row, ssize_t *new_cx,
+                                    int *new_cy) {
+    ssize_t cx = editor_state.cursor_x;
     int cy = editor_state.cursor_y;
 
     if (cx == 0 || editor_get_first_non_whitespace(row) >= cx) {
         if (cy != 0) {
             cy -= 1;
-            row -= 1;
+            row = editor_line_tree_prev(row);
             cx = MAX(0, row->size);
         } else {
             *new_cx = editor_state.cursor_x;
@@ -69,8 +73,8 @@ void editor_get_previous_word_start(EditorRow *row, int *new_cx, int *new_cy) {
     *new_cy = cy;
 }
 
-void editor_get_next_word_start(EditorRow *row, int *new_cx, int *new_cy) {
-    int cx = editor_state.cursor_x;
+void editor_get_next_word_start(EditorRow *row, ssize_t *new_cx, int *new_cy) {
+    ssize_t cx = editor_state.cursor_x;
     int cy = editor_state.cursor_y;
 
     while (cx < row->size - 1) {
@@ -90,7 +94,7 @@ void editor_get_next_word_start(EditorRow *row, int *new_cx, int *new_cy) {
     }
 
     cy += 1;
-    row += 1;
+    row = editor_line_tree_next(row);
     cx = editor_get_first_non_whitespace(row);
     if (cx == -1) { cx = 0; }
 
@@ -98,15 +102,16 @@ void editor_get_next_word_start(EditorRow *row, int *new_cx, int *new_cy) {
     *new_cy = cy;
 }
 
-void editor_get_next_word_end(EditorRow *row, int *new_cx, int *new_cy) {
-    int cx = editor_state.cursor_x;
+void editor_get_next_word_end(EditorRow *row, ssize_t *new_cx, int *new_cy) {
+    ssize_t cx = editor_state.cursor_x;
     int cy = editor_state.cursor_y;
 
     while (cx < row->size - 1) {
         cx++;
         if (!is_whitescape(row->chars[cx])) {
             if (cx == row->size - 1 || is_whitescape(row->chars[cx + 1])) {
-                *new_cx = cx;
+                // last byte of word may be within a multi-byte char
+                *new_cx = editor_row_char_start(row, cx);
                 *new_cy = cy;
                 return;
             }
@@ -121,13 +126,13 @@ void editor_get_next_word_end(EditorRow *row, int *new_cx, int *new_cy) {
 
     cx = 0;
     cy += 1;
-    row += 1;
+    row = editor_line_tree_next(row);
 
     while (cx < row->size - 1) {
         cx++;
         if (!is_whitescape(row->chars[cx])) {
             if (cx == row->size - 1 || is_whitescape(row->chars[cx + 1])) {
-                *new_cx = cx;
+                *new_cx = editor_row_char_start(row, cx);
                 *new_cy = cy;
                 return;
             }
@@ -138,7 +143,7 @@ void editor_get_next_word_end(EditorRow *row, int *new_cx, int *new_cy) {
     *new_cy = cy;
 }
 
-void editor_get_next_blank_line(EditorRow *row, int *new_cx, int *new_cy) {
+void editor_get_next_blank_line(EditorRow *row, ssize_t *new_cx, int *new_cy) {
     int cy = editor_state.cursor_y;
 
     // whether already starting on a blank line
@@ -153,7 +158,7 @@ void editor_get_next_blank_line(EditorRow *row, int *new_cx, int *new_cy) {
         }
 
         cy++;
-        row = &editor_state.rows[cy];
+        row = editor_line_tree_next(row);
 
         // if not already in blank segment and reached blank line
         if (!blank_segment && row->size == 0) {
@@ -167,7 +172,8 @@ void editor_get_next_blank_line(EditorRow *row, int *new_cx, int *new_cy) {
     }
 }
 
-void editor_get_previous_blank_line(EditorRow *row, int *new_cx, int *new_cy) {
+void editor_get_previous_blank_line(EditorRow *row, ssize_t *new_cx,
+                                    int *new_cy) {
     int cy = editor_state.cursor_y;
     bool blank_segment = row->size == 0;
 
@@ -179,7 +185,7 @@ void editor_get_previous_blank_line(EditorRow *row, int *new_cx, int *new_cy) {
         }
 
         cy--;
-        row = &editor_state.rows[cy];
+        row = editor_line_tree_prev(row);
 
         if (!blank_segment && row->size == 0) {
             *new_cx = 0;
@@ -1,137 +1,702 @@
+#define _GNU_SOURCE // memrchr()
+
 #include "operations.h"
 #include "a1.h"
+#include "file_io.h"
 #include "highlight.h"
+#include "input.h"
+#include "utf8.h"
+#include "util.h"
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
+// the row being typed into whose chars contain an open gap (insert mode only)
+static EditorRow *gap_row = NULL;
+// whether keys typed into the gap row are yet to update its multi-line
+// comment state, which is rescanned once before drawing rather than per key
+static bool gap_row_changed = false;
+
+// rows currently allocated, loaded into the rows tree or not
+static size_t live_rows = 0;
+
+// row buffers are kept inline in the row when they fit, else in the arena
+static void *editor_row_buffer_alloc(void *inline_buffer, size_t inline_size,
+                                     size_t size) {
+    if (size <= inline_size) { return inline_buffer; }
+    return editor_arena_alloc(editor_state.arena, size);
+}
+
+static void editor_row_buffer_free(void *buffer, const void *inline_buffer,
+                                   size_t size) {
+    if (buffer == inline_buffer) { return; }
+    editor_arena_free(editor_state.arena, buffer, size);
+}
+
+// only used to grow buffers, so an arena buffer is never moved back inline
+static void *editor_row_buffer_realloc(void *buffer, void *inline_buffer,
+                                       size_t inline_size, size_t old_size,
+                                       size_t new_size) {
+    if (buffer != inline_buffer) {
+        return editor_arena_realloc(editor_state.arena, buffer, old_size,
+                                    new_size);
+    }
+    if (new_size <= inline_size) { return buffer; }
+
+    void *new_buffer = editor_arena_alloc(editor_state.arena, new_size);
+    memcpy(new_buffer, buffer, MIN(old_size, new_size));
+    return new_buffer;
+}
+
+// copies viewed text into memory owned by the row so that it can be modified
+static void editor_row_own(EditorRow *row) {
+    if (row->capacity > 0) { return; }
+
+    // render may be sharing the viewed chars
+    editor_invalidate_row(row);
+
+    // inline chars are given the whole inline buffer to grow into
+    ssize_t capacity = row->size + 1;
+    if (capacity <= ROW_INLINE_SIZE) { capacity = ROW_INLINE_SIZE; }
+
+    char *chars = editor_row_buffer_alloc(
+        row->inline_chars, sizeof(row->inline_chars), capacity);
+    memcpy(chars, row->chars, row->size);
+    chars[row->size] = '\0';
+
+    row->chars = chars;
+    row->capacity = capacity;
+    row->gap_start = row->size;
+    row->gap_len = capacity - row->size - 1;
+}
+
+// moves gap so that it starts at col_idx, only shifting the chars in between
+static void editor_row_move_gap(EditorRow *row, ssize_t col_idx) {
+    if (col_idx < row->gap_start) {
+        memmove(&row->chars[col_idx + row->gap_len], &row->chars[col_idx],
+                row->gap_start - col_idx);
+    } else if (col_idx > row->gap_start) {
+        memmove(&row->chars[row->gap_start],
+                &row->chars[row->gap_start + row->gap_len],
+                col_idx - row->gap_start);
+    }
+    row->gap_start = col_idx;
+}
+
+// doubles capacity, keeping the chars after the gap at the end of the buffer
+static void editor_row_grow_gap(EditorRow *row) {
+    editor_invalidate_row(row); // chars are about to move
+
+    ssize_t old_capacity = row->capacity;
+    ssize_t tail_len = row->size - row->gap_start;
+
+    row->capacity = MAX(old_capacity * 2, 16);
+    row->chars = editor_row_buffer_realloc(
+        row->chars, row->inline_chars, sizeof(row->inline_chars), old_capacity,
+        row->capacity);
+
+    // +1 to include null character
+    memmove(&row->chars[row->capacity - tail_len - 1],
+            &row->chars[old_capacity - tail_len - 1], tail_len + 1);
+    row->gap_len = row->capacity - row->size - 1;
+}
+
+// ensures a flat row can hold size chars (and null character)
+static void editor_row_reserve(EditorRow *row, ssize_t size) {
+    if (size + 1 > row->capacity) {
+        editor_invalidate_row(row); // chars are about to move
+
+        ssize_t old_capacity = row->capacity;
+        row->capacity = MAX(row->capacity * 2, size + 1);
+        row->chars = editor_row_buffer_realloc(
+            row->chars, row->inline_chars, sizeof(row->inline_chars),
+            old_capacity, row->capacity);
+    }
+}
+
+void editor_close_row_gap(void) {
+    if (gap_row == NULL) { return; }
+
+    EditorRow *row = gap_row;
+    editor_row_move_gap(row, row->size);
+    row->chars[row->size] = '\0';
+    gap_row = NULL;
+
+    if (gap_row_changed) {
+        gap_row_changed = false;
+        editor_update_row(row);
+    }
+}
+
+void editor_update_gap_row(void) {
+    if (gap_row == NULL || !gap_row_changed) { return; }
+
+    gap_row_changed = false;
+    editor_update_row(gap_row);
+}
+
+// marks the gap row to be rebuilt after a key typed into it, indexing it in
+// chunks once long enough that the rescan before drawing would otherwise cover
+// the whole row rather than the chunk typed into
+static void editor_gap_row_changed(EditorRow *row) {
+    row->from_pack = false;
+    editor_invalidate_row(row);
+    editor_row_chunks_sized(row, TYPED_ROW_SIZE);
+    gap_row_changed = true;
+}
+
+static EditorRow *editor_create_row(const char *chars, size_t len) {
+    EditorRow *row = malloc(sizeof(EditorRow));
+    live_rows++;
+
+    row->leaf = NULL;
+    row->size = len;
+    row->capacity = 0;
+    row->gap_start = len;
+    row->gap_len = 0;
+    row->chars = (char *)chars;
+
+    row->render_size = 0;
+    row->render_start = 0;
+    row->render = NULL;
+    row->highlight = NULL;
+    row->highlight_count = 0;
+    row->render_stale = true;
+    row->hl_open_comment = false;
+    row->from_pack = false;
+    row->chunks = NULL;
+    row->glyphs = NULL;
+    row->glyph_count = -1;
+    row->ascii = false;
+
+    return row;
+}
+
+// links new rows into rows tree, then updates their multi-line comment state in
+// one pass (they are rendered and highlighted once drawn)
+static void editor_link_rows(int index, EditorRow **rows, int count) {
+    if (count == 0) { return; }
+
+    // inserted before updating as highlighting depends on neighbouring rows
+    editor_line_tree_insert_many(editor_state.rows, index, rows, count);
+
+    // start from the multi-line comment state the following row last saw, so
+    // that it is only re-highlighted if that state changes
+    EditorRow *prev_row = editor_line_tree_prev(rows[0]);
+    rows[count - 1]->hl_open_comment =
+        prev_row != NULL && prev_row->hl_open_comment;
+
+    editor_update_syntax_highlight_rows(rows[0], count);
+
+    editor_state.num_rows += count;
+    editor_state.modified = true;
+}
+
 void editor_insert_row(int index, const char *string, size_t len) {
+    const char *chars =
+        editor_piece_table_append(editor_state.piece_table, string, len);
+    editor_insert_row_view(index, chars, len);
+}
+
+void editor_insert_row_view(int index, const char *chars, size_t len) {
     if (index < 0 || index > editor_state.num_rows) { return; }
+    if (editor_state.num_rows == INT_MAX) { return; }
+
+    EditorRow *row = editor_create_row(chars, len);
+    editor_link_rows(index, &row, 1);
+}
+
+bool editor_insert_rows(int index, const char *text, size_t len) {
+    const char *chars =
+        editor_piece_table_append(editor_state.piece_table, text, len);
+    return editor_insert_rows_view(index, chars, len);
+}
+
+bool editor_insert_rows_view(int index, const char *text, size_t len) {
+    if (index < 0 || index > editor_state.num_rows) { return false; }
+
+    size_t capacity = 64;
+    int count = 0;
+    EditorRow **rows = malloc(capacity * sizeof(EditorRow *));
 
-    editor_state.rows = realloc(
-        editor_state.rows, sizeof(EditorRow) * (editor_state.num_rows + 1));
+    const char *line = text;
+    const char *end = text + len;
 
-    // shift every following row
-    memmove(&editor_state.rows[index + 1], &editor_state.rows[index],
-            sizeof(EditorRow) * (editor_state.num_rows - index));
+    while (line < end) {
+        // rows are indexed by int, unlike the text itself
+        if (count == INT_MAX - editor_state.num_rows) {
+            for (int i = 0; i < count; i++) {
+                editor_free_row(rows[i]);
+            }
+            free(rows);
+            return false;
+        }
+
+        const char *newline = memchr(line, '\n', end - line);
+        const char *line_end = newline ? newline : end;
+
+        // strip line-ending characters
+        size_t line_len = line_end - line;
+        while (line_len > 0 && line[line_len - 1] == '\r') {
+            line_len--;
+        }
+
+        if ((size_t)count == capacity) {
+            capacity *= 2;
+            rows = realloc(rows, capacity * sizeof(EditorRow *));
+        }
+        rows[count++] = editor_create_row(line, line_len);
+
+        line = line_end + 1;
+    }
+
+    editor_link_rows(index, rows, count);
+    free(rows);
+    return true;
+}
 
-    // shift indices of following rows
-    for (int i = index + 1; i <= editor_state.num_rows; i++) {
-        editor_state.rows[i].index++;
+EditorRow *editor_load_row(EditorLinePack *pack, int line) {
+    if (pack == NULL) {
+        size_t len;
+        const char *chars =
+            editor_line_index_line(editor_state.line_index, line, &len);
+        return editor_create_row(chars, len);
     }
 
-    editor_state.rows[index].index = index;
+    // the pack's text is only readable until another pack is read
+    size_t len;
+    const char *chars = editor_line_pack_line(pack, line, &len);
+    EditorRow *row = editor_create_row(chars, len);
+    editor_row_own(row);
+    row->from_pack = true;
+    return row;
+}
 
-    editor_state.rows[index].size = len;
-    editor_state.rows[index].chars = malloc(len + 1);
-    memcpy(editor_state.rows[index].chars, string, len);
-    editor_state.rows[index].chars[len] = '\0';
+void editor_append_unloaded_rows(int source_line, int count) {
+    if (count <= 0 || count > INT_MAX - editor_state.num_rows) { return; }
 
-    editor_state.rows[index].render_size = 0;
-    editor_state.rows[index].render = NULL;
-    editor_state.rows[index].highlight = NULL;
-    editor_state.rows[index].hl_open_comment = false;
+    editor_line_tree_append_unloaded(editor_state.rows, NULL, source_line,
+                                     count);
+    editor_state.num_rows += count;
+}
 
-    editor_update_row(&editor_state.rows[index]);
+bool editor_append_packed_rows(const char *text, size_t len) {
+    const char *end = text + len;
 
-    editor_state.num_rows++;
-    editor_state.modified = true;
+    while (text < end) {
+        // packs end after a newline, unless a line is longer than a pack
+        size_t pack_len = MIN(LINE_PACK_SIZE, (size_t)(end - text));
+        const char *newline = memrchr(text, '\n', pack_len);
+        if (newline == NULL) {
+            newline = memchr(text + pack_len, '\n', end - text - pack_len);
+        }
+        pack_len = newline != NULL ? (size_t)(newline - text) + 1
+                                   : (size_t)(end - text);
+
+        EditorLinePack *pack = editor_line_pack_create(text, pack_len);
+        int count = editor_line_pack_count(pack);
+        if (count > INT_MAX - editor_state.num_rows) {
+            editor_line_pack_release(pack);
+            return false;
+        }
+
+        editor_line_tree_append_unloaded(editor_state.rows, pack, 0, count);
+        editor_line_pack_release(pack);
+        editor_state.num_rows += count;
+        text += pack_len;
+    }
+
+    return true;
 }
 
-void editor_insert_char_in_row(EditorRow *row, int col_idx, int character) {
+const char *editor_unloaded_line(const EditorLineRun *run, int line,
+                                 size_t *len) {
+    if (run->pack != NULL) {
+        return editor_line_pack_line(run->pack, run->source_line + line, len);
+    }
+    return editor_line_index_line(editor_state.line_index,
+                                  run->source_line + line, len);
+}
+
+EditorRow *editor_get_row(int row_idx) {
+    return editor_line_tree_get(editor_state.rows, row_idx);
+}
+
+int editor_get_row_index(const EditorRow *row) {
+    return editor_line_tree_index_of(row);
+}
+
+void editor_insert_char_in_row(EditorRow *row, ssize_t col_idx,
+                               int character) {
     if (col_idx < 0 || col_idx > row->size) { col_idx = row->size; }
 
-    row->chars = realloc(row->chars, row->size + 2);
-    memmove(&row->chars[col_idx + 1], &row->chars[col_idx],
-            row->size - col_idx + 1);
-    row->size++;
-    row->chars[col_idx] = character;
-    editor_update_row(row);
+    if (row != gap_row) {
+        editor_close_row_gap();
+        editor_row_own(row);
+        gap_row = row;
+    }
+
+    char seq[UTF8_MAX_LEN];
+    int len = editor_utf8_encode(character, seq);
+
+    for (int i = 0; i < len; i++) {
+        if (row->gap_len == 0) { editor_row_grow_gap(row); }
+        editor_row_move_gap(row, col_idx + i);
+
+        row->chars[row->gap_start] = seq[i];
+        row->gap_start++;
+        row->gap_len--;
+        row->size++;
+        editor_row_chunks_insert(row, col_idx + i);
+    }
+    editor_gap_row_changed(row);
     editor_state.modified = true;
 }
 
-void editor_update_row(EditorRow *row) {
-    int tab_stop = editor_state.options.tab_stop;
-    int tabs = 0;
+// last column a long row is rendered to, a little past those on screen so
+// that tokens running past the screen are highlighted as a whole
+static ssize_t editor_row_render_end(const EditorRowChunks *chunks) {
+    return MIN(editor_row_chunks_width(chunks),
+               editor_state.col_scroll_offset + editor_state.screen_cols +
+                   ROW_CHUNK_LOOKAHEAD);
+}
+
+// writes the first count columns of render of char at idx, which takes width
+// columns
+static void editor_render_char(const EditorRow *row, ssize_t idx, int width,
+                               int count, char *render) {
+    if (count <= 0) { return; }
 
-    for (int i = 0; i < row->size; i++) {
-        if (row->chars[i] == TAB) { tabs++; }
+    char c = editor_row_char_at(row, idx);
+    if (!((unsigned char)c & 0x80)) {
+        // tabs are expanded to spaces
+        memset(render, c == TAB ? ' ' : c, count);
+        return;
     }
 
-    free(row->render);
-    row->render = malloc(row->size + (tabs * (tab_stop - 1)) + 1);
+    uint32_t code_point;
+    if (editor_row_decode(row, idx, &code_point) == 0 || code_point < 0xA0) {
+        render[0] = '?';
+        return;
+    }
 
-    int idx = 0;
-    for (int i = 0; i < row->size; i++) {
-        if (row->chars[i] == TAB) {
-            row->render[idx++] = ' ';
-            while (idx % tab_stop != 0) {
-                row->render[idx++] = ' ';
-            }
-        } else {
-            row->render[idx++] = row->chars[i];
+    render[0] = RENDER_GLYPH;
+    memset(&render[1], RENDER_GLYPH_CONT, MIN(width, count) - 1);
+}
+
+// renders long row from the start of the chunk containing the first column on
+// screen, so that only O(chunk) chars are read
+static void editor_build_row_render_window(EditorRow *row,
+                                           const EditorRowChunks *chunks) {
+    const EditorRowChunk *chunk = &chunks->chunks[editor_row_chunks_find_col(
+        chunks, editor_state.col_scroll_offset)];
+
+    ssize_t start = chunk->col;
+    ssize_t end = MAX(editor_row_render_end(chunks), start);
+
+    row->render_start = start;
+    row->render_size = end - start;
+    row->render = editor_row_buffer_alloc(
+        row->inline_render, sizeof(row->inline_render), row->render_size + 1);
+
+    ssize_t col = start;
+    ssize_t i = editor_row_chunk_first_char(row, chunk);
+    while (i < row->size && col < end) {
+        int len;
+        int width = editor_row_char_columns(row, i, col, &len);
+        editor_render_char(row, i, width, MIN(width, end - col),
+                           &row->render[col - start]);
+        col += width;
+        i += len;
+    }
+    col = MIN(col, end);
+    row->render[col - start] = '\0';
+}
+
+// copies len chars of row from idx to render, with invalid bytes as '?'
+static void editor_render_run(const EditorRow *row, ssize_t idx, ssize_t len,
+                              char *render) {
+    // chars either side of the gap
+    ssize_t before = MAX(MIN(row->gap_start - idx, len), 0);
+    memcpy(render, &row->chars[idx], before);
+    memcpy(&render[before], &row->chars[idx + before + row->gap_len],
+           len - before);
+
+    if (row->ascii) { return; }
+    for (ssize_t i = 0; i < len; i++) {
+        if ((unsigned char)render[i] & 0x80) { render[i] = '?'; }
+    }
+}
+
+// builds render, expanding tabs and multi-byte chars
+static void editor_build_row_render(EditorRow *row) {
+    EditorRowChunks *chunks = editor_row_chunks(row);
+    if (chunks != NULL) {
+        editor_build_row_render_window(row, chunks);
+        return;
+    }
+
+    editor_prepare_row_glyphs(row);
+    row->render_start = 0;
+    row->render_size = row->size;
+
+    // columns of chars following the last glyph match their bytes
+    if (row->glyph_count > 0) {
+        const EditorRowGlyph *last = &row->glyphs[row->glyph_count - 1];
+        row->render_size = last->col + last->width +
+                           (row->size - last->idx - last->len);
+    }
+
+    // render would be identical to chars (when not split by a gap)
+    if (row->glyph_count == 0 && row->ascii && row->gap_start == row->size) {
+        row->render = row->chars;
+        return;
+    }
+
+    // exact size needed, as buffers are freed by size
+    row->render = editor_row_buffer_alloc(
+        row->inline_render, sizeof(row->inline_render), row->render_size + 1);
+
+    ssize_t idx = 0;
+    for (int i = 0; i < row->glyph_count; i++) {
+        const EditorRowGlyph *glyph = &row->glyphs[i];
+        ssize_t col = glyph->col - (glyph->idx - idx);
+        editor_render_run(row, idx, glyph->idx - idx, &row->render[col]);
+        editor_render_char(row, glyph->idx, glyph->width, glyph->width,
+                           &row->render[glyph->col]);
+        idx = glyph->idx + glyph->len;
+    }
+    editor_render_run(row, idx, row->size - idx,
+                      &row->render[row->render_size - (row->size - idx)]);
+    row->render[row->render_size] = '\0';
+}
+
+void editor_invalidate_row(EditorRow *row) {
+    // glyphs are indexed separately from rendering, so may be held regardless
+    if (row->glyph_count > 0) {
+        editor_arena_free(editor_state.arena, row->glyphs,
+                          row->glyph_count * sizeof(EditorRowGlyph));
+    }
+    row->glyphs = NULL;
+    row->glyph_count = -1;
+
+    if (row->render_stale) { return; }
+
+    if (row->render != row->chars) {
+        editor_row_buffer_free(row->render, row->inline_render,
+                               row->render_size + 1);
+    }
+    editor_row_buffer_free(row->highlight, row->inline_highlight,
+                           row->highlight_count * sizeof(EditorHighlightSpan));
+
+    row->render = NULL;
+    row->highlight = NULL;
+    row->render_size = 0;
+    row->render_start = 0;
+    row->highlight_count = 0;
+    row->render_stale = true;
+}
+
+// whether render of long row no longer covers the columns on screen, having
+// been scrolled away from
+static bool editor_row_render_off_screen(const EditorRow *row) {
+    if (row->chunks == NULL) { return false; }
+
+    return row->render_start > editor_state.col_scroll_offset ||
+           row->render_start + row->render_size <
+               editor_row_render_end(row->chunks);
+}
+
+void editor_prepare_row(EditorRow *row) {
+    if (!row->render_stale) {
+        if (!editor_row_render_off_screen(row)) { return; }
+        editor_invalidate_row(row);
+    }
+
+    editor_build_row_render(row);
+
+    int count;
+    const EditorHighlightSpan *spans = editor_highlight_row(row, &count);
+    if (count > 0) {
+        size_t size = count * sizeof(EditorHighlightSpan);
+        row->highlight = editor_row_buffer_alloc(
+            row->inline_highlight, sizeof(row->inline_highlight), size);
+        memcpy(row->highlight, spans, size);
+    }
+    row->highlight_count = count;
+
+    row->render_stale = false;
+}
+
+// returns index of the first tab at or after idx in all-ASCII row, or -1
+static ssize_t editor_row_find_tab(const EditorRow *row, ssize_t idx) {
+    // chars either side of the gap
+    if (idx < row->gap_start) {
+        const char *tab = memchr(&row->chars[idx], TAB, row->gap_start - idx);
+        if (tab != NULL) { return tab - row->chars; }
+        idx = row->gap_start;
+    }
+
+    const char *after = &row->chars[row->gap_len];
+    const char *tab = memchr(&after[idx], TAB, row->size - idx);
+    return tab != NULL ? tab - after : -1;
+}
+
+// finds the first glyph at or after *idx, setting *idx to it and len to its
+// number of bytes, returns false if there is none
+static bool editor_row_find_glyph(const EditorRow *row, ssize_t *idx,
+                                  int *len) {
+    *len = 1;
+    if (row->ascii) {
+        *idx = editor_row_find_tab(row, *idx);
+        return *idx != -1;
+    }
+
+    for (ssize_t i = *idx; i < row->size; i++) {
+        char c = editor_row_char_at(row, i);
+        if (c == TAB) {
+            *idx = i;
+            return true;
+        }
+
+        // invalid bytes take a column each, as ASCII chars do
+        uint32_t code_point;
+        int seq_len;
+        if ((unsigned char)c & 0x80 &&
+            (seq_len = editor_row_decode(row, i, &code_point)) > 0) {
+            *idx = i;
+            *len = seq_len;
+            return true;
         }
     }
-    row->render[idx] = '\0';
-    row->render_size = idx;
+    *len = 0;
+    return false;
+}
+
+void editor_prepare_row_glyphs(EditorRow *row) {
+    if (row->glyph_count >= 0) { return; }
+
+    // chars either side of the gap
+    const char *after = &row->chars[row->gap_start + row->gap_len];
+    row->ascii = editor_utf8_is_ascii(row->chars, row->gap_start) &&
+                 editor_utf8_is_ascii(after, row->size - row->gap_start);
+
+    int count = 0;
+    int len;
+    for (ssize_t i = 0; editor_row_find_glyph(row, &i, &len); i += len) {
+        count++;
+    }
+
+    row->glyph_count = count;
+    if (count == 0) { return; }
+
+    row->glyphs =
+        editor_arena_alloc(editor_state.arena, count * sizeof(EditorRowGlyph));
+
+    ssize_t col = 0;
+    ssize_t prev_end = 0;
+    int glyph = 0;
+    for (ssize_t i = 0; glyph < count; i += len) {
+        editor_row_find_glyph(row, &i, &len);
+
+        // chars between glyphs take a column each
+        col += i - prev_end;
+        int width = editor_row_char_columns(row, i, col, &len);
+        row->glyphs[glyph++] = (EditorRowGlyph){
+            .idx = i, .col = col, .len = len, .width = width};
+        col += width;
+        prev_end = i + len;
+    }
+}
 
-    editor_update_syntax_highlight(row);
+void editor_update_row(EditorRow *row) {
+    row->from_pack = false;
+    editor_update_syntax_highlight(row); // also invalidates render
 }
 
 void editor_append_string_to_row(EditorRow *row, const char *string,
                                  size_t len) {
-    row->chars = realloc(row->chars, row->size + len + 1);
+    if (row == gap_row) { editor_close_row_gap(); }
+
+    editor_row_chunks_free(row);
+
+    editor_row_own(row);
+    editor_row_reserve(row, row->size + len);
     memcpy(&row->chars[row->size], string, len);
     row->size += len;
     row->chars[row->size] = '\0';
+    row->gap_start = row->size;
+    row->gap_len = row->capacity - row->size - 1;
     editor_update_row(row);
     editor_state.modified = true;
 }
 
-void editor_invert_letter_at_row(EditorRow *row, int col_idx) {
+void editor_invert_letter_at_row(EditorRow *row, ssize_t col_idx) {
+    editor_row_own(row);
+
     char c = row->chars[col_idx];
 
     // if uppercase or lower case letter
     if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
         row->chars[col_idx] ^= 0x20; // flip sixth bit to toggle case
     }
+    editor_row_chunks_replace(row, col_idx);
     editor_update_row(row);
 }
 
 void editor_clear_row(EditorRow *row) {
-    row->chars = realloc(row->chars, sizeof(char));
+    if (row == gap_row) {
+        gap_row = NULL;
+        gap_row_changed = false;
+    }
+
+    editor_row_chunks_free(row);
+    editor_row_own(row);
     row->size = 0;
     row->chars[0] = '\0';
+    row->gap_start = 0;
+    row->gap_len = row->capacity - 1;
     editor_update_row(row);
     editor_state.modified = true;
 }
 
 int editor_auto_indent_row(EditorRow *row) {
-    if (row->index == 0) { return 0; }
-
-    EditorRow *row_above = &editor_state.rows[row->index - 1];
-    if (row_above->render_size == 0) { return 0; }
+    EditorRow *row_above = editor_line_tree_prev(row);
+    if (row_above == NULL) { return 0; }
 
     char buffer[256] = {0};
 
+    // indentation is measured from chars, as a long row is only rendered
+    // around the columns on screen
+    int tab_stop = editor_state.options.tab_stop;
+    ssize_t indent = 0;
     bool only_spaces = true;
 
-    for (int i = 0; i < row_above->render_size; i++) {
-        if (row_above->render[i] != SPACE) {
+    for (ssize_t i = 0; i < row_above->size; i++) {
+        char c = editor_row_char_at(row_above, i);
+        if (c == TAB) {
+            indent += tab_stop - indent % tab_stop;
+        } else if (c == SPACE) {
+            indent++;
+        } else {
             only_spaces = false;
             break;
         }
+    }
+
+    // if line above only contains spaces, do not further indent
+    if (only_spaces) { return 0; }
 
+    indent = MIN(indent, (ssize_t)sizeof(buffer) - 1);
+    for (ssize_t i = 0; i < indent; i++) {
         if (editor_state.options.tab_character) {
-            buffer[i / editor_state.options.tab_stop] = '\t';
-            i += editor_state.options.tab_stop - 1;
+            buffer[i / tab_stop] = '\t';
+            i += tab_stop - 1;
         } else {
             buffer[i] = ' ';
         }
     }
 
-    // if line above only contains spaces, do not further indent
-    if (only_spaces) { return 0; }
-
     int len = strlen(buffer);
     editor_append_string_to_row(row, buffer, len);
     return len;
@@ -140,49 +705,503 @@ int editor_auto_indent_row(EditorRow *row) {
 void editor_del_row(int row_idx) {
     if (row_idx < 0 || row_idx >= editor_state.num_rows) { return; }
 
-    EditorRow *row = &editor_state.rows[row_idx];
-    free(row->render);
-    free(row->chars);
-    free(row->highlight);
+    EditorRow *row = editor_line_tree_remove(editor_state.rows, row_idx);
+    editor_free_row(row);
 
-    // shift following rows
-    memmove(&editor_state.rows[row_idx], &editor_state.rows[row_idx + 1],
-            sizeof(EditorRow) * (editor_state.num_rows - row_idx - 1));
+    editor_state.num_rows--;
+    editor_state.modified = true;
+}
 
-    // update indices of following rows
-    for (int i = row_idx; i < editor_state.num_rows - 1; i++) {
-        editor_state.rows[i].index--;
+void editor_free_row(EditorRow *row) {
+    if (row == gap_row) {
+        gap_row = NULL;
+        gap_row_changed = false;
     }
 
-    editor_state.num_rows--;
-    editor_state.modified = true;
+    editor_invalidate_row(row);
+    editor_row_chunks_free(row);
+    if (row->capacity > 0) {
+        editor_row_buffer_free(row->chars, row->inline_chars, row->capacity);
+    }
+    free(row);
+    live_rows--;
+}
+
+void editor_free_rows(void) {
+    // walked by runs so that unloaded rows are not loaded just to be freed
+    EditorLineRun run;
+    bool more = editor_line_tree_first_run(editor_state.rows, &run);
+    while (more) {
+        EditorRow *row = run.row;
+        more = editor_line_tree_next_run(&run);
+        if (row != NULL) { editor_free_row(row); }
+    }
+
+    editor_line_tree_destroy(editor_state.rows);
+    editor_state.rows = NULL;
+    editor_state.num_rows = 0;
+}
+
+size_t editor_compact_rows(void) {
+    EditorArena *arena = editor_state.arena;
+    if (!editor_arena_compact_begin(arena)) { return 0; }
+
+    // unloaded rows have no buffers to move
+    EditorLineRun run;
+    for (bool more = editor_line_tree_first_run(editor_state.rows, &run); more;
+         more = editor_line_tree_next_run(&run)) {
+        EditorRow *row = run.row;
+        if (row == NULL) { continue; }
+
+        bool render_shared = row->render == row->chars;
+
+        // inline buffers are not in the arena
+        if (row->capacity > 0 && row->chars != row->inline_chars) {
+            row->chars =
+                editor_arena_relocate(arena, row->chars, row->capacity);
+        }
+        if (render_shared) {
+            row->render = row->chars;
+        } else if (row->render != row->inline_render) {
+            row->render = editor_arena_relocate(arena, row->render,
+                                                row->render_size + 1);
+        }
+        if (row->highlight != row->inline_highlight) {
+            row->highlight = editor_arena_relocate(
+                arena, row->highlight,
+                row->highlight_count * sizeof(EditorHighlightSpan));
+        }
+        if (row->glyph_count > 0) {
+            row->glyphs = editor_arena_relocate(
+                arena, row->glyphs, row->glyph_count * sizeof(EditorRowGlyph));
+        }
+    }
+
+    return editor_arena_compact_end(arena);
+}
+
+size_t editor_rows_memory(void) {
+    EditorArenaStats stats;
+    editor_arena_get_stats(editor_state.arena, &stats);
+
+    // each row also takes a slot of a leaf of the rows tree
+    return live_rows * (sizeof(EditorRow) + sizeof(EditorRow *)) +
+           stats.used_bytes + stats.large_bytes + editor_row_chunks_memory();
+}
+
+// returns the line of the mapped file from which leaf's rows can be loaded
+// again, or -1 if any of them is modified or is not the next line of the file
+static int editor_leaf_source_line(EditorLineNode *leaf) {
+    EditorLineIndex *index = editor_state.line_index;
+    if (index == NULL) { return -1; }
+
+    int count;
+    EditorRow **rows = editor_line_node_rows(leaf, &count);
+    if (count == 0) { return -1; }
+
+    int first = editor_line_index_find(index, rows[0]->chars);
+    if (first < 0 || count > editor_line_index_count(index, NULL) - first) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        size_t len;
+        const char *chars = editor_line_index_line(index, first + i, &len);
+        if (rows[i]->capacity > 0 || rows[i]->chars != chars ||
+            rows[i]->size != (ssize_t)len) {
+            return -1;
+        }
+    }
+
+    return first;
+}
+
+// returns pack of the text of leaf's rows, or NULL unless every one of them is
+// an unchanged copy of a packed line
+static EditorLinePack *editor_pack_leaf(EditorLineNode *leaf) {
+    int count;
+    EditorRow **rows = editor_line_node_rows(leaf, &count);
+
+    size_t len = 0;
+    for (int i = 0; i < count; i++) {
+        if (!rows[i]->from_pack) { return NULL; }
+        len += rows[i]->size + 1; // +1 for newline character
+    }
+
+    char *text = malloc(len);
+    if (text == NULL) { return NULL; }
+
+    char *p = text;
+    for (int i = 0; i < count; i++) {
+        memcpy(p, rows[i]->chars, rows[i]->size);
+        p += rows[i]->size;
+        *p++ = '\n';
+    }
+
+    EditorLinePack *pack = editor_line_pack_create(text, len);
+    free(text);
+    return pack;
+}
+
+void editor_limit_rows_memory(void) {
+    size_t limit = editor_state.options.memory_limit;
+    if (limit == 0 || editor_state.rows == NULL) { return; }
+    if (editor_rows_memory() <= limit) { return; }
+
+    // going well below the limit leaves room to page on for a while before
+    // having to look for rows to free again
+    size_t target = limit - limit / 4;
+
+    int count;
+    EditorLineNode **leaves =
+        editor_line_tree_loaded_leaves(editor_state.rows, &count);
+
+    for (int i = 0; i < count && editor_rows_memory() > target; i++) {
+        // leaves are least recently used first, so the rest are on screen
+        if (editor_line_node_used_since_tick(leaves[i])) { break; }
+
+        int row_count;
+        EditorRow **rows = editor_line_node_rows(leaves[i], &row_count);
+        int source_line = editor_leaf_source_line(leaves[i]);
+        EditorLinePack *pack =
+            source_line < 0 ? editor_pack_leaf(leaves[i]) : NULL;
+
+        if (source_line >= 0 || pack != NULL) {
+            for (int j = 0; j < row_count; j++) {
+                editor_free_row(rows[j]);
+            }
+            editor_line_tree_unload(leaves[i], pack, MAX(source_line, 0));
+            if (pack != NULL) { editor_line_pack_release(pack); }
+        } else {
+            // modified rows are kept, only what is rebuilt when drawn goes
+            for (int j = 0; j < row_count; j++) {
+                editor_invalidate_row(rows[j]);
+            }
+        }
+    }
+
+    free(leaves);
 }
 
-void editor_del_char_at_row(EditorRow *row, int col_idx) {
+void editor_del_char_at_row(EditorRow *row, ssize_t col_idx) {
     if (col_idx < 0 || col_idx >= row->size) { return; }
 
-    memmove(&row->chars[col_idx], &row->chars[col_idx + 1],
-            row->size - col_idx);
-    row->size--;
-    editor_update_row(row);
+    // a multi-byte char is deleted whole, along with combining chars drawn
+    // with it
+    ssize_t len = editor_row_next_char(row, col_idx) - col_idx;
+
+    for (ssize_t i = 0; i < len; i++) {
+        // when typing, deleted char is absorbed into the gap instead of
+        // shifting the rest of the row
+        if (row == gap_row) {
+            editor_row_move_gap(row, col_idx);
+        } else {
+            editor_row_own(row);
+            memmove(&row->chars[col_idx], &row->chars[col_idx + 1],
+                    row->size - col_idx);
+            row->gap_start--;
+        }
+        row->gap_len++;
+        row->size--;
+        editor_row_chunks_delete(row, col_idx);
+    }
+    if (row == gap_row) {
+        editor_gap_row_changed(row);
+    } else {
+        editor_update_row(row);
+    }
     editor_state.modified = true;
 }
 
 void editor_del_to_previous_row(int row_idx) {
     if (row_idx == 0) { return; }
 
-    EditorRow *row = &editor_state.rows[row_idx];
+    editor_close_row_gap();
 
-    editor_append_string_to_row(row - 1, row->chars, row->size);
+    EditorRow *row = editor_get_row(row_idx);
+
+    editor_append_string_to_row(editor_line_tree_prev(row), row->chars,
+                                row->size);
     editor_del_row(row_idx);
 }
 
-void editor_del_to_end_of_row(EditorRow *row, int col_idx) {
+void editor_del_to_end_of_row(EditorRow *row, ssize_t col_idx) {
     if (col_idx < 0 || col_idx >= row->size) { return; }
 
-    row->chars = realloc(row->chars, col_idx + 1);
+    if (row == gap_row) { editor_close_row_gap(); }
+
+    editor_row_chunks_free(row);
     row->size = col_idx;
-    row->chars[row->size] = '\0';
+    row->gap_start = row->size;
+
+    // a view can simply be shortened
+    if (row->capacity > 0) {
+        row->chars[row->size] = '\0';
+        row->gap_len = row->capacity - row->size - 1;
+    }
     editor_update_row(row);
     editor_state.modified = true;
 }
+
+void editor_rebase_row(EditorRow *row, const char *chars) {
+    if (row == gap_row) { editor_close_row_gap(); }
+    // text is identical, so render and highlight stay valid
+    if (row->render == row->chars) { row->render = (char *)chars; }
+    if (row->capacity > 0) {
+        editor_row_buffer_free(row->chars, row->inline_chars, row->capacity);
+    }
+
+    row->chars = (char *)chars;
+    row->capacity = 0;
+    row->gap_start = row->size;
+    row->gap_len = 0;
+    row->from_pack = false;
+}
+
+// an index of a long row is updated a byte at a time, so is dropped (to be
+// rebuilt when next needed) when more than a char changes at once
+static bool editor_row_chunks_follow(size_t len) {
+    return len <= UTF8_MAX_LEN;
+}
+
+// inserts len bytes of text (without newlines) into row at col_idx
+static void editor_row_insert_text(EditorRow *row, ssize_t col_idx,
+                                   const char *text, size_t len) {
+    if (row == gap_row) { editor_close_row_gap(); }
+
+    editor_row_own(row);
+    editor_row_reserve(row, row->size + len);
+
+    bool follow = editor_row_chunks_follow(len);
+    if (!follow) { editor_row_chunks_free(row); }
+
+    for (size_t done = 0; done < len;) {
+        size_t n = follow ? 1 : len;
+        ssize_t at = col_idx + done;
+
+        // +1 to include null character
+        memmove(&row->chars[at + n], &row->chars[at], row->size - at + 1);
+        memcpy(&row->chars[at], &text[done], n);
+        row->size += n;
+        row->gap_start = row->size;
+        row->gap_len = row->capacity - row->size - 1;
+
+        if (follow) { editor_row_chunks_insert(row, at); }
+        done += n;
+    }
+    editor_update_row(row);
+    editor_state.modified = true;
+}
+
+// deletes len bytes of row at col_idx
+static void editor_row_delete_text(EditorRow *row, ssize_t col_idx,
+                                   size_t len) {
+    if (row == gap_row) { editor_close_row_gap(); }
+
+    editor_row_own(row);
+
+    bool follow = editor_row_chunks_follow(len);
+    if (!follow) { editor_row_chunks_free(row); }
+
+    for (size_t done = 0; done < len;) {
+        size_t n = follow ? 1 : len;
+
+        memmove(&row->chars[col_idx], &row->chars[col_idx + n],
+                row->size - col_idx - n + 1);
+        row->size -= n;
+        row->gap_start = row->size;
+        row->gap_len = row->capacity - row->size - 1;
+
+        if (follow) { editor_row_chunks_delete(row, col_idx); }
+        done += n;
+    }
+    editor_update_row(row);
+    editor_state.modified = true;
+}
+
+// removes len bytes of text at (col_idx, row_idx), joining the rows it spans
+static void editor_remove_text(int row_idx, ssize_t col_idx, size_t len) {
+    EditorRow *row = editor_get_row(row_idx);
+
+    // find end of text, which may be on a later row
+    int end_idx = row_idx;
+    ssize_t end_col = col_idx;
+    EditorRow *end_row = row;
+    while (len > (size_t)(end_row->size - end_col)) {
+        len -= end_row->size - end_col + 1; // +1 for newline
+        end_row = editor_get_row(++end_idx);
+        end_col = 0;
+    }
+    end_col += len;
+
+    if (end_idx == row_idx) {
+        if (end_col > col_idx) {
+            editor_row_delete_text(row, col_idx, end_col - col_idx);
+        }
+        return;
+    }
+
+    // the rest of the last row is joined onto the first
+    editor_close_row_gap();
+    editor_del_to_end_of_row(row, col_idx);
+    if (end_col < end_row->size) {
+        editor_append_string_to_row(row, &end_row->chars[end_col],
+                                    end_row->size - end_col);
+    }
+    for (int i = end_idx; i > row_idx; i--) {
+        editor_del_row(i);
+    }
+}
+
+// inserts text at (col_idx, row_idx), splitting the row at each newline
+static void editor_add_text(int row_idx, ssize_t col_idx, const char *text,
+                            size_t len) {
+    EditorRow *row = editor_get_row(row_idx);
+    const char *end = text + len;
+    const char *newline = memchr(text, '\n', len);
+
+    if (newline == NULL) {
+        if (len > 0) { editor_row_insert_text(row, col_idx, text, len); }
+        return;
+    }
+
+    // the rest of the row follows the last line of text
+    editor_close_row_gap();
+    size_t tail_len = row->size - col_idx;
+    char *tail = malloc(tail_len + 1);
+    memcpy(tail, &row->chars[col_idx], tail_len);
+
+    editor_del_to_end_of_row(row, col_idx);
+    if (newline > text) {
+        editor_row_insert_text(row, col_idx, text, newline - text);
+    }
+
+    const char *line = newline + 1;
+    while ((newline = memchr(line, '\n', end - line)) != NULL) {
+        editor_insert_row(++row_idx, line, newline - line);
+        line = newline + 1;
+    }
+    editor_insert_row(++row_idx, line, end - line);
+
+    if (tail_len > 0) {
+        editor_append_string_to_row(editor_get_row(row_idx), tail, tail_len);
+    }
+    free(tail);
+}
+
+void editor_replace_text(int row_idx, ssize_t col_idx, size_t removed_len,
+                         const char *text, size_t len) {
+    if (removed_len > 0) { editor_remove_text(row_idx, col_idx, removed_len); }
+    editor_add_text(row_idx, col_idx, text, len);
+}
+
+// copies len bytes of text at (col_idx, row_idx) to buf
+static void editor_copy_text(int row_idx, ssize_t col_idx, size_t len,
+                             char *buf) {
+    EditorRow *row = editor_get_row(row_idx);
+
+    for (size_t i = 0; i < len; i++) {
+        if (col_idx == row->size) {
+            buf[i] = '\n';
+            row = editor_get_row(++row_idx);
+            col_idx = 0;
+        } else {
+            buf[i] = editor_row_char_at(row, col_idx++);
+        }
+    }
+}
+
+// returns whether the len bytes of text at (col_idx, row_idx) are text
+static bool editor_text_matches(int row_idx, ssize_t col_idx,
+                                const char *text, size_t len) {
+    if (row_idx < 0 || row_idx >= editor_state.num_rows) { return false; }
+    EditorRow *row = editor_get_row(row_idx);
+    if (col_idx < 0 || col_idx > row->size) { return false; }
+
+    for (size_t i = 0; i < len; i++) {
+        if (col_idx == row->size) {
+            if (text[i] != '\n' || row_idx + 1 >= editor_state.num_rows) {
+                return false;
+            }
+            row = editor_get_row(++row_idx);
+            col_idx = 0;
+        } else if (editor_row_char_at(row, col_idx++) != text[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// records action, with its text read from the rows (from before the edit for
+// removed text, after it for inserted text)
+static void editor_record_text(EditorActionType type, int row_idx,
+                               ssize_t col_idx, size_t removed_len,
+                               size_t inserted_len) {
+    size_t len = removed_len + inserted_len;
+    if (len == 0) { return; }
+
+    // keystrokes are recorded without allocating
+    char buf[64];
+    char *text = len <= sizeof(buf) ? buf : malloc(len);
+    editor_copy_text(row_idx, col_idx, len, text);
+
+    EditorAction action = {.type = type,
+                           .y = row_idx,
+                           .x = col_idx,
+                           .removed = text,
+                           .removed_len = removed_len,
+                           .inserted = text,
+                           .inserted_len = inserted_len};
+    editor_record_action(editor_state.action_history, &action);
+    if (text != buf) { free(text); }
+}
+
+void editor_record_delete(EditorActionType type, int row_idx, ssize_t col_idx,
+                          size_t len) {
+    editor_record_text(type, row_idx, col_idx, len, 0);
+}
+
+void editor_record_insert(EditorActionType type, int row_idx, ssize_t col_idx,
+                          size_t len) {
+    editor_record_text(type, row_idx, col_idx, 0, len);
+}
+
+void editor_record_replace(EditorActionType type, int row_idx,
+                           ssize_t col_idx, char c) {
+    char removed = editor_row_char_at(editor_get_row(row_idx), col_idx);
+
+    EditorAction action = {.type = type,
+                           .y = row_idx,
+                           .x = col_idx,
+                           .removed = &removed,
+                           .removed_len = 1,
+                           .inserted = &c,
+                           .inserted_len = 1};
+    editor_record_action(editor_state.action_history, &action);
+}
+
+bool editor_apply_action(const EditorAction *action) {
+    // actions restored from the journal may reach rows not yet loaded
+    int last_row = action->y;
+    const char *end = action->removed + action->removed_len;
+    for (const char *p = action->removed;
+         p < end && (p = memchr(p, '\n', end - p)) != NULL; p++) {
+        last_row++;
+    }
+    if (last_row >= editor_state.num_rows) { editor_finish_loading(); }
+
+    // the log may not be of this text, if restored from the journal of a file
+    // changed in a way its identity misses
+    if (!editor_text_matches(action->y, action->x, action->removed,
+                             action->removed_len)) {
+        return false;
+    }
+
+    editor_replace_text(action->y, action->x, action->removed_len,
+                        action->inserted, action->inserted_len);
+
+    editor_set_cursor_y(action->y);
+    EditorRow *row = editor_get_row(action->y);
+    editor_set_cursor_x(MIN(action->x, editor_row_prev_char(row, row->size)));
+    return true;
+}
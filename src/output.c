@@ -2,10 +2,13 @@
 
 #include "output.h"
 #include "a1.h"
+#include "file_io.h"
 #include "highlight.h"
 #include "input.h"
 #include "modes.h"
+#include "operations.h"
 #include "structures.h"
+#include "utf8.h"
 #include "util.h"
 #include "welcome_logo.h"
 #include <ctype.h>
@@ -16,18 +19,30 @@
 
 static void editor_scroll_render_update(void) {
     int y_position;
+    ssize_t x_position;
 
     // update render_x and get y_position based on mode
     if (editor_state.mode == &find_mode) {
         FindMatch *fm = &editor_state.find_state
                              .matches[editor_state.find_state.match_index];
-        editor_state.render_x =
-            editor_row_cx_to_rx(&editor_state.rows[fm->row], fm->col);
         y_position = fm->row;
+        x_position = fm->col;
     } else {
-        editor_state.render_x = editor_row_cx_to_rx(
-            &editor_state.rows[editor_state.cursor_y], editor_state.cursor_x);
         y_position = editor_state.cursor_y;
+        x_position = editor_state.cursor_x;
+    }
+
+    EditorRow *row = editor_get_row(y_position);
+    editor_state.render_x = editor_row_cx_to_rx(row, x_position);
+
+    // a wide char is scrolled into view whole
+    ssize_t last_x = editor_state.render_x;
+    if (row != NULL && x_position < row->size &&
+        editor_row_char_at(row, x_position) != TAB) {
+        int len;
+        int width = editor_row_char_columns(row, x_position,
+                                            editor_state.render_x, &len);
+        last_x += MAX(width - 1, 0);
     }
 
     // if scrolled up
@@ -48,12 +63,11 @@ static void editor_scroll_render_update(void) {
     }
 
     // if scrolled right
-    if (editor_state.render_x >=
-        editor_state.col_scroll_offset +
-            (editor_state.screen_cols - editor_state.num_col_width)) {
+    if (last_x >= editor_state.col_scroll_offset +
+                      (editor_state.screen_cols - editor_state.num_col_width)) {
         editor_state.col_scroll_offset =
-            editor_state.render_x -
-            (editor_state.screen_cols - editor_state.num_col_width) + 1;
+            last_x - (editor_state.screen_cols - editor_state.num_col_width) +
+            1;
     }
 }
 
@@ -67,7 +81,7 @@ static void editor_add_row_end(AppendBuffer *ab) {
 }
 
 // utility function for editor_draw_rows()
-static bool editor_at_block_cursor(int cur_row, int cur_col) {
+static bool editor_at_block_cursor(int cur_row, ssize_t cur_col) {
     bool at_row = false;
     bool at_col = false;
 
@@ -83,18 +97,135 @@ static bool editor_at_block_cursor(int cur_row, int cur_col) {
     return at_row && at_col;
 }
 
+// utility function for editor_append_render()
+// draws columns [x, end) of row char by char from chars, for runs with
+// multi-byte chars (whose render only marks their columns)
+static void editor_append_row_chars(AppendBuffer *ab, EditorRow *row,
+                                    ssize_t x, ssize_t end) {
+    ssize_t idx = editor_row_rx_to_cx(row, x);
+    ssize_t col = editor_row_cx_to_rx(row, idx);
+
+    while (col < end && idx < row->size) {
+        int len;
+        int width = editor_row_char_columns(row, idx, col, &len);
+        ssize_t next = editor_row_next_char(row, idx);
+        char c = editor_row_char_at(row, idx);
+
+        uint32_t code_point = (unsigned char)c;
+        if ((unsigned char)c & 0x80 &&
+            editor_row_decode(row, idx, &code_point) == 0) {
+            code_point = 0; // invalid bytes are drawn as control chars are
+        }
+
+        if (col < x || col + width > end) {
+            // char cut by the edge of the run, drawn as the spaces visible
+            for (ssize_t i = MAX(col, x); i < MIN(col + width, end); i++) {
+                ab_append(ab, " ", 1);
+            }
+        } else if (c == TAB) {
+            for (int i = 0; i < width; i++) {
+                ab_append(ab, " ", 1);
+            }
+        } else if (!editor_utf8_is_printable(code_point)) {
+            ab_append(ab, "?", 1);
+        } else {
+            // combining chars are drawn along with the char before them
+            for (ssize_t i = idx; i < next; i++) {
+                char byte = editor_row_char_at(row, i);
+                ab_append(ab, &byte, 1);
+            }
+        }
+
+        col += width;
+        idx = next;
+    }
+}
+
+// utility function for editor_draw_rows()
+// draws columns [x, x + len) of row, if control character, just draw '?'
+static void editor_append_render(AppendBuffer *ab, EditorRow *row, ssize_t x,
+                                 ssize_t len) {
+    const char *text = &row->render[x - row->render_start];
+    ssize_t start = 0;
+    for (ssize_t i = 0; i < len; i++) {
+        if ((unsigned char)text[i] & 0x80) {
+            editor_append_row_chars(ab, row, x, x + len);
+            return;
+        }
+    }
+
+    for (ssize_t i = 0; i < len; i++) {
+        if (iscntrl((unsigned char)text[i])) {
+            ab_append(ab, &text[start], i - start);
+            ab_append(ab, "?", 1);
+            start = i + 1;
+        }
+    }
+    ab_append(ab, &text[start], len - start);
+}
+
+// returns columns taken by char rendered at column x of row
+static ssize_t editor_render_width(const EditorRow *row, ssize_t x) {
+    ssize_t end = x + 1;
+    while (end < row->render_start + row->render_size &&
+           row->render[end - row->render_start] == RENDER_GLYPH_CONT) {
+        end++;
+    }
+    return end - x;
+}
+
+// returns index of first find match at or after row_index
+static int editor_find_match_from(int row_index) {
+    EditorFindState *fs = &editor_state.find_state;
+    int low = 0;
+    int high = fs->matches_count;
+
+    // matches are ordered by row
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (fs->matches[mid].row < row_index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// utility function for editor_draw_rows()
+// gives the rendered columns [*start, *end) of the next find match on row,
+// starting at *match_index, returns false if there is none
+static bool editor_next_row_match(EditorRow *row, int row_index,
+                                  int *match_index, ssize_t *start,
+                                  ssize_t *end) {
+    EditorFindState *fs = &editor_state.find_state;
+    if (*match_index >= fs->matches_count ||
+        fs->matches[*match_index].row != row_index) {
+        return false;
+    }
+
+    // match may include tabs, so convert both ends
+    FindMatch *match = &fs->matches[*match_index];
+    *start = editor_row_cx_to_rx(row, match->col);
+    *end = editor_row_cx_to_rx(row, match->col + strlen(fs->string));
+    (*match_index)++;
+    return true;
+}
+
 static void editor_draw_rows(AppendBuffer *ab) {
     char esc_seq_buf[15];
 
     bool block_cursor =
         editor_state.mode == &normal_mode || editor_state.mode == &find_mode;
 
+    bool find_mode_active = editor_state.mode == &find_mode;
+
     for (int y = 0; y < editor_state.screen_rows; y++) {
         int row_index = y + editor_state.row_scroll_offset;
-        EditorRow *row = &editor_state.rows[row_index];
+        EditorRow *row = editor_get_row(row_index);
 
         // if past text buffer, fill lines below with '~'
-        if (row_index >= editor_state.num_rows) {
+        if (row == NULL) {
             ab_append(ab, "~", 1);
             editor_add_row_end(ab);
             continue;
@@ -112,7 +243,22 @@ static void editor_draw_rows(AppendBuffer *ab) {
             ab_append(ab, "\x1b[22m", 5); // un-dim (normal intensity)
         }
 
-        int line_len = row->render_size - editor_state.col_scroll_offset;
+        // only rows drawn are rendered and highlighted
+        editor_prepare_row(row);
+
+        // find matches are drawn over syntax highlighting
+        int match_index = 0;
+        ssize_t match_start = 0, match_end = 0;
+        bool row_match = false;
+        if (find_mode_active) {
+            match_index = editor_find_match_from(row_index);
+            row_match = editor_next_row_match(row, row_index, &match_index,
+                                              &match_start, &match_end);
+        }
+
+        // render of a long row covers the columns on screen, from render_start
+        ssize_t line_len = row->render_start + row->render_size -
+                           editor_state.col_scroll_offset;
 
         // fit line to screen
         line_len = MIN(line_len,
@@ -130,13 +276,59 @@ static void editor_draw_rows(AppendBuffer *ab) {
             }
         }
 
+        ssize_t cursor_col = -1;
+        if (block_cursor &&
+            editor_at_block_cursor(row_index, editor_state.render_x)) {
+            cursor_col = editor_state.render_x;
+        }
+
         EditorHighlight cur_hl = HL_NORMAL;
+        int span_index = 0;
+        ssize_t x = editor_state.col_scroll_offset;
+        ssize_t line_end = x + line_len;
+
+        // drawn in runs of columns sharing a highlight
+        while (x < line_end) {
+            while (span_index < row->highlight_count &&
+                   row->highlight[span_index].start +
+                           row->highlight[span_index].len <=
+                       x) {
+                span_index++;
+            }
 
-        for (int x = 0; x < line_len; x++) {
-            int col_index = editor_state.col_scroll_offset + x;
-            char *draw_str = &row->render[col_index];
+            EditorHighlight next_hl = HL_NORMAL;
+            ssize_t run_end = line_end;
+
+            if (span_index < row->highlight_count) {
+                EditorHighlightSpan *span = &row->highlight[span_index];
+                if (span->start <= x) {
+                    next_hl = span->highlight;
+                    run_end = MIN(run_end, span->start + span->len);
+                } else {
+                    run_end = MIN(run_end, span->start);
+                }
+            }
 
-            EditorHighlight next_hl = row->highlight[col_index];
+            while (row_match && x >= match_end) {
+                row_match = editor_next_row_match(row, row_index, &match_index,
+                                                  &match_start, &match_end);
+            }
+            if (row_match) {
+                if (x >= match_start) {
+                    next_hl = HL_MATCH;
+                    run_end = MIN(run_end, match_end);
+                } else {
+                    run_end = MIN(run_end, match_start);
+                }
+            }
+
+            // block cursor is drawn as a run of its own
+            bool at_cursor = x == cursor_col;
+            if (at_cursor) {
+                run_end = MIN(x + editor_render_width(row, x), line_end);
+            } else if (cursor_col > x) {
+                run_end = MIN(run_end, cursor_col);
+            }
 
             // if different highlight, add escape sequence
             // (resets before)
@@ -148,16 +340,77 @@ static void editor_draw_rows(AppendBuffer *ab) {
                 cur_hl = next_hl;
             }
 
-            // if control character, just draw '?'
-            if (iscntrl(*draw_str)) { draw_str = "?"; }
-
             // block cursor invert
-            if (block_cursor && editor_at_block_cursor(row_index, col_index)) {
+            if (at_cursor) {
                 ab_append(ab, "\x1b[7m", 4); // invert
-                ab_append(ab, draw_str, 1);
+                editor_append_render(ab, row, x, run_end - x);
                 ab_append(ab, "\x1b[27m", 5); // not invert
             } else {
-                ab_append(ab, draw_str, 1);
+                editor_append_render(ab, row, x, run_end - x);
+            }
+
+            x = run_end;
+        }
+        editor_add_row_end(ab);
+    }
+}
+
+// keeps the hex view's cursor on screen
+static void editor_hex_scroll_update(EditorHexView *view) {
+    size_t line = view->cursor / HEX_VIEW_LINE_BYTES;
+    size_t screen_rows = MAX(editor_state.screen_rows, 1);
+
+    if (line < view->scroll_line) { view->scroll_line = line; }
+    if (line >= view->scroll_line + screen_rows) {
+        view->scroll_line = line - screen_rows + 1;
+    }
+}
+
+// utility function for editor_draw_hex_rows(), appends columns [from, to) of
+// formatted line, clipped to the screen
+static void editor_append_hex_cols(AppendBuffer *ab, const char *buf, int from,
+                                   int to) {
+    to = MIN(to, editor_state.screen_cols);
+    if (from < to) { ab_append(ab, &buf[from], to - from); }
+}
+
+// lines are formatted from the mapped file as they are drawn
+static void editor_draw_hex_rows(AppendBuffer *ab) {
+    EditorHexView *view = editor_state.hex_view;
+    size_t lines = editor_hex_view_lines(view);
+    size_t cursor_line = view->cursor / HEX_VIEW_LINE_BYTES;
+
+    for (int y = 0; y < editor_state.screen_rows; y++) {
+        size_t line = view->scroll_line + y;
+
+        if (line >= lines) {
+            ab_append(ab, "~", 1);
+            editor_add_row_end(ab);
+            continue;
+        }
+
+        char buf[HEX_VIEW_LINE_MAX];
+        int len = editor_hex_view_format_line(view, line, buf);
+
+        ab_append(ab, "\x1b[2m", 4); // dim
+        editor_append_hex_cols(ab, buf, 0, view->offset_digits);
+        ab_append(ab, "\x1b[22m", 5); // un-dim (normal intensity)
+
+        // cursor's byte is inverted both in hex and as ASCII
+        if (line != cursor_line || view->size == 0) {
+            editor_append_hex_cols(ab, buf, view->offset_digits, len);
+        } else {
+            int hex_col, ascii_col;
+            editor_hex_view_byte_cols(view,
+                                      view->cursor % HEX_VIEW_LINE_BYTES,
+                                      &hex_col, &ascii_col);
+            int runs[] = {view->offset_digits, hex_col, hex_col + 2,
+                          ascii_col, ascii_col + 1, len};
+
+            for (int i = 0; i < 5; i++) {
+                if (i % 2 == 1) { ab_append(ab, "\x1b[7m", 4); } // invert
+                editor_append_hex_cols(ab, buf, runs[i], runs[i + 1]);
+                if (i % 2 == 1) { ab_append(ab, "\x1b[27m", 5); } // not invert
             }
         }
         editor_add_row_end(ab);
@@ -228,6 +481,19 @@ static void editor_draw_status_bar(AppendBuffer *ab) {
                                     &left_render_len, "%s",
                                     editor_state.modified ? " [Modified]" : "");
 
+    // following appends to file
+    editor_add_to_status_bar_buffer(
+        left_status, sizeof(left_status), &left_len, &left_render_len, "%s",
+        editor_is_following() ? " [Following]" : "");
+
+    // loading progress
+    int load_progress = editor_loading_progress();
+    if (load_progress != -1) {
+        editor_add_to_status_bar_buffer(left_status, sizeof(left_status),
+                                        &left_len, &left_render_len,
+                                        " [Loading %d%%]", load_progress);
+    }
+
     // match index/number of matches
     if (editor_state.mode == &find_mode) {
         editor_add_to_status_bar_buffer(
@@ -236,23 +502,30 @@ static void editor_draw_status_bar(AppendBuffer *ab) {
             editor_state.find_state.matches_count);
     }
 
+    // offset of cursor/size (hex view)
+    if (editor_state.hex_view != NULL) {
+        editor_add_to_status_bar_buffer(
+            right_status, sizeof(right_status), &right_len, &right_render_len,
+            "0x%zx/0x%zx", editor_state.hex_view->cursor,
+            editor_state.hex_view->size);
+    }
     // row/col positions (find mode)
-    if (editor_state.mode == &find_mode) {
+    else if (editor_state.mode == &find_mode) {
         FindMatch *fm = &editor_state.find_state
                              .matches[editor_state.find_state.match_index];
 
         editor_add_to_status_bar_buffer(
             right_status, sizeof(right_status), &right_len, &right_render_len,
-            "%d/%d, %d/%d", fm->row + 1, editor_state.num_rows, fm->col + 1,
-            editor_state.rows[fm->row].size);
+            "%d/%d, %zd/%zd", fm->row + 1, editor_state.num_rows, fm->col + 1,
+            editor_get_row(fm->row)->size);
     }
     // row/col positions (normal mode default)
     else {
         editor_add_to_status_bar_buffer(
             right_status, sizeof(right_status), &right_len, &right_render_len,
-            "%d/%d, %d/%d", editor_state.cursor_y + 1, editor_state.num_rows,
+            "%d/%d, %zd/%zd", editor_state.cursor_y + 1, editor_state.num_rows,
             editor_state.cursor_x + 1,
-            editor_state.rows[editor_state.cursor_y].size);
+            editor_get_row(editor_state.cursor_y)->size);
     }
 
     // scroll percentage
@@ -334,7 +607,25 @@ void editor_refresh_screen(void) {
         editor_state.num_col_width = 0;
     }
 
-    editor_scroll_render_update();
+    // rows accessed while drawing are kept should memory need to be freed
+    editor_line_tree_tick(editor_state.rows);
+    editor_update_gap_row();
+
+    EditorHexView *hex_view = editor_state.hex_view;
+    if (hex_view != NULL) {
+        // bytes cut off by truncating the file must not be drawn
+        if (editor_hex_view_refresh(hex_view)) {
+            size_t lines = editor_hex_view_lines(hex_view);
+            size_t screen_rows = MAX(editor_state.screen_rows, 1);
+            hex_view->scroll_line =
+                MIN(hex_view->scroll_line,
+                    lines > screen_rows ? lines - screen_rows : 0);
+            editor_set_status_message(MSG_WARNING, "File changed size on disk");
+        }
+        editor_hex_scroll_update(hex_view);
+    } else {
+        editor_scroll_render_update();
+    }
 
     // to be added to with the contents of the screen
     AppendBuffer ab = {.buf = NULL, .len = 0};
@@ -345,20 +636,26 @@ void editor_refresh_screen(void) {
 
     ab_append(&ab, "\x1b[H", 3); // move cursor to top-left
 
-    editor_draw_rows(&ab);
+    if (hex_view != NULL) {
+        editor_draw_hex_rows(&ab);
+    } else {
+        editor_draw_rows(&ab);
+    }
     editor_draw_status_bar(&ab);
     editor_draw_bottom_bar(&ab);
 
-    char command_buf[32];
+    char command_buf[48];
 
     // if command mode, return cursor to bottom of screen at input buffer
     // else return to text editor buffer position
     if (editor_state.mode == &command_mode) {
-        snprintf(command_buf, sizeof(command_buf), "\x1b[%d;%dH",
+        snprintf(command_buf, sizeof(command_buf), "\x1b[%d;%zuH",
                  editor_state.screen_cols - 1,
-                 editor_state.command_state.cursor_x + 1);
+                 editor_utf8_text_width(editor_state.command_state.buffer,
+                                        editor_state.command_state.cursor_x) +
+                     1);
     } else {
-        snprintf(command_buf, sizeof(command_buf), "\x1b[%d;%dH",
+        snprintf(command_buf, sizeof(command_buf), "\x1b[%d;%zdH",
                  (editor_state.cursor_y - editor_state.row_scroll_offset) + 1,
                  (editor_state.render_x - editor_state.col_scroll_offset +
                   editor_state.num_col_width) +
@@ -373,6 +670,8 @@ void editor_refresh_screen(void) {
 
     write(STDOUT_FILENO, ab.buf, ab.len);
     ab_free(&ab);
+
+    editor_limit_rows_memory();
 }
 
 void editor_page_scroll(EditorDirection dir, bool half) {
@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+
+#include "piece_table.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ADD_BLOCK_SIZE (64 * 1024)
+
+// add buffer is made up of blocks so that appending never moves earlier text
+typedef struct EditorAddBlock {
+    struct EditorAddBlock *next;
+    size_t len;
+    size_t capacity;
+    char data[];
+} EditorAddBlock;
+
+struct EditorPieceTable {
+    char *original;        // file contents (mapped or read into heap)
+    size_t original_size;  // size of file contents
+    bool original_mapped;  // whether original needs munmap() or free()
+    char *previous;        // original replaced by last load, until released
+    size_t previous_size;
+    bool previous_mapped;
+    EditorAddBlock *add;   // most recent block of add buffer
+};
+
+EditorPieceTable *editor_piece_table_create(void) {
+    EditorPieceTable *pt = malloc(sizeof *pt);
+    *pt = (EditorPieceTable){.original = NULL,
+                             .original_size = 0,
+                             .original_mapped = false,
+                             .previous = NULL,
+                             .previous_size = 0,
+                             .previous_mapped = false,
+                             .add = NULL};
+    return pt;
+}
+
+static void editor_free_text(char *text, size_t size, bool mapped) {
+    if (text == NULL) { return; }
+
+    if (mapped) {
+        munmap(text, size);
+    } else {
+        free(text);
+    }
+}
+
+static void editor_piece_table_free_original(EditorPieceTable *pt) {
+    editor_free_text(pt->original, pt->original_size, pt->original_mapped);
+    pt->original = NULL;
+    pt->original_size = 0;
+    pt->original_mapped = false;
+}
+
+static void editor_piece_table_free_previous(EditorPieceTable *pt) {
+    editor_free_text(pt->previous, pt->previous_size, pt->previous_mapped);
+    pt->previous = NULL;
+    pt->previous_size = 0;
+    pt->previous_mapped = false;
+}
+
+// reads until EOF, for files which report no size or do not support mmap()
+static bool editor_piece_table_read_file(EditorPieceTable *pt, int fd) {
+    size_t capacity = ADD_BLOCK_SIZE;
+    size_t size = 0;
+    char *buf = malloc(capacity);
+
+    while (true) {
+        if (size == capacity) {
+            capacity *= 2;
+            buf = realloc(buf, capacity);
+        }
+
+        ssize_t bytes_read = read(fd, buf + size, capacity - size);
+        if (bytes_read == -1) {
+            free(buf);
+            return false;
+        }
+        if (bytes_read == 0) { break; }
+        size += bytes_read;
+    }
+
+    if (size == 0) {
+        free(buf);
+        return true;
+    }
+
+    pt->original = buf;
+    pt->original_size = size;
+    pt->original_mapped = false;
+    return true;
+}
+
+// keeps the original readable as the previous one, until released
+static void editor_piece_table_retire_original(EditorPieceTable *pt) {
+    editor_piece_table_free_previous(pt);
+    pt->previous = pt->original;
+    pt->previous_size = pt->original_size;
+    pt->previous_mapped = pt->original_mapped;
+    pt->original = NULL;
+    pt->original_size = 0;
+    pt->original_mapped = false;
+}
+
+bool editor_piece_table_load_file(EditorPieceTable *pt, int fd) {
+    editor_piece_table_retire_original(pt);
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) { return false; }
+
+    if (st.st_size > 0) {
+        // MAP_PRIVATE so the text is never written through, note that changes
+        // made to the file by other processes may still become visible
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            pt->original = data;
+            pt->original_size = st.st_size;
+            pt->original_mapped = true;
+            return true;
+        }
+    }
+
+    return editor_piece_table_read_file(pt, fd);
+}
+
+void editor_piece_table_load_text(EditorPieceTable *pt, char *text,
+                                  size_t size) {
+    editor_piece_table_retire_original(pt);
+
+    if (size == 0) {
+        free(text);
+        return;
+    }
+
+    pt->original = text;
+    pt->original_size = size;
+}
+
+const char *editor_piece_table_original(const EditorPieceTable *pt,
+                                        size_t *size) {
+    *size = pt->original_size;
+    return pt->original;
+}
+
+const char *editor_piece_table_append(EditorPieceTable *pt, const char *string,
+                                      size_t len) {
+    if (len == 0) { return ""; }
+
+    EditorAddBlock *block = pt->add;
+
+    if (block == NULL || block->capacity - block->len < len) {
+        size_t capacity = MAX(len, ADD_BLOCK_SIZE);
+        block = malloc(sizeof(EditorAddBlock) + capacity);
+        block->next = pt->add;
+        block->len = 0;
+        block->capacity = capacity;
+        pt->add = block;
+    }
+
+    char *dest = &block->data[block->len];
+    memcpy(dest, string, len);
+    block->len += len;
+    return dest;
+}
+
+void editor_piece_table_release(EditorPieceTable *pt) {
+    editor_piece_table_free_previous(pt);
+
+    EditorAddBlock *block = pt->add;
+    while (block != NULL) {
+        EditorAddBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    pt->add = NULL;
+}
+
+void editor_piece_table_reset(EditorPieceTable *pt) {
+    editor_piece_table_free_original(pt);
+    editor_piece_table_release(pt);
+}
+
+void editor_piece_table_destroy(EditorPieceTable *pt) {
+    editor_piece_table_reset(pt);
+    free(pt);
+}
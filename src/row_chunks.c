@@ -0,0 +1,303 @@
+#include "row_chunks.h"
+#include "a1.h"
+#include "terminal.h"
+#include "utf8.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+// bytes held by every index
+static size_t chunks_memory = 0;
+
+static const EditorScanState unknown_state = {.skip = -1};
+
+static void editor_row_chunks_reserve(EditorRowChunks *chunks, int count) {
+    if (count <= chunks->capacity) { return; }
+
+    int capacity = MAX(chunks->capacity * 2, count);
+    EditorRowChunk *resized =
+        realloc(chunks->chunks, capacity * sizeof(EditorRowChunk));
+    if (resized == NULL) { terminal_die("editor_row_chunks_reserve"); }
+
+    chunks_memory += (capacity - chunks->capacity) * sizeof(EditorRowChunk);
+    chunks->chunks = resized;
+    chunks->capacity = capacity;
+}
+
+ssize_t editor_row_chunk_first_char(const EditorRow *row,
+                                    const EditorRowChunk *chunk) {
+    ssize_t start = editor_row_char_start(row, chunk->start);
+    if (start == chunk->start) { return start; }
+
+    int len;
+    editor_row_char_columns(row, start, 0, &len);
+    return start + len;
+}
+
+// measures how chunk's chars render, a multi-byte char belonging to the chunk
+// its first byte is in
+static void editor_row_chunk_measure(const EditorRow *row,
+                                     EditorRowChunk *chunk, int tab_stop) {
+    chunk->tabs = 0;
+    chunk->before = 0;
+    chunk->after = 0;
+
+    ssize_t i = editor_row_chunk_first_char(row, chunk);
+    chunk->ascii = i == chunk->start;
+
+    while (i < chunk->start + chunk->len) {
+        char c = editor_row_char_at(row, i);
+        int len = 1;
+        int width = 1;
+        if ((unsigned char)c & 0x80) {
+            width = editor_row_char_columns(row, i, 0, &len);
+            chunk->ascii = false;
+        }
+        i += len;
+
+        if (c == TAB) {
+            // columns after the first tab are counted from a tab stop
+            if (chunk->tabs > 0) {
+                chunk->after += tab_stop - chunk->after % tab_stop;
+            }
+            chunk->tabs++;
+        } else if (chunk->tabs == 0) {
+            chunk->before += width;
+        } else {
+            chunk->after += width;
+        }
+    }
+}
+
+ssize_t editor_row_chunk_end_col(const EditorRowChunks *chunks,
+                                 const EditorRowChunk *chunk) {
+    ssize_t col = chunk->col + chunk->before;
+    if (chunk->tabs == 0) { return col; }
+
+    // first tab moves to the next tab stop
+    return (col / chunks->tab_stop + 1) * chunks->tab_stop + chunk->after;
+}
+
+ssize_t editor_row_chunks_width(const EditorRowChunks *chunks) {
+    return editor_row_chunk_end_col(chunks, &chunks->chunks[chunks->count - 1]);
+}
+
+// updates the columns of chunks following first, stopping once a chunk starts
+// at the column it did before unless every chunk is to be updated
+static void editor_row_chunks_update_cols(EditorRowChunks *chunks, int first,
+                                          bool all) {
+    for (int i = first + 1; i < chunks->count; i++) {
+        ssize_t col =
+            editor_row_chunk_end_col(chunks, &chunks->chunks[i - 1]);
+        if (!all && chunks->chunks[i].col == col) { return; }
+        chunks->chunks[i].col = col;
+    }
+}
+
+static EditorRowChunks *editor_row_chunks_build(const EditorRow *row) {
+    EditorRowChunks *chunks = malloc(sizeof(EditorRowChunks));
+    if (chunks == NULL) { terminal_die("editor_row_chunks_build"); }
+    chunks_memory += sizeof(EditorRowChunks);
+
+    chunks->chunks = NULL;
+    chunks->count = 0;
+    chunks->capacity = 0;
+    chunks->tab_stop = editor_state.options.tab_stop;
+    chunks->dirty = 0;
+    chunks->syntax = NULL;
+    chunks->exit = unknown_state;
+
+    int count = MAX((row->size + ROW_CHUNK_SIZE - 1) / ROW_CHUNK_SIZE, 1);
+    editor_row_chunks_reserve(chunks, count);
+
+    for (int i = 0; i < count; i++) {
+        EditorRowChunk *chunk = &chunks->chunks[i];
+        chunk->start = (ssize_t)i * ROW_CHUNK_SIZE;
+        chunk->col = 0;
+        chunk->len = MIN(ROW_CHUNK_SIZE, row->size - chunk->start);
+        chunk->entry = unknown_state;
+        editor_row_chunk_measure(row, chunk, chunks->tab_stop);
+    }
+    chunks->count = count;
+
+    editor_row_chunks_update_cols(chunks, 0, true);
+    return chunks;
+}
+
+EditorRowChunks *editor_row_chunks(EditorRow *row) {
+    return editor_row_chunks_sized(row, LONG_ROW_SIZE);
+}
+
+EditorRowChunks *editor_row_chunks_sized(EditorRow *row, ssize_t min_size) {
+    EditorRowChunks *chunks = row->chunks;
+
+    if (chunks == NULL) {
+        if (row->size < min_size) { return NULL; }
+        row->chunks = editor_row_chunks_build(row);
+        return row->chunks;
+    }
+
+    // highlighting states do not depend on tab stop, only columns do
+    if (chunks->tab_stop != editor_state.options.tab_stop) {
+        chunks->tab_stop = editor_state.options.tab_stop;
+        for (int i = 0; i < chunks->count; i++) {
+            editor_row_chunk_measure(row, &chunks->chunks[i],
+                                     chunks->tab_stop);
+        }
+        editor_row_chunks_update_cols(chunks, 0, true);
+    }
+
+    return chunks;
+}
+
+void editor_row_chunks_free(EditorRow *row) {
+    EditorRowChunks *chunks = row->chunks;
+    if (chunks == NULL) { return; }
+
+    chunks_memory -=
+        sizeof(EditorRowChunks) + chunks->capacity * sizeof(EditorRowChunk);
+    free(chunks->chunks);
+    free(chunks);
+    row->chunks = NULL;
+}
+
+int editor_row_chunks_find(const EditorRowChunks *chunks, ssize_t idx) {
+    // last chunk starting at or before idx
+    int low = 0, high = chunks->count - 1;
+    while (low < high) {
+        int mid = low + (high - low + 1) / 2;
+        if (chunks->chunks[mid].start <= idx) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+int editor_row_chunks_find_col(const EditorRowChunks *chunks, ssize_t rx) {
+    int low = 0, high = chunks->count - 1;
+    while (low < high) {
+        int mid = low + (high - low + 1) / 2;
+        if (chunks->chunks[mid].col <= rx) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+// splits chunk in two once typed into up to twice its built size
+static void editor_row_chunks_split(EditorRowChunks *chunks,
+                                    const EditorRow *row, int i) {
+    editor_row_chunks_reserve(chunks, chunks->count + 1);
+    memmove(&chunks->chunks[i + 2], &chunks->chunks[i + 1],
+            (chunks->count - i - 1) * sizeof(EditorRowChunk));
+    chunks->count++;
+
+    EditorRowChunk *first = &chunks->chunks[i];
+    EditorRowChunk *second = &chunks->chunks[i + 1];
+    ssize_t len = first->len;
+
+    first->len = len / 2;
+    second->start = first->start + first->len;
+    second->len = len - first->len;
+    second->entry = unknown_state;
+
+    editor_row_chunk_measure(row, first, chunks->tab_stop);
+    editor_row_chunk_measure(row, second, chunks->tab_stop);
+    second->col = editor_row_chunk_end_col(chunks, first);
+}
+
+// marks highlighting states as needing to be scanned again from before idx
+static void editor_row_chunks_mark_dirty(EditorRowChunks *chunks,
+                                         ssize_t idx) {
+    // scanning a chunk reads a little past its end, so chunks ending shortly
+    // before idx are also scanned differently
+    int first =
+        editor_row_chunks_find(chunks, MAX(idx - ROW_CHUNK_LOOKAHEAD, 0));
+    int last = editor_row_chunks_find(chunks, idx);
+
+    // states up to the chunk containing idx are unknown, so that scanning
+    // does not stop at one before reaching it
+    for (int i = first + 1; i <= last; i++) {
+        chunks->chunks[i].entry = unknown_state;
+    }
+    chunks->dirty = MIN(chunks->dirty, first);
+}
+
+// applies a change of delta chars at idx, in chunk i, after the row's chars
+// changed
+static void editor_row_chunks_resize(EditorRow *row, int i, ssize_t idx,
+                                     ssize_t delta) {
+    EditorRowChunks *chunks = row->chunks;
+    EditorRowChunk *chunk = &chunks->chunks[i];
+    int measured = -1;
+
+    chunk->len += delta;
+    for (int j = i + 1; j < chunks->count; j++) {
+        chunks->chunks[j].start += delta;
+    }
+
+    if (chunk->len == 0 && chunks->count > 1) {
+        // text which followed the chunk now starts where it did, in the same
+        // state
+        if (i + 1 < chunks->count) {
+            chunks->chunks[i + 1].entry = chunk->entry;
+            chunks->chunks[i + 1].col = chunk->col;
+        }
+        memmove(chunk, chunk + 1,
+                (chunks->count - i - 1) * sizeof(EditorRowChunk));
+        chunks->count--;
+    } else {
+        editor_row_chunk_measure(row, chunk, chunks->tab_stop);
+        measured = i;
+        if (chunk->len >= 2 * ROW_CHUNK_SIZE) {
+            editor_row_chunks_split(chunks, row, i);
+            measured = i + 1;
+        }
+    }
+
+    // a multi-byte char may run on from one chunk into the next, so chunks
+    // next to the change may measure differently too (unless all ASCII)
+    int first =
+        editor_row_chunks_find(chunks, MAX(idx - (UTF8_MAX_LEN - 1), 0));
+    int last = editor_row_chunks_find(chunks, idx + (UTF8_MAX_LEN - 1));
+    for (int j = first; j <= last; j++) {
+        if (j != measured && !chunks->chunks[j].ascii) {
+            editor_row_chunk_measure(row, &chunks->chunks[j],
+                                     chunks->tab_stop);
+        }
+    }
+
+    for (int j = first; j < last; j++) {
+        chunks->chunks[j + 1].col =
+            editor_row_chunk_end_col(chunks, &chunks->chunks[j]);
+    }
+    editor_row_chunks_update_cols(chunks, MAX(last, measured), false);
+
+    editor_row_chunks_mark_dirty(chunks, idx);
+}
+
+void editor_row_chunks_insert(EditorRow *row, ssize_t idx) {
+    if (row->chunks == NULL) { return; }
+    editor_row_chunks_resize(row, editor_row_chunks_find(row->chunks, idx),
+                             idx, 1);
+}
+
+void editor_row_chunks_delete(EditorRow *row, ssize_t idx) {
+    if (row->chunks == NULL) { return; }
+    editor_row_chunks_resize(row, editor_row_chunks_find(row->chunks, idx),
+                             idx, -1);
+}
+
+void editor_row_chunks_replace(EditorRow *row, ssize_t idx) {
+    if (row->chunks == NULL) { return; }
+    editor_row_chunks_resize(row, editor_row_chunks_find(row->chunks, idx),
+                             idx, 0);
+}
+
+size_t editor_row_chunks_memory(void) {
+    return chunks_memory;
+}
@@ -1,4 +1,5 @@
 #include "a1.h"
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
@@ -21,6 +22,18 @@ void terminal_quit(void) {
     exit(EXIT_SUCCESS);
 }
 
+int terminal_detach_stdin(void) {
+    int fd = dup(STDIN_FILENO);
+    if (fd == -1) { terminal_die("dup"); }
+
+    int tty = open("/dev/tty", O_RDWR);
+    if (tty == -1) { terminal_die("/dev/tty"); }
+    if (dup2(tty, STDIN_FILENO) == -1) { terminal_die("dup2"); }
+    close(tty);
+
+    return fd;
+}
+
 void terminal_disable_raw_mode(void) {
     int result =
         tcsetattr(STDIN_FILENO, TCSAFLUSH, &editor_state.original_termios);
@@ -1,91 +1,287 @@
 #define _GNU_SOURCE
 
 #include "a1.h"
+#include "operations.h"
+#include "utf8.h"
+#include "util.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 // ===== EDITOR ================================================================
 
-int editor_row_cx_to_rx(const EditorRow *row, int cx) {
-    int rx = 0;
-    int tab_stop = editor_state.options.tab_stop;
+char editor_row_char_at(const EditorRow *row, ssize_t idx) {
+    if (idx < row->gap_start) { return row->chars[idx]; }
+    return row->chars[idx + row->gap_len];
+}
+
+int editor_row_decode(const EditorRow *row, ssize_t idx,
+                      uint32_t *code_point) {
+    char bytes[UTF8_MAX_LEN];
+    int len = MIN(UTF8_MAX_LEN, row->size - idx);
+    for (int i = 0; i < len; i++) {
+        bytes[i] = editor_row_char_at(row, idx + i);
+    }
+    return editor_utf8_decode(bytes, len, code_point);
+}
+
+int editor_row_char_columns(const EditorRow *row, ssize_t idx, ssize_t col,
+                            int *len) {
+    char c = editor_row_char_at(row, idx);
+    *len = 1;
+
+    if (c == TAB) {
+        int tab_stop = editor_state.options.tab_stop;
+        return tab_stop - col % tab_stop;
+    }
+    if (!((unsigned char)c & 0x80)) { return 1; }
+
+    // invalid bytes and C1 control chars are drawn as '?'
+    uint32_t code_point;
+    int seq_len = editor_row_decode(row, idx, &code_point);
+    if (seq_len == 0) { return 1; }
+    *len = seq_len;
+    return code_point < 0xA0 ? 1 : editor_utf8_width(code_point);
+}
+
+ssize_t editor_row_char_start(const EditorRow *row, ssize_t idx) {
+    if (idx >= row->size ||
+        !UTF8_IS_CONTINUATION(editor_row_char_at(row, idx))) {
+        return idx;
+    }
+
+    // continuation byte is part of the sequence of the byte starting one
+    // before it, if valid
+    for (ssize_t start = idx - 1; start >= MAX(idx - 3, 0); start--) {
+        if (UTF8_IS_CONTINUATION(editor_row_char_at(row, start))) { continue; }
+
+        uint32_t code_point;
+        int len = editor_row_decode(row, start, &code_point);
+        return start + len > idx ? start : idx;
+    }
+    return idx;
+}
+
+// whether char at idx is drawn with the one before it
+static bool editor_row_char_combines(const EditorRow *row, ssize_t idx) {
+    if (!((unsigned char)editor_row_char_at(row, idx) & 0x80)) { return false; }
+
+    int len;
+    return editor_row_char_columns(row, idx, 0, &len) == 0;
+}
+
+ssize_t editor_row_next_char(const EditorRow *row, ssize_t idx) {
+    if (idx >= row->size) { return row->size; }
+
+    int len;
+    editor_row_char_columns(row, idx, 0, &len);
+    idx += len;
 
-    for (int i = 0; i < cx; i++) {
-        if (row->chars[i] == TAB) { rx += (tab_stop - 1) - (rx % tab_stop); }
-        rx++;
+    while (idx < row->size && editor_row_char_combines(row, idx)) {
+        editor_row_char_columns(row, idx, 0, &len);
+        idx += len;
     }
-    return rx;
+    return idx;
 }
 
-int editor_row_rx_to_cx(const EditorRow *row, const int rx) {
-    int tab_stop = editor_state.options.tab_stop;
+ssize_t editor_row_prev_char(const EditorRow *row, ssize_t idx) {
+    if (idx <= 0) { return 0; }
+
+    idx = editor_row_char_start(row, idx - 1);
+    while (idx > 0 && editor_row_char_combines(row, idx)) {
+        idx = editor_row_char_start(row, idx - 1);
+    }
+    return idx;
+}
+
+ssize_t editor_row_cx_to_rx(EditorRow *row, ssize_t cx) {
+    if (cx <= 0) { return 0; }
+
+    // long rows are measured from the start of the chunk containing cx
+    const EditorRowChunks *chunks = editor_row_chunks(row);
+    if (chunks != NULL) {
+        cx = editor_row_char_start(row, cx);
+        const EditorRowChunk *chunk =
+            &chunks->chunks[editor_row_chunks_find(chunks, cx)];
+        if (chunk->ascii && chunk->tabs == 0) {
+            return chunk->col + (cx - chunk->start);
+        }
+
+        ssize_t rx = chunk->col;
+        ssize_t i = editor_row_chunk_first_char(row, chunk);
+        while (i < cx) {
+            int len;
+            rx += editor_row_char_columns(row, i, rx, &len);
+            i += len;
+        }
+        return rx;
+    }
+
+    // other rows from the last glyph before cx
+    editor_prepare_row_glyphs(row);
+    int low = 0, high = row->glyph_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (row->glyphs[mid].idx < cx) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) { return cx; }
+
+    const EditorRowGlyph *glyph = &row->glyphs[low - 1];
+    if (cx < glyph->idx + glyph->len) { return glyph->col; }
+    return glyph->col + glyph->width + (cx - glyph->idx - glyph->len);
+}
+
+ssize_t editor_row_rx_to_cx(EditorRow *row, const ssize_t rx) {
+    const EditorRowChunks *chunks = editor_row_chunks(row);
+    if (chunks != NULL) {
+        const EditorRowChunk *chunk =
+            &chunks->chunks[editor_row_chunks_find_col(chunks, rx)];
+        if (chunk->ascii && chunk->tabs == 0 && rx - chunk->col < chunk->len) {
+            return chunk->start + (rx - chunk->col);
+        }
+
+        ssize_t current_rx = chunk->col;
+        ssize_t cx = editor_row_chunk_first_char(row, chunk);
+        while (cx < row->size) {
+            int len;
+            current_rx += editor_row_char_columns(row, cx, current_rx, &len);
+            if (current_rx > rx) { return cx; }
+            cx += len;
+        }
+
+        return cx; // only needed when rx is out of range
+    }
 
-    int current_rx = 0;
-    int cx;
+    if (rx < 0) { return 0; }
 
-    for (cx = 0; cx < row->size; cx++) {
-        if (row->chars[cx] == TAB) {
-            current_rx += (tab_stop - 1) - (current_rx % tab_stop);
+    // other rows from the last glyph ending at or before rx
+    editor_prepare_row_glyphs(row);
+    int low = 0, high = row->glyph_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        const EditorRowGlyph *glyph = &row->glyphs[mid];
+        if (glyph->col + glyph->width <= rx) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
-        current_rx++;
+    }
 
-        if (current_rx > rx) { return cx; }
+    ssize_t cx = rx;
+    if (low > 0) {
+        const EditorRowGlyph *glyph = &row->glyphs[low - 1];
+        cx = glyph->idx + glyph->len + (rx - glyph->col - glyph->width);
     }
 
-    return cx; // only needed when rx is out of range
+    // rx may be within the next glyph
+    if (low < row->glyph_count) { cx = MIN(cx, row->glyphs[low].idx); }
+    return MIN(cx, row->size);
 }
 
 void editor_get_scroll_percentage(char *buf, size_t size) {
-    if (editor_state.row_scroll_offset == 0) {
+    // the hex view scrolls by lines of bytes rather than rows
+    ssize_t scroll_offset = editor_state.row_scroll_offset;
+    ssize_t num_rows = editor_state.num_rows;
+    if (editor_state.hex_view != NULL) {
+        scroll_offset = editor_state.hex_view->scroll_line;
+        num_rows = editor_hex_view_lines(editor_state.hex_view);
+    }
+
+    if (scroll_offset == 0) {
         strncpy(buf, "Top", size);
-    } else if (editor_state.num_rows - editor_state.screen_rows ==
-               editor_state.row_scroll_offset) {
+    } else if (num_rows - editor_state.screen_rows == scroll_offset) {
         strncpy(buf, "Bot", size);
     } else {
-        double percentage =
-            ((double)(editor_state.row_scroll_offset) /
-             (editor_state.num_rows - editor_state.screen_rows)) *
-            100;
+        double percentage = ((double)scroll_offset /
+                             (num_rows - editor_state.screen_rows)) *
+                            100;
         snprintf(buf, size, "%d%%", (int)percentage);
     }
 }
 
-char *editor_rows_to_string(int *buf_len) {
-    int total_len = 0;
-    for (int i = 0; i < editor_state.num_rows; i++) {
-        total_len += editor_state.rows[i].size + 1; // +1 for newline character
+// copies text of run to buf (unless NULL), with a newline after each line,
+// returns number of bytes
+// unloaded lines are copied straight from the mapped file (or their pack)
+// without loading them
+static size_t editor_copy_run(const EditorLineRun *run, char *buf) {
+    const EditorLineIndex *index = editor_state.line_index;
+    const char *text;
+    size_t len;
+
+    if (run->row != NULL) {
+        text = run->row->chars;
+        len = run->row->size;
+    } else if (run->pack == NULL &&
+               !editor_line_index_has_carriage_returns(index)) {
+        // newlines between lines are already in place
+        text = editor_line_index_lines(index, run->source_line, run->count,
+                                       &len);
+    } else {
+        size_t total_len = 0;
+        for (int i = 0; i < run->count; i++) {
+            text = editor_unloaded_line(run, i, &len);
+            if (buf != NULL) {
+                memcpy(buf + total_len, text, len);
+                buf[total_len + len] = '\n';
+            }
+            total_len += len + 1;
+        }
+        return total_len;
+    }
+
+    if (buf != NULL) {
+        memcpy(buf, text, len);
+        buf[len] = '\n';
+    }
+    return len + 1; // +1 for newline character
+}
+
+char *editor_rows_to_string(size_t *buf_len) {
+    EditorLineRun run;
+    bool more;
+
+    size_t total_len = 0;
+    more = editor_line_tree_first_run(editor_state.rows, &run);
+    for (; more; more = editor_line_tree_next_run(&run)) {
+        total_len += editor_copy_run(&run, NULL);
     }
     *buf_len = total_len;
 
     char *buf = malloc(total_len);
+    if (buf == NULL) { return NULL; }
+
     char *buf_p = buf;
-    for (int i = 0; i < editor_state.num_rows; i++) {
-        memcpy(buf_p, editor_state.rows[i].chars, editor_state.rows[i].size);
-        buf_p += editor_state.rows[i].size;
-        *buf_p = '\n';
-        buf_p++;
+    more = editor_line_tree_first_run(editor_state.rows, &run);
+    for (; more; more = editor_line_tree_next_run(&run)) {
+        buf_p += editor_copy_run(&run, buf_p);
     }
 
     return buf;
 }
 
-int editor_get_backspace_deletion_count(const EditorRow *row, int cursor_x) {
+int editor_get_backspace_deletion_count(EditorRow *row, ssize_t cursor_x) {
     if (cursor_x < 2) { return cursor_x; }
 
     int count = 0;
-    int i = cursor_x - 1;
+    ssize_t i = cursor_x - 1;
+
+    // spaces before cursor take a column each, back from the cursor's
+    ssize_t cursor_col = editor_row_cx_to_rx(row, cursor_x);
 
     while (true) {
         // if reached end
         if (i < 0) { break; }
 
         // if reached non-space character
-        if (row->chars[i] != SPACE) { break; }
+        if (editor_row_char_at(row, i) != SPACE) { break; }
 
         // check if at tab stop increment
-        if ((i + editor_state.options.tab_stop) %
-                editor_state.options.tab_stop ==
+        if ((cursor_col - (cursor_x - i)) % editor_state.options.tab_stop ==
             0) {
             count++;
             break;
@@ -100,10 +296,11 @@ int editor_get_backspace_deletion_count(const EditorRow *row, int cursor_x) {
     return count;
 }
 
-int editor_get_first_non_whitespace(EditorRow *row) {
-    int i = 0;
+ssize_t editor_get_first_non_whitespace(EditorRow *row) {
+    ssize_t i = 0;
     while (i < row->size) {
-        if (row->chars[i] != SPACE && row->chars[i] != TAB) { return i; }
+        char c = editor_row_char_at(row, i);
+        if (c != SPACE && c != TAB) { return i; }
         i++;
     }
     return -1;
@@ -166,6 +363,59 @@ int parse_int(const char *string, bool *valid) {
     return num;
 }
 
+size_t parse_size(const char *string, bool *valid) {
+    size_t len = strlen(string);
+    size_t unit = 1;
+
+    if (len > 0) {
+        switch (string[len - 1]) {
+        case 'K':
+        case 'k':
+            unit = (size_t)1 << 10;
+            break;
+        case 'M':
+        case 'm':
+            unit = (size_t)1 << 20;
+            break;
+        case 'G':
+        case 'g':
+            unit = (size_t)1 << 30;
+            break;
+        }
+        if (unit != 1) { len--; }
+    }
+
+    *valid = false;
+    if (len == 0) { return 0; }
+
+    size_t num = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (string[i] < '0' || string[i] > '9') { return 0; }
+        if (num > (SIZE_MAX - (string[i] - '0')) / 10) { return 0; }
+        num = num * 10 + (string[i] - '0');
+    }
+
+    if (num > SIZE_MAX / unit) { return 0; }
+    *valid = true;
+    return num * unit;
+}
+
+void size_to_str(size_t size, char *buffer, size_t buffer_size) {
+    const char *suffixes = "KMG";
+    int suffix = -1;
+
+    while (suffix < 2 && size != 0 && size % 1024 == 0) {
+        size /= 1024;
+        suffix++;
+    }
+
+    if (suffix < 0) {
+        snprintf(buffer, buffer_size, "%zu", size);
+    } else {
+        snprintf(buffer, buffer_size, "%zu%c", size, suffixes[suffix]);
+    }
+}
+
 char *file_name_from_file_path(const char *file_path) {
     const char *separator = "/";
     const char *ch_ptr = file_path;
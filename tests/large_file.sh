@@ -0,0 +1,88 @@
+#!/bin/sh
+# Loads, edits and saves a generated text file of over 4GB in large-file mode,
+# then compares the file saved with the text expected, byte for byte. Lines
+# are edited and deleted on both sides of the 4GB offset, so that sizes and
+# offsets needing more than 32 bits are exercised.
+#
+# usage: tests/large_file.sh [A1_BINARY] (default ./a1)
+# needs about 10GB free in $TMPDIR (default /tmp), skipped otherwise
+
+set -eu
+
+a1=$(realpath "${1:-./a1}")
+dir=$(mktemp -d "${TMPDIR:-/tmp}/a1-large-file.XXXXXX")
+trap 'rm -rf "$dir"' EXIT
+trap 'exit 1' INT TERM
+
+lines=70000000 # of 65 bytes each, 4550000000 bytes in all
+mid=67000000   # first byte is at 4354999935, past 4GB
+del=69000000
+
+# twice the file's size, as it is saved to a new file renamed over it
+avail=$(df -Pk "$dir" | awk 'NR == 2 { print $4 }')
+if [ "$avail" -lt $((10 * 1024 * 1024)) ]; then
+    echo "large_file: skipped, needs 10GB free in $dir"
+    exit 0
+fi
+
+# prints lines from to to of the file as generated
+text() {
+    seq -f '%015.0f the quick brown fox jumps over the lazy dog 0123' "$1" "$2"
+}
+
+expected() {
+    printf 'FIRST '
+    text 1 $((mid - 1))
+    text "$mid" "$mid" | sed 's/$/ MID/'
+    text $((mid + 1)) $((del - 1))
+    text $((del + 1)) $((lines - 1))
+    text "$lines" "$lines" | sed 's/$/ LAST/'
+}
+
+# sends keys, pausing so that an escape is not read as the start of an escape
+# sequence along with the keys after it
+send() {
+    printf "$1"
+    sleep 1
+}
+
+# waits (up to 10 minutes) for text to be drawn
+wait_for() {
+    n=0
+    until grep -q "$1" "$dir/screen" 2>/dev/null; do
+        n=$((n + 1))
+        [ "$n" -lt 600 ] || return 0
+        sleep 1
+    done
+}
+
+echo "large_file: generating $dir/file"
+text 1 "$lines" >"$dir/file"
+
+echo "large_file: editing"
+start=$(date +%s)
+{
+    sleep 2 # keys sent before the terminal is set up are discarded
+    send 'iFIRST \033'
+    send " goto $mid\r"
+    send 'A MID\033'
+    send " goto $del\r"
+    send 'd'
+    send 'GA LAST\033'
+    send 's'
+    wait_for 'bytes written\|Cannot save'
+    send 'Q'
+} | script -qfec "stty rows 24 cols 80; XDG_STATE_HOME='$dir' \
+exec '$a1' --clean --large '$dir/file'" "$dir/screen" >/dev/null
+echo "large_file: edited and saved in $(($(date +%s) - start))s"
+
+if ! grep -q 'bytes written' "$dir/screen"; then
+    echo "large_file: FAILED, file was not saved"
+    exit 1
+fi
+
+if ! expected | cmp - "$dir/file"; then
+    echo "large_file: FAILED, file saved differs from the text expected"
+    exit 1
+fi
+echo "large_file: ok"